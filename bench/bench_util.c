@@ -0,0 +1,96 @@
+#include "bench_util.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define MAX_BASELINE 256
+
+// A throughput loaded from a baseline file
+typedef struct {
+    char corpus[128];
+    char stage[16];
+    double throughput;
+} BaselineEntry;
+
+static BaselineEntry baseline[MAX_BASELINE];
+static int baseline_count = 0;
+
+// Get a monotonic time in seconds
+double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Order doubles for qsort
+static int compare_doubles(const void* a, const void* b) {
+    double x = *(const double*)a;
+    double y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+// Median of count samples; reorders the samples
+double median(double* samples, int count) {
+    qsort(samples, count, sizeof(double), compare_doubles);
+    if (count % 2) {
+        return samples[count / 2];
+    }
+    return (samples[count / 2 - 1] + samples[count / 2]) / 2;
+}
+
+// Read a whole file into a NUL-terminated buffer
+char* read_file(const char* path) {
+    FILE* file = fopen(path, "rb");
+    if (!file) {
+        perror(path);
+        exit(1);
+    }
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    char* source = (char*)malloc(size + 1);
+    if (!source || fread(source, 1, size, file) != (size_t)size) {
+        fprintf(stderr, "Failed to read %s\n", path);
+        exit(1);
+    }
+    source[size] = '\0';
+    fclose(file);
+    return source;
+}
+
+// Get the file name without its directory and extension
+void corpus_name(const char* path, char* out, size_t size) {
+    const char* base = strrchr(path, '/');
+    base = base ? base + 1 : path;
+    snprintf(out, size, "%s", base);
+    char* dot = strrchr(out, '.');
+    if (dot) {
+        *dot = '\0';
+    }
+}
+
+// Load a baseline written by --save; returns false if there is no file
+bool load_baseline(const char* path) {
+    FILE* file = fopen(path, "r");
+    if (!file) {
+        return false;
+    }
+    BaselineEntry entry;
+    while (baseline_count < MAX_BASELINE &&
+           fscanf(file, "%127s %15s %lf", entry.corpus, entry.stage, &entry.throughput) == 3) {
+        baseline[baseline_count++] = entry;
+    }
+    fclose(file);
+    return true;
+}
+
+// Find a baseline throughput, or 0 if there is none
+double baseline_throughput(const char* corpus, const char* stage) {
+    for (int i = 0; i < baseline_count; i++) {
+        if (strcmp(baseline[i].corpus, corpus) == 0 && strcmp(baseline[i].stage, stage) == 0) {
+            return baseline[i].throughput;
+        }
+    }
+    return 0;
+}
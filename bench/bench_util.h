@@ -0,0 +1,22 @@
+// Helpers shared by the benchmarks: timing, medians, reading a corpus
+// file and baselines of throughputs saved by an earlier run.
+//
+// A baseline file holds one "corpus stage throughput" line per
+// measurement, as written by a benchmark's --save option.
+#ifndef IBERY_BENCH_UTIL_H
+#define IBERY_BENCH_UTIL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#define DEFAULT_RUNS 9
+#define MAX_RUNS 1000
+
+double now_seconds(void);
+double median(double* samples, int count);
+char* read_file(const char* path);
+void corpus_name(const char* path, char* out, size_t size);
+bool load_baseline(const char* path);
+double baseline_throughput(const char* corpus, const char* stage);
+
+#endif // IBERY_BENCH_UTIL_H
@@ -0,0 +1,111 @@
+// Keyword classification microbenchmark.
+//
+// Compares the perfect hash in keywords.c against the linear strncmp scan
+// the lexer used before it, on a corpus of keywords mixed with ordinary
+// identifiers, and reports identifiers classified per second.
+#include "keywords.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define CORPUS_SIZE 100000
+#define ROUNDS 50
+
+typedef struct {
+    const char* text;
+    int length;
+} Identifier;
+
+static const struct {
+    const char* keyword;
+    TokenType type;
+} keyword_list[] = {
+#define KEYWORD(text, type) {text, type},
+#include "keywords.def"
+#undef KEYWORD
+    {NULL, TOKEN_IDENTIFIER}
+};
+
+static const char* plain_identifiers[] = {
+    "player", "mass", "acceleration", "force", "calculate_force",
+    "animate_game", "setup_backend", "create_frontend", "main", "x",
+    "velocity", "create_game_object", "set_position", "move_object",
+    "display", "create_api", "create_button", "create_input", "count",
+    "index", "result", "value", "items", "name", "total_mass", "dt"
+};
+
+// The lexer's keyword lookup before the perfect hash
+static TokenType linear_lookup(const char* text, int length) {
+    for (int i = 0; keyword_list[i].keyword; i++) {
+        if (strncmp(text, keyword_list[i].keyword, length) == 0 &&
+            keyword_list[i].keyword[length] == '\0') {
+            return keyword_list[i].type;
+        }
+    }
+    return TOKEN_IDENTIFIER;
+}
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Classify the corpus ROUNDS times and return identifiers per second
+static double measure(TokenType (*lookup)(const char*, int),
+                      const Identifier* corpus, long* checksum) {
+    double start = now_seconds();
+    long sum = 0;
+    for (int round = 0; round < ROUNDS; round++) {
+        for (int i = 0; i < CORPUS_SIZE; i++) {
+            sum += lookup(corpus[i].text, corpus[i].length);
+        }
+    }
+    double elapsed = now_seconds() - start;
+    *checksum = sum;
+    return (double)CORPUS_SIZE * ROUNDS / elapsed;
+}
+
+int main(void) {
+    int keyword_count = 0;
+    while (keyword_list[keyword_count].keyword) {
+        keyword_count++;
+    }
+    int plain_count = (int)(sizeof(plain_identifiers) / sizeof(plain_identifiers[0]));
+
+    // Roughly one keyword for every three identifiers, as in typical scripts
+    Identifier* corpus = (Identifier*)malloc(CORPUS_SIZE * sizeof(Identifier));
+    srand(42);
+    for (int i = 0; i < CORPUS_SIZE; i++) {
+        const char* text;
+        if (rand() % 4 == 0) {
+            text = keyword_list[rand() % keyword_count].keyword;
+        } else {
+            text = plain_identifiers[rand() % plain_count];
+        }
+        corpus[i].text = text;
+        corpus[i].length = (int)strlen(text);
+    }
+
+    for (int i = 0; i < CORPUS_SIZE; i++) {
+        if (linear_lookup(corpus[i].text, corpus[i].length) !=
+            lookup_keyword(corpus[i].text, corpus[i].length)) {
+            fprintf(stderr, "Mismatch classifying '%s'\n", corpus[i].text);
+            return 1;
+        }
+    }
+
+    long linear_sum, hash_sum;
+    double linear_rate = measure(linear_lookup, corpus, &linear_sum);
+    double hash_rate = measure(lookup_keyword, corpus, &hash_sum);
+
+    printf("keywords: %d, corpus: %d identifiers x %d rounds\n",
+           keyword_count, CORPUS_SIZE, ROUNDS);
+    printf("linear scan:  %12.0f identifiers/sec\n", linear_rate);
+    printf("perfect hash: %12.0f identifiers/sec (%.1fx)\n",
+           hash_rate, hash_rate / linear_rate);
+
+    free(corpus);
+    return linear_sum == hash_sum ? 0 : 1;
+}
@@ -0,0 +1,156 @@
+// Compiler pipeline benchmark.
+//
+// Usage: pipeline_bench [--runs N] [--baseline FILE] [--save FILE] <file.ibery>...
+//
+// Lexes, parses and generates code for each file N times and reports the
+// median time of every stage with its throughput: tokens/sec for lexing,
+// AST nodes/sec for parsing and module bytes/sec for codegen. With
+// --baseline, each throughput is compared against a file written earlier
+// by --save.
+#include "lexer.h"
+#include "parser.h"
+#include "codegen.h"
+#include "bench_util.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef enum {
+    STAGE_LEX,
+    STAGE_PARSE,
+    STAGE_CODEGEN,
+    STAGE_COUNT
+} Stage;
+
+static const char* stage_names[STAGE_COUNT] = { "lex", "parse", "codegen" };
+static const char* stage_units[STAGE_COUNT] = { "tokens/s", "nodes/s", "bytes/s" };
+
+// Format a rate with a metric suffix
+static void format_rate(double rate, char* out, size_t size) {
+    if (rate >= 1e9) {
+        snprintf(out, size, "%.2fG", rate / 1e9);
+    } else if (rate >= 1e6) {
+        snprintf(out, size, "%.2fM", rate / 1e6);
+    } else if (rate >= 1e3) {
+        snprintf(out, size, "%.2fK", rate / 1e3);
+    } else {
+        snprintf(out, size, "%.2f", rate);
+    }
+}
+
+// Benchmark one file and report (and optionally save) its throughputs
+static void bench_file(const char* path, int runs, FILE* save) {
+    char* source = read_file(path);
+    char corpus[128];
+    corpus_name(path, corpus, sizeof(corpus));
+
+    double samples[STAGE_COUNT][MAX_RUNS];
+    double work[STAGE_COUNT] = { 0 };
+    Arena* arena = create_arena(0);
+
+    for (int run = 0; run < runs; run++) {
+        arena_reset(arena);
+
+        double start = now_seconds();
+        Lexer* lexer = create_lexer(source, arena);
+        TokenBuffer* tokens = lex_all(lexer);
+        double lexed = now_seconds();
+
+        Parser* parser = create_buffered_parser(lexer, tokens);
+        AST* ast = parse_program(parser);
+        double parsed = now_seconds();
+
+        CodeGenerator* gen = create_code_generator(arena, parser->strings);
+        size_t module_size;
+        generate_code(gen, ast, &module_size);
+        double generated = now_seconds();
+
+        samples[STAGE_LEX][run] = lexed - start;
+        samples[STAGE_PARSE][run] = parsed - lexed;
+        samples[STAGE_CODEGEN][run] = generated - parsed;
+        work[STAGE_LEX] = tokens->count;
+        work[STAGE_PARSE] = ast->node_count;
+        work[STAGE_CODEGEN] = module_size;
+
+        destroy_code_generator(gen);
+        destroy_parser(parser);
+        destroy_lexer(lexer);
+    }
+
+    for (int stage = 0; stage < STAGE_COUNT; stage++) {
+        double seconds = median(samples[stage], runs);
+        double throughput = seconds > 0 ? work[stage] / seconds : 0;
+        char rate[32];
+        format_rate(throughput, rate, sizeof(rate));
+
+        printf("%-12s %-8s %10.3f ms %10s %-9s", corpus, stage_names[stage],
+               seconds * 1e3, rate, stage_units[stage]);
+        double previous = baseline_throughput(corpus, stage_names[stage]);
+        if (previous > 0) {
+            printf(" %+7.1f%% vs baseline", (throughput / previous - 1) * 100);
+        }
+        printf("\n");
+
+        if (save) {
+            fprintf(save, "%s %s %.6e\n", corpus, stage_names[stage], throughput);
+        }
+    }
+
+    destroy_arena(arena);
+    free(source);
+}
+
+int main(int argc, char** argv) {
+    int runs = DEFAULT_RUNS;
+    const char* baseline_path = NULL;
+    const char* save_path = NULL;
+    int first_file = 1;
+
+    while (first_file < argc && strncmp(argv[first_file], "--", 2) == 0) {
+        const char* option = argv[first_file];
+        if (first_file + 1 >= argc) {
+            fprintf(stderr, "Missing value for %s\n", option);
+            return 1;
+        }
+        const char* value = argv[first_file + 1];
+        if (strcmp(option, "--runs") == 0) {
+            runs = atoi(value);
+        } else if (strcmp(option, "--baseline") == 0) {
+            baseline_path = value;
+        } else if (strcmp(option, "--save") == 0) {
+            save_path = value;
+        } else {
+            fprintf(stderr, "Unknown option %s\n", option);
+            return 1;
+        }
+        first_file += 2;
+    }
+    if (first_file >= argc || runs < 1 || runs > MAX_RUNS) {
+        fprintf(stderr, "Usage: %s [--runs N] [--baseline FILE] [--save FILE] <file.ibery>...\n",
+                argv[0]);
+        return 1;
+    }
+
+    if (baseline_path && !load_baseline(baseline_path)) {
+        fprintf(stderr, "No baseline at %s; run make bench-baseline to create one\n", baseline_path);
+    }
+    FILE* save = NULL;
+    if (save_path) {
+        save = fopen(save_path, "w");
+        if (!save) {
+            perror(save_path);
+            return 1;
+        }
+    }
+
+    printf("%d runs per stage, median time\n", runs);
+    for (int i = first_file; i < argc; i++) {
+        bench_file(argv[i], runs, save);
+    }
+
+    if (save) {
+        fclose(save);
+        printf("Saved baseline to %s\n", save_path);
+    }
+    return 0;
+}
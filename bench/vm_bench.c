@@ -0,0 +1,130 @@
+// Virtual machine benchmark.
+//
+// Usage: vm_bench [--runs N] [--baseline FILE] [--save FILE] <file.ibery>...
+//
+// Compiles and loads each file once, then runs it N times with its output
+// discarded and reports the median time per run. Built twice by the
+// Makefile, with NaN-boxed values and with -DVM_STRUCT_VALUES, so that
+// make vm-bench can compare the two value representations: the struct
+// build saves a baseline and the NaN-boxed build is measured against it.
+#include "lexer.h"
+#include "parser.h"
+#include "codegen.h"
+#include "vm.h"
+#include "bench_util.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef VM_STRUCT_VALUES
+#define VALUE_REPRESENTATION "struct"
+#else
+#define VALUE_REPRESENTATION "NaN-boxed"
+#endif
+
+// Benchmark one file and report (and optionally save) its runs per second
+static void bench_file(const char* path, int runs, FILE* output, FILE* save) {
+    char* source = read_file(path);
+    char corpus[128];
+    corpus_name(path, corpus, sizeof(corpus));
+
+    Arena* arena = create_arena(0);
+    Lexer* lexer = create_lexer(source, arena);
+    Parser* parser = create_parser(lexer);
+    AST* ast = parse_program(parser);
+    CodeGenerator* gen = create_code_generator(arena, parser->strings);
+    size_t module_size;
+    uint8_t* module = generate_code(gen, ast, &module_size);
+
+    VM* vm = create_vm();
+    vm_set_output(vm, output);
+    vm_load(vm, module, module_size);
+
+    double samples[MAX_RUNS];
+    for (int run = 0; run < runs; run++) {
+        double start = now_seconds();
+        vm_run(vm);
+        samples[run] = now_seconds() - start;
+    }
+
+    double seconds = median(samples, runs);
+    double throughput = seconds > 0 ? 1 / seconds : 0;
+    printf("%-12s %10.3f ms %10.2f runs/s", corpus, seconds * 1e3, throughput);
+    double previous = baseline_throughput(corpus, "run");
+    if (previous > 0) {
+        printf(" %+7.1f%% vs baseline", (throughput / previous - 1) * 100);
+    }
+    printf("\n");
+    if (save) {
+        fprintf(save, "%s run %.6e\n", corpus, throughput);
+    }
+
+    destroy_vm(vm);
+    destroy_code_generator(gen);
+    destroy_parser(parser);
+    destroy_lexer(lexer);
+    destroy_arena(arena);
+    free(source);
+}
+
+int main(int argc, char** argv) {
+    int runs = DEFAULT_RUNS;
+    const char* baseline_path = NULL;
+    const char* save_path = NULL;
+    int first_file = 1;
+
+    while (first_file < argc && strncmp(argv[first_file], "--", 2) == 0) {
+        const char* option = argv[first_file];
+        if (first_file + 1 >= argc) {
+            fprintf(stderr, "Missing value for %s\n", option);
+            return 1;
+        }
+        const char* value = argv[first_file + 1];
+        if (strcmp(option, "--runs") == 0) {
+            runs = atoi(value);
+        } else if (strcmp(option, "--baseline") == 0) {
+            baseline_path = value;
+        } else if (strcmp(option, "--save") == 0) {
+            save_path = value;
+        } else {
+            fprintf(stderr, "Unknown option %s\n", option);
+            return 1;
+        }
+        first_file += 2;
+    }
+    if (first_file >= argc || runs < 1 || runs > MAX_RUNS) {
+        fprintf(stderr, "Usage: %s [--runs N] [--baseline FILE] [--save FILE] <file.ibery>...\n",
+                argv[0]);
+        return 1;
+    }
+
+    if (baseline_path && !load_baseline(baseline_path)) {
+        fprintf(stderr, "No baseline at %s\n", baseline_path);
+    }
+    FILE* save = NULL;
+    if (save_path) {
+        save = fopen(save_path, "w");
+        if (!save) {
+            perror(save_path);
+            return 1;
+        }
+    }
+    FILE* output = fopen("/dev/null", "w");
+    if (!output) {
+        perror("/dev/null");
+        return 1;
+    }
+
+    printf("%s values of %zu bytes, %d runs, median time\n",
+           VALUE_REPRESENTATION, sizeof(Value), runs);
+    for (int i = first_file; i < argc; i++) {
+        bench_file(argv[i], runs, output, save);
+    }
+
+    fclose(output);
+    if (save) {
+        fclose(save);
+        printf("Saved baseline to %s\n", save_path);
+    }
+    return 0;
+}
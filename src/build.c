@@ -0,0 +1,353 @@
+#include "build.h"
+#include "compiler/lexer.h"
+#include "compiler/parser.h"
+#include "compiler/codegen.h"
+#include "compiler/error.h"
+#include "compiler/source.h"
+#include "compiler/stats.h"
+#include "compiler/workers.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <glob.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#define SOURCE_EXTENSION ".ibery"
+#define MODULE_EXTENSION ".ibc"
+
+// One source file to compile
+typedef struct {
+    char* path;
+    char* output_path;
+    size_t module_size;
+    CompileStats stats;
+    bool done;
+    bool failed;
+    char error[ERROR_MESSAGE_MAX];  // Why a failed job failed
+} BuildJob;
+
+// A growable list of source paths
+typedef struct {
+    char** paths;
+    size_t count;
+    size_t capacity;
+} PathList;
+
+// State shared by the workers of one build
+typedef struct {
+    BuildJob* jobs;
+    size_t count;
+    const BuildOptions* options;
+    pthread_mutex_t print_lock;
+    size_t next_to_print;
+} Build;
+
+// Add a copy of a path to a list
+static void add_path(PathList* list, const char* path) {
+    if (list->count == list->capacity) {
+        list->capacity = list->capacity ? list->capacity * 2 : 64;
+        list->paths = (char**)realloc(list->paths, list->capacity * sizeof(char*));
+        if (!list->paths) {
+            fprintf(stderr, "Out of memory\n");
+            exit(1);
+        }
+    }
+    list->paths[list->count++] = strdup(path);
+}
+
+// Check if a path ends with a suffix
+static bool has_suffix(const char* path, const char* suffix) {
+    size_t length = strlen(path);
+    size_t suffix_length = strlen(suffix);
+    return length >= suffix_length && strcmp(path + length - suffix_length, suffix) == 0;
+}
+
+static int compare_names(const void* a, const void* b) {
+    return strcmp(*(char* const*)a, *(char* const*)b);
+}
+
+// Add every source file under a directory, in name order
+static void add_directory(PathList* list, const char* dir_path) {
+    DIR* dir = opendir(dir_path);
+    if (!dir) {
+        perror(dir_path);
+        exit(1);
+    }
+
+    PathList entries = { NULL, 0, 0 };
+    struct dirent* entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if (entry->d_name[0] != '.') {
+            add_path(&entries, entry->d_name);
+        }
+    }
+    closedir(dir);
+    qsort(entries.paths, entries.count, sizeof(char*), compare_names);
+
+    for (size_t i = 0; i < entries.count; i++) {
+        size_t length = strlen(dir_path) + strlen(entries.paths[i]) + 2;
+        char* child = (char*)malloc(length);
+        snprintf(child, length, "%s/%s", dir_path, entries.paths[i]);
+
+        struct stat st;
+        if (stat(child, &st) == 0) {
+            if (S_ISDIR(st.st_mode)) {
+                add_directory(list, child);
+            } else if (has_suffix(child, SOURCE_EXTENSION)) {
+                add_path(list, child);
+            }
+        }
+        free(child);
+        free(entries.paths[i]);
+    }
+    free(entries.paths);
+}
+
+// Add a file, a directory, or every match of a glob pattern
+static void add_input(PathList* list, const char* input) {
+    if (strpbrk(input, "*?[")) {
+        glob_t matches;
+        if (glob(input, 0, NULL, &matches) != 0) {
+            fprintf(stderr, "No files match '%s'\n", input);
+            exit(1);
+        }
+        for (size_t i = 0; i < matches.gl_pathc; i++) {
+            add_input(list, matches.gl_pathv[i]);
+        }
+        globfree(&matches);
+        return;
+    }
+
+    struct stat st;
+    if (stat(input, &st) != 0) {
+        perror(input);
+        exit(1);
+    }
+    if (S_ISDIR(st.st_mode)) {
+        add_directory(list, input);
+    } else {
+        add_path(list, input);
+    }
+}
+
+// Get the module path for a source: its extension replaced, and its
+// directory replaced by output_dir if one is given
+static char* module_path(const char* path, const char* output_dir) {
+    const char* name = path;
+    if (output_dir) {
+        const char* slash = strrchr(path, '/');
+        name = slash ? slash + 1 : path;
+    }
+    size_t stem = strlen(name);
+    if (has_suffix(name, SOURCE_EXTENSION)) {
+        stem -= strlen(SOURCE_EXTENSION);
+    }
+
+    size_t length = (output_dir ? strlen(output_dir) + 1 : 0) + stem + strlen(MODULE_EXTENSION) + 1;
+    char* result = (char*)malloc(length);
+    snprintf(result, length, "%s%s%.*s%s", output_dir ? output_dir : "", output_dir ? "/" : "",
+             (int)stem, name, MODULE_EXTENSION);
+    return result;
+}
+
+// Print every finished job that all earlier jobs are also done for
+static void flush_finished(Build* build) {
+    while (build->next_to_print < build->count && build->jobs[build->next_to_print].done) {
+        BuildJob* job = &build->jobs[build->next_to_print++];
+        if (job->failed) {
+            fflush(stdout);
+            fprintf(stderr, "%s: %s\n", job->path, job->error);
+        } else {
+            printf("%s -> %s (%zu bytes)\n", job->path, job->output_path, job->module_size);
+        }
+    }
+    fflush(stdout);
+}
+
+// Mark a job done and report whatever can now be reported in order
+static void finish_job(Build* build, BuildJob* job) {
+    pthread_mutex_lock(&build->print_lock);
+    job->done = true;
+    flush_finished(build);
+    pthread_mutex_unlock(&build->print_lock);
+}
+
+// Compile one source file to a module, or copy it from the cache; every
+// job has its own arena, lexer, parser and code generator. An error fails
+// only this job: it is reported with the path and the build goes on
+static void compile_job(void* userdata, size_t index) {
+    Build* build = (Build*)userdata;
+    BuildJob* job = &build->jobs[index];
+    stats_init(&job->stats);
+
+    int fd = open(job->path, O_RDONLY);
+    SourceFile source;
+    if (fd < 0 || !source_map(fd, &source)) {
+        if (fd >= 0) {
+            close(fd);
+        }
+        snprintf(job->error, sizeof(job->error), "Error opening file");
+        job->failed = true;
+        finish_job(build, job);
+        return;
+    }
+    close(fd);
+
+    // Released after an error too, so they live in volatile locals
+    Arena* volatile arena = NULL;
+    Lexer* volatile lexer = NULL;
+    Parser* volatile parser = NULL;
+    CodeGenerator* volatile gen = NULL;
+
+    ErrorHandler handler;
+    error_push_handler(&handler);
+    if (setjmp(handler.jump) == 0) {
+        job->stats.source_bytes = source.length;
+        Cache* cache = build->options->cache;
+        job->stats.cache_enabled = cache != NULL;
+        CacheKey key = { 0, 0 };
+        SourceFile cached;
+        if (cache) {
+            key = cache_key(cache, source.text, source.length,
+                            build->options->optimize ? CACHE_OPTION_OPTIMIZE : 0);
+        }
+        if (cache && cache_lookup(cache, key, &cached)) {
+            job->stats.cache_hits = 1;
+            job->module_size = job->stats.module_bytes = cached.length;
+            module_write(job->output_path, (const uint8_t*)cached.text, cached.length);
+            source_release(&cached);
+        } else {
+            job->stats.cache_misses = cache != NULL;
+
+            arena = create_arena(0);
+            if (build->options->show_stats) {
+                stats_attach(&job->stats, arena);
+            }
+
+            stats_begin_phase(&job->stats, PHASE_LEX);
+            lexer = create_lexer_from_buffer(source.text, source.length, arena);
+            TokenBuffer* tokens = lex_all(lexer);
+            stats_end_phase(&job->stats);
+
+            stats_begin_phase(&job->stats, PHASE_PARSE);
+            parser = create_buffered_parser(lexer, tokens);
+            AST* ast = parse_program(parser);
+            stats_end_phase(&job->stats);
+
+            stats_begin_phase(&job->stats, PHASE_CODEGEN);
+            gen = create_code_generator(arena, parser->strings);
+            gen->optimize = build->options->optimize;
+            uint8_t* module = generate_code(gen, ast, &job->module_size);
+            stats_end_phase(&job->stats);
+            job->stats.optimized = gen->optimize;
+            job->stats.optimize = gen->optimize_report;
+
+            job->stats.token_count = tokens->count;
+            job->stats.node_count = ast->node_count;
+            job->stats.constant_count = gen->constant_count;
+            job->stats.function_count = gen->function_count;
+            job->stats.code_bytes = gen->size;
+            job->stats.module_bytes = job->module_size;
+
+            module_write(job->output_path, module, job->module_size);
+            if (cache) {
+                job->stats.cache_evictions = cache_store(cache, key, module, job->module_size);
+            }
+        }
+        error_pop_handler(&handler);
+    } else {
+        memcpy(job->error, handler.message, sizeof(job->error));
+        job->failed = true;
+    }
+
+    destroy_code_generator(gen);
+    destroy_parser(parser);
+    destroy_lexer(lexer);
+    destroy_arena(arena);
+    source_release(&source);
+    finish_job(build, job);
+}
+
+// Write the stats of every job as a JSON array, in input order
+static void write_stats(const Build* build) {
+    const char* stats_path = build->options->stats_path;
+    FILE* out = stats_path ? fopen(stats_path, "w") : stderr;
+    if (!out) {
+        perror("Error opening stats file");
+        exit(1);
+    }
+    fprintf(out, "[\n");
+    for (size_t i = 0; i < build->count; i++) {
+        if (i > 0) {
+            fprintf(out, ",\n");
+        }
+        stats_write_json(&build->jobs[i].stats, build->jobs[i].path, out);
+    }
+    fprintf(out, "]\n");
+    if (out != stderr) {
+        fclose(out);
+    }
+}
+
+// Compile every input to a module on a worker pool; results are reported
+// in input order. Returns 1 if any source failed to compile
+int build_files(const char** inputs, int input_count, const BuildOptions* options) {
+    PathList paths = { NULL, 0, 0 };
+    for (int i = 0; i < input_count; i++) {
+        add_input(&paths, inputs[i]);
+    }
+    if (paths.count == 0) {
+        fprintf(stderr, "No source files to compile\n");
+        return 1;
+    }
+
+    Build build;
+    build.jobs = (BuildJob*)calloc(paths.count, sizeof(BuildJob));
+    build.count = paths.count;
+    build.options = options;
+    build.next_to_print = 0;
+    pthread_mutex_init(&build.print_lock, NULL);
+    for (size_t i = 0; i < paths.count; i++) {
+        build.jobs[i].path = paths.paths[i];
+        build.jobs[i].output_path = module_path(paths.paths[i], options->output_dir);
+    }
+
+    // Two sources compiled to the same module would race on the file
+    for (size_t i = 0; i < build.count; i++) {
+        for (size_t j = i + 1; j < build.count; j++) {
+            if (strcmp(build.jobs[i].output_path, build.jobs[j].output_path) == 0) {
+                fprintf(stderr, "%s and %s both compile to %s\n",
+                        build.jobs[i].path, build.jobs[j].path, build.jobs[i].output_path);
+                return 1;
+            }
+        }
+    }
+
+    int workers = options->jobs > 0 ? options->jobs : default_worker_count();
+    if ((size_t)workers > build.count) {
+        workers = (int)build.count;
+    }
+    WorkerPool* pool = create_worker_pool(workers);
+    worker_pool_run(pool, compile_job, &build, build.count);
+    destroy_worker_pool(pool);
+
+    if (options->show_stats) {
+        write_stats(&build);
+    }
+
+    int status = 0;
+    for (size_t i = 0; i < build.count; i++) {
+        if (build.jobs[i].failed) {
+            status = 1;
+        }
+        free(build.jobs[i].path);
+        free(build.jobs[i].output_path);
+    }
+    free(build.jobs);
+    free(paths.paths);
+    pthread_mutex_destroy(&build.print_lock);
+    return status;
+}
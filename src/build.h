@@ -0,0 +1,20 @@
+#ifndef IBERY_BUILD_H
+#define IBERY_BUILD_H
+
+#include "compiler/cache.h"
+#include <stdbool.h>
+
+// Options for compiling many sources to modules
+typedef struct {
+    const char* output_dir;  // NULL writes each module next to its source
+    int jobs;                // 0 uses one worker per core
+    bool show_stats;
+    const char* stats_path;  // NULL writes stats to stderr
+    Cache* cache;            // NULL compiles every source
+    bool optimize;           // Run the peephole pass on every module
+} BuildOptions;
+
+// Function declarations
+int build_files(const char** inputs, int input_count, const BuildOptions* options);
+
+#endif // IBERY_BUILD_H
@@ -0,0 +1,142 @@
+#include "arena.h"
+#include "error.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#define ARENA_ALIGNMENT _Alignof(max_align_t)
+#define ALIGN_UP(n) (((n) + ARENA_ALIGNMENT - 1) & ~(ARENA_ALIGNMENT - 1))
+#define BLOCK_HEADER_SIZE ALIGN_UP(sizeof(ArenaBlock))
+
+// Get the first usable byte of a block
+static uint8_t* block_data(ArenaBlock* block) {
+    return (uint8_t*)block + BLOCK_HEADER_SIZE;
+}
+
+// Allocate a new block with room for at least size bytes
+static ArenaBlock* create_block(size_t size) {
+    ArenaBlock* block = (ArenaBlock*)malloc(BLOCK_HEADER_SIZE + size);
+    if (!block) {
+        raise_error("Failed to allocate arena block of %zu bytes", size);
+    }
+    block->next = NULL;
+    block->size = size;
+    block->used = 0;
+    return block;
+}
+
+// Create a new arena
+Arena* create_arena(size_t block_size) {
+    Arena* arena = (Arena*)malloc(sizeof(Arena));
+    if (!arena) {
+        return NULL;
+    }
+
+    arena->block_size = block_size ? block_size : ARENA_DEFAULT_BLOCK_SIZE;
+    arena->first = create_block(arena->block_size);
+    arena->current = arena->first;
+    arena->hook = NULL;
+    arena->hook_userdata = NULL;
+    return arena;
+}
+
+// Destroy an arena and everything allocated from it
+void destroy_arena(Arena* arena) {
+    if (!arena) return;
+
+    ArenaBlock* block = arena->first;
+    while (block) {
+        ArenaBlock* next = block->next;
+        free(block);
+        block = next;
+    }
+    free(arena);
+}
+
+// Release every allocation but keep the blocks for the next compilation
+void arena_reset(Arena* arena) {
+    for (ArenaBlock* block = arena->first; block; block = block->next) {
+        block->used = 0;
+    }
+    arena->current = arena->first;
+}
+
+// Install an allocation observer, or remove it with NULL
+void arena_set_hook(Arena* arena, ArenaHook hook, void* userdata) {
+    arena->hook = hook;
+    arena->hook_userdata = userdata;
+}
+
+// Allocate size bytes from the arena
+void* arena_alloc(Arena* arena, size_t size) {
+    if (arena->hook) {
+        arena->hook(size, arena->hook_userdata);
+    }
+    size = ALIGN_UP(size ? size : 1);
+
+    ArenaBlock* block = arena->current;
+    while (block->used + size > block->size) {
+        if (!block->next) {
+            size_t block_size = size > arena->block_size ? size : arena->block_size;
+            block->next = create_block(block_size);
+        }
+        block = block->next;
+    }
+    arena->current = block;
+
+    void* ptr = block_data(block) + block->used;
+    block->used += size;
+    return ptr;
+}
+
+// Resize an allocation, extending it in place when it is the latest one
+void* arena_grow(Arena* arena, void* ptr, size_t old_size, size_t new_size) {
+    if (!ptr) {
+        return arena_alloc(arena, new_size);
+    }
+
+    ArenaBlock* block = arena->current;
+    size_t old_aligned = ALIGN_UP(old_size ? old_size : 1);
+    size_t new_aligned = ALIGN_UP(new_size);
+    if ((uint8_t*)ptr + old_aligned == block_data(block) + block->used &&
+        block->used - old_aligned + new_aligned <= block->size) {
+        block->used = block->used - old_aligned + new_aligned;
+        if (arena->hook && new_size > old_size) {
+            arena->hook(new_size - old_size, arena->hook_userdata);
+        }
+        return ptr;
+    }
+
+    void* new_ptr = arena_alloc(arena, new_size);
+    memcpy(new_ptr, ptr, old_size < new_size ? old_size : new_size);
+    return new_ptr;
+}
+
+// Grow an arena array so it holds at least needed elements, doubling its
+// capacity so repeated appends stay amortized constant time
+void* arena_reserve(Arena* arena, void* items, size_t* capacity, size_t needed, size_t element_size) {
+    if (needed <= *capacity) {
+        return items;
+    }
+    size_t new_capacity = *capacity ? *capacity * 2 : 16;
+    while (new_capacity < needed) {
+        new_capacity *= 2;
+    }
+    items = arena_grow(arena, items, *capacity * element_size, new_capacity * element_size);
+    *capacity = new_capacity;
+    return items;
+}
+
+// Copy a string into the arena
+char* arena_strdup(Arena* arena, const char* str) {
+    return arena_strndup(arena, str, strlen(str));
+}
+
+// Copy length bytes of a string into the arena and terminate it
+char* arena_strndup(Arena* arena, const char* str, size_t length) {
+    char* copy = (char*)arena_alloc(arena, length + 1);
+    memcpy(copy, str, length);
+    copy[length] = '\0';
+    return copy;
+}
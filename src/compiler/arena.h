@@ -0,0 +1,38 @@
+#ifndef IBERY_ARENA_H
+#define IBERY_ARENA_H
+
+#include <stddef.h>
+
+#define ARENA_DEFAULT_BLOCK_SIZE (64 * 1024)
+
+// A chunk of arena memory
+typedef struct ArenaBlock {
+    struct ArenaBlock* next;
+    size_t size;
+    size_t used;
+} ArenaBlock;
+
+// Observer called with the size of every allocation served by an arena
+typedef void (*ArenaHook)(size_t size, void* userdata);
+
+// Region allocator: everything is released at once by reset or destroy
+typedef struct {
+    ArenaBlock* first;
+    ArenaBlock* current;
+    size_t block_size;
+    ArenaHook hook;
+    void* hook_userdata;
+} Arena;
+
+// Function declarations
+Arena* create_arena(size_t block_size);
+void destroy_arena(Arena* arena);
+void arena_reset(Arena* arena);
+void arena_set_hook(Arena* arena, ArenaHook hook, void* userdata);
+void* arena_alloc(Arena* arena, size_t size);
+void* arena_grow(Arena* arena, void* ptr, size_t old_size, size_t new_size);
+void* arena_reserve(Arena* arena, void* items, size_t* capacity, size_t needed, size_t element_size);
+char* arena_strdup(Arena* arena, const char* str);
+char* arena_strndup(Arena* arena, const char* str, size_t length);
+
+#endif // IBERY_ARENA_H
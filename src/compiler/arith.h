@@ -0,0 +1,279 @@
+#ifndef IBERY_ARITH_H
+#define IBERY_ARITH_H
+
+#include "codegen.h"
+#include <inttypes.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Operator semantics shared by the VM and constant folding, so that a
+// folded expression has exactly the value it would have at runtime.
+// Integers are 64-bit and wrap around, integer division truncates toward
+// zero and shift counts use their low six bits. An operator with a double
+// operand works on doubles, with IEEE division, fmod and pow; shifts and
+// bitwise operators take integers only. Comparisons yield the integer 1 or
+// 0, and compare an integer with a double exactly.
+
+// Longest text of a number, with its NUL
+#define NUMBER_TEXT_MAX 32
+
+// Order of two numbers when either is NaN
+#define ORDER_UNORDERED 2
+
+// A number operand: an integer or a double
+typedef struct {
+    bool is_double;
+    NumberValue as;
+} Number;
+
+// Why an operator has no result
+typedef enum {
+    ARITH_OK,
+    ARITH_DIVISION_BY_ZERO,
+    ARITH_NEGATIVE_POWER_OF_ZERO,
+    ARITH_NOT_INTEGER
+} ArithStatus;
+
+// Make an integer number
+static inline Number make_integer(int64_t value) {
+    Number number;
+    number.is_double = false;
+    number.as.integer = value;
+    return number;
+}
+
+// Make a double number
+static inline Number make_real(double value) {
+    Number number;
+    number.is_double = true;
+    number.as.real = value;
+    return number;
+}
+
+// Get a number as a double
+static inline double number_real(Number number) {
+    return number.is_double ? number.as.real : (double)number.as.integer;
+}
+
+// Check if a number counts as false
+static inline bool number_is_zero(Number number) {
+    return number.is_double ? number.as.real == 0.0 : number.as.integer == 0;
+}
+
+// Write a number as text; returns its length. A double gets the shortest
+// text that reads back as the same value, with ".0" if it looks integral
+static inline int format_number(char* buffer, Number value) {
+    if (!value.is_double) {
+        return snprintf(buffer, NUMBER_TEXT_MAX, "%" PRId64, value.as.integer);
+    }
+    double real = value.as.real;
+    if (isnan(real)) {
+        return snprintf(buffer, NUMBER_TEXT_MAX, "nan");
+    } else if (isinf(real)) {
+        return snprintf(buffer, NUMBER_TEXT_MAX, real < 0 ? "-inf" : "inf");
+    }
+    int length = 0;
+    for (int precision = 15; precision <= 17; precision++) {
+        length = snprintf(buffer, NUMBER_TEXT_MAX, "%.*g", precision, real);
+        if (strtod(buffer, NULL) == real) {
+            break;
+        }
+    }
+    if (strcspn(buffer, ".e") == (size_t)length) {
+        memcpy(buffer + length, ".0", 3);
+        length += 2;
+    }
+    return length;
+}
+
+// Raise an integer to a power by squaring; 0 to a negative power has no
+// result and other negative powers truncate like division
+static inline ArithStatus integer_power(int64_t base, int64_t exponent, int64_t* result) {
+    if (exponent < 0) {
+        if (base == 0) {
+            return ARITH_NEGATIVE_POWER_OF_ZERO;
+        }
+        *result = base == 1 ? 1 : base == -1 ? ((exponent & 1) ? -1 : 1) : 0;
+        return ARITH_OK;
+    }
+    uint64_t value = 1;
+    uint64_t square = (uint64_t)base;
+    for (uint64_t n = (uint64_t)exponent; n > 0; n >>= 1) {
+        if (n & 1) {
+            value *= square;
+        }
+        square *= square;
+    }
+    *result = (int64_t)value;
+    return ARITH_OK;
+}
+
+// Turn the order of two operands (negative, zero, positive or
+// ORDER_UNORDERED) into the result of a comparison opcode
+static inline int compare_result(uint8_t opcode, int order) {
+    if (order == ORDER_UNORDERED) {
+        return opcode == OP_NOT_EQUAL;
+    }
+    switch (opcode) {
+        case OP_EQUAL: return order == 0;
+        case OP_NOT_EQUAL: return order != 0;
+        case OP_LESS: return order < 0;
+        case OP_LESS_EQUAL: return order <= 0;
+        case OP_GREATER: return order > 0;
+        default: return order >= 0;
+    }
+}
+
+// Check if an opcode compares its operands
+static inline bool is_comparison(uint8_t opcode) {
+    return opcode >= OP_EQUAL && opcode <= OP_GREATER_EQUAL;
+}
+
+// Order two strings byte by byte, a prefix first
+static inline int compare_text(const char* a, int a_length, const char* b, int b_length) {
+    int shorter = a_length < b_length ? a_length : b_length;
+    int order = shorter > 0 ? memcmp(a, b, shorter) : 0;
+    if (order != 0) {
+        return order;
+    }
+    return (a_length > b_length) - (a_length < b_length);
+}
+
+// Order an integer against a double without rounding the integer
+static inline int integer_real_order(int64_t integer, double real) {
+    if (isnan(real)) {
+        return ORDER_UNORDERED;
+    } else if (real >= 9223372036854775808.0) {
+        return -1;
+    } else if (real < -9223372036854775808.0) {
+        return 1;
+    }
+    int64_t whole = (int64_t)real;
+    if (integer != whole) {
+        return integer < whole ? -1 : 1;
+    }
+    double fraction = real - (double)whole;
+    return (fraction < 0) - (fraction > 0);
+}
+
+// Order two numbers
+static inline int number_order(Number a, Number b) {
+    if (!a.is_double && !b.is_double) {
+        return (a.as.integer > b.as.integer) - (a.as.integer < b.as.integer);
+    } else if (a.is_double && b.is_double) {
+        if (isnan(a.as.real) || isnan(b.as.real)) {
+            return ORDER_UNORDERED;
+        }
+        return (a.as.real > b.as.real) - (a.as.real < b.as.real);
+    } else if (a.is_double) {
+        int order = integer_real_order(b.as.integer, a.as.real);
+        return order == ORDER_UNORDERED ? order : -order;
+    }
+    return integer_real_order(a.as.integer, b.as.real);
+}
+
+// Apply an arithmetic or bitwise operator to two integers
+static inline ArithStatus integer_binary(uint8_t opcode, int64_t a, int64_t b, int64_t* result) {
+    uint64_t x = (uint64_t)a;
+    uint64_t y = (uint64_t)b;
+    switch (opcode) {
+        case OP_ADD: *result = (int64_t)(x + y); return ARITH_OK;
+        case OP_SUBTRACT: *result = (int64_t)(x - y); return ARITH_OK;
+        case OP_MULTIPLY: *result = (int64_t)(x * y); return ARITH_OK;
+        case OP_DIVIDE:
+        case OP_MODULO:
+            if (b == 0) {
+                return ARITH_DIVISION_BY_ZERO;
+            }
+            if (b == -1) {
+                // INT64_MIN / -1 wraps instead of trapping
+                *result = opcode == OP_DIVIDE ? (int64_t)(0u - x) : 0;
+            } else {
+                *result = opcode == OP_DIVIDE ? a / b : a % b;
+            }
+            return ARITH_OK;
+        case OP_POWER: return integer_power(a, b, result);
+        case OP_SHIFT_LEFT: *result = (int64_t)(x << (y & 63)); return ARITH_OK;
+        case OP_SHIFT_RIGHT: *result = a >> (y & 63); return ARITH_OK;
+        case OP_SHIFT_RIGHT_UNSIGNED: *result = (int64_t)(x >> (y & 63)); return ARITH_OK;
+        case OP_BIT_AND: *result = a & b; return ARITH_OK;
+        case OP_BIT_OR: *result = a | b; return ARITH_OK;
+        default: *result = a ^ b; return ARITH_OK;
+    }
+}
+
+// Apply an arithmetic operator to two doubles; the others need integers
+static inline ArithStatus real_binary(uint8_t opcode, double a, double b, double* result) {
+    switch (opcode) {
+        case OP_ADD: *result = a + b; return ARITH_OK;
+        case OP_SUBTRACT: *result = a - b; return ARITH_OK;
+        case OP_MULTIPLY: *result = a * b; return ARITH_OK;
+        case OP_DIVIDE: *result = a / b; return ARITH_OK;
+        case OP_MODULO: *result = fmod(a, b); return ARITH_OK;
+        case OP_POWER: *result = pow(a, b); return ARITH_OK;
+        default: return ARITH_NOT_INTEGER;
+    }
+}
+
+// Apply a binary operator to two numbers; an integer meeting a double is
+// converted to a double
+static inline ArithStatus arith_binary(uint8_t opcode, Number a, Number b, Number* result) {
+    if (is_comparison(opcode)) {
+        *result = make_integer(compare_result(opcode, number_order(a, b)));
+        return ARITH_OK;
+    }
+    if (!a.is_double && !b.is_double) {
+        result->is_double = false;
+        return integer_binary(opcode, a.as.integer, b.as.integer, &result->as.integer);
+    }
+    result->is_double = true;
+    return real_binary(opcode, number_real(a), number_real(b), &result->as.real);
+}
+
+// Apply OP_NEGATE or OP_BIT_NOT to a number
+static inline ArithStatus arith_unary(uint8_t opcode, Number a, Number* result) {
+    if (a.is_double) {
+        if (opcode != OP_NEGATE) {
+            return ARITH_NOT_INTEGER;
+        }
+        *result = make_real(-a.as.real);
+    } else {
+        uint64_t x = (uint64_t)a.as.integer;
+        *result = make_integer(opcode == OP_NEGATE ? (int64_t)(0u - x) : (int64_t)~x);
+    }
+    return ARITH_OK;
+}
+
+// Get the source text of an operator opcode, for error messages
+static inline const char* opcode_symbol(uint8_t opcode) {
+    switch (opcode) {
+        case OP_ADD: return "+";
+        case OP_SUBTRACT: return "-";
+        case OP_MULTIPLY: return "*";
+        case OP_DIVIDE: return "/";
+        case OP_MODULO: return "%";
+        case OP_POWER: return "**";
+        case OP_SHIFT_LEFT: return "<<";
+        case OP_SHIFT_RIGHT: return ">>";
+        case OP_SHIFT_RIGHT_UNSIGNED: return ">>>";
+        case OP_BIT_AND: return "&";
+        case OP_BIT_OR: return "|";
+        case OP_BIT_XOR: return "^";
+        case OP_EQUAL: return "==";
+        case OP_NOT_EQUAL: return "!=";
+        case OP_LESS: return "<";
+        case OP_LESS_EQUAL: return "<=";
+        case OP_GREATER: return ">";
+        case OP_GREATER_EQUAL: return ">=";
+        case OP_NEGATE: return "-";
+        case OP_NOT: return "!";
+        case OP_BIT_NOT: return "~";
+        default: return "?";
+    }
+}
+
+#endif // IBERY_ARITH_H
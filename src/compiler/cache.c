@@ -0,0 +1,283 @@
+#include "cache.h"
+#include "module.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#define ENTRY_EXTENSION ".ibc"
+#define KEY_HEX_LENGTH 32
+
+#define HASH_PRIME_1 0x9E3779B97F4A7C15ull
+#define HASH_PRIME_2 0xC2B2AE3D27D4EB4Full
+#define HASH_PRIME_3 0x165667B19E3779F9ull
+
+// Rotate a 64-bit value left
+static inline uint64_t rotate_left(uint64_t value, int bits) {
+    return (value << bits) | (value >> (64 - bits));
+}
+
+// Scramble every bit of a lane into every other
+static inline uint64_t avalanche(uint64_t h) {
+    h ^= h >> 33;
+    h *= HASH_PRIME_2;
+    h ^= h >> 29;
+    h *= HASH_PRIME_3;
+    h ^= h >> 32;
+    return h;
+}
+
+// Hash bytes eight at a time into two independent 64-bit lanes
+CacheKey cache_hash(const char* data, size_t length, uint64_t seed) {
+    uint64_t a = seed ^ HASH_PRIME_1;
+    uint64_t b = rotate_left(seed, 32) ^ HASH_PRIME_2;
+    size_t i = 0;
+    for (; i + 8 <= length; i += 8) {
+        uint64_t word;
+        memcpy(&word, data + i, 8);
+        a = rotate_left(a ^ word, 31) * HASH_PRIME_1;
+        b = rotate_left(b + word, 27) * HASH_PRIME_2;
+    }
+    uint64_t tail = 0;
+    memcpy(&tail, data + i, length - i);
+    a = rotate_left(a ^ tail, 31) * HASH_PRIME_1;
+    b = rotate_left(b + tail, 27) * HASH_PRIME_2;
+
+    CacheKey key;
+    key.high = avalanche(a ^ length);
+    key.low = avalanche(b + length + key.high);
+    return key;
+}
+
+// Identify the running compiler by the module format and the size and
+// modification time of its own binary, so a rebuilt compiler never reuses
+// modules generated by an older one
+static uint64_t compiler_identity(void) {
+    uint64_t id = MODULE_VERSION;
+    struct stat st;
+    if (stat("/proc/self/exe", &st) == 0) {
+        id = id * HASH_PRIME_1 + (uint64_t)st.st_size;
+        id = id * HASH_PRIME_1 + (uint64_t)st.st_mtim.tv_sec;
+        id = id * HASH_PRIME_1 + (uint64_t)st.st_mtim.tv_nsec;
+    }
+    return avalanche(id);
+}
+
+// Get the cache directory used when none is given: $IBERY_CACHE_DIR, else
+// $XDG_CACHE_HOME/ibery, else ~/.cache/ibery
+const char* cache_default_dir(void) {
+    static char path[4096];
+    const char* dir = getenv("IBERY_CACHE_DIR");
+    if (dir && *dir) {
+        return dir;
+    }
+    const char* base = getenv("XDG_CACHE_HOME");
+    if (base && *base) {
+        snprintf(path, sizeof(path), "%s/ibery", base);
+        return path;
+    }
+    const char* home = getenv("HOME");
+    snprintf(path, sizeof(path), "%s/.cache/ibery", home && *home ? home : ".");
+    return path;
+}
+
+// Create a directory and any missing parents
+static bool make_directories(const char* dir) {
+    char* path = strdup(dir);
+    bool ok = true;
+    for (char* p = path + 1; ok; p++) {
+        if (*p == '/' || *p == '\0') {
+            char saved = *p;
+            *p = '\0';
+            if (mkdir(path, 0755) != 0 && errno != EEXIST) {
+                ok = false;
+            }
+            *p = saved;
+            if (saved == '\0') {
+                break;
+            }
+        }
+    }
+    free(path);
+    return ok;
+}
+
+// Open a cache directory, creating it if needed; returns NULL if it cannot
+// be created
+Cache* create_cache(const char* dir, uint64_t max_bytes) {
+    if (!make_directories(dir)) {
+        return NULL;
+    }
+    Cache* cache = (Cache*)malloc(sizeof(Cache));
+    if (!cache) {
+        return NULL;
+    }
+    cache->dir = strdup(dir);
+    cache->max_bytes = max_bytes;
+    cache->compiler_id = compiler_identity();
+    pthread_mutex_init(&cache->lock, NULL);
+    cache->known_bytes = -1;
+    return cache;
+}
+
+// Close a cache; the entries stay on disk
+void destroy_cache(Cache* cache) {
+    if (cache) {
+        pthread_mutex_destroy(&cache->lock);
+        free(cache->dir);
+        free(cache);
+    }
+}
+
+// Get the key of a source compiled by this compiler with the given
+// code generation options
+CacheKey cache_key(const Cache* cache, const char* source, size_t length, uint32_t options) {
+    return cache_hash(source, length, cache->compiler_id ^ ((uint64_t)options << 48));
+}
+
+// Get the path of an entry
+static void entry_path(const Cache* cache, CacheKey key, char* path, size_t size) {
+    snprintf(path, size, "%s/%016llx%016llx" ENTRY_EXTENSION, cache->dir,
+             (unsigned long long)key.high, (unsigned long long)key.low);
+}
+
+// Map the module cached under a key and mark it as just used. Returns
+// false on a miss; a damaged entry is removed and counts as a miss
+bool cache_lookup(Cache* cache, CacheKey key, SourceFile* module) {
+    char path[4096];
+    entry_path(cache, key, path, sizeof(path));
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    bool mapped = source_map(fd, module);
+    if (mapped) {
+        futimens(fd, NULL);
+    }
+    close(fd);
+    if (!mapped) {
+        return false;
+    }
+    if (!module_is_valid((const uint8_t*)module->text, module->length)) {
+        source_release(module);
+        unlink(path);
+        return false;
+    }
+    return true;
+}
+
+// One entry found while scanning the cache directory
+typedef struct {
+    char name[KEY_HEX_LENGTH + sizeof(ENTRY_EXTENSION)];
+    uint64_t size;
+    struct timespec used;
+} CacheEntry;
+
+static int compare_last_use(const void* a, const void* b) {
+    const struct timespec* x = &((const CacheEntry*)a)->used;
+    const struct timespec* y = &((const CacheEntry*)b)->used;
+    if (x->tv_sec != y->tv_sec) {
+        return x->tv_sec < y->tv_sec ? -1 : 1;
+    }
+    return (x->tv_nsec > y->tv_nsec) - (x->tv_nsec < y->tv_nsec);
+}
+
+// Total the entries on disk and, past the size limit, remove the least
+// recently used ones until the rest fit; returns the number removed.
+// Called with the lock held
+static size_t evict(Cache* cache) {
+    DIR* dir = opendir(cache->dir);
+    if (!dir) {
+        return 0;
+    }
+    CacheEntry* entries = NULL;
+    size_t count = 0;
+    size_t capacity = 0;
+    uint64_t total = 0;
+    char path[4096];
+
+    struct dirent* item;
+    while ((item = readdir(dir)) != NULL) {
+        size_t length = strlen(item->d_name);
+        if (length != KEY_HEX_LENGTH + strlen(ENTRY_EXTENSION) ||
+            strcmp(item->d_name + KEY_HEX_LENGTH, ENTRY_EXTENSION) != 0) {
+            continue;
+        }
+        struct stat st;
+        snprintf(path, sizeof(path), "%s/%s", cache->dir, item->d_name);
+        if (stat(path, &st) != 0) {
+            continue;
+        }
+        if (count == capacity) {
+            capacity = capacity ? capacity * 2 : 64;
+            entries = (CacheEntry*)realloc(entries, capacity * sizeof(CacheEntry));
+        }
+        memcpy(entries[count].name, item->d_name, length + 1);
+        entries[count].size = (uint64_t)st.st_size;
+        entries[count].used = st.st_mtim;
+        count++;
+        total += (uint64_t)st.st_size;
+    }
+    closedir(dir);
+
+    size_t removed = 0;
+    if (total > cache->max_bytes) {
+        qsort(entries, count, sizeof(CacheEntry), compare_last_use);
+        for (size_t i = 0; i < count && total > cache->max_bytes; i++) {
+            snprintf(path, sizeof(path), "%s/%s", cache->dir, entries[i].name);
+            if (unlink(path) == 0 || errno == ENOENT) {
+                total -= entries[i].size;
+                removed++;
+            }
+        }
+    }
+    free(entries);
+    cache->known_bytes = (int64_t)total;
+    return removed;
+}
+
+// Store a module under a key, then evict old entries if the cache has
+// outgrown its limit; returns the number of entries evicted. Failing to
+// write is not an error, the module just is not cached
+size_t cache_store(Cache* cache, CacheKey key, const uint8_t* image, size_t size) {
+    char path[4096];
+    char temp_path[4096];
+    entry_path(cache, key, path, sizeof(path));
+    snprintf(temp_path, sizeof(temp_path), "%s/.tmp-XXXXXX", cache->dir);
+
+    int fd = mkstemp(temp_path);
+    if (fd < 0) {
+        return 0;
+    }
+    size_t written = 0;
+    while (written < size) {
+        ssize_t n = write(fd, image + written, size - written);
+        if (n <= 0) {
+            break;
+        }
+        written += (size_t)n;
+    }
+    if (close(fd) != 0 || written != size || rename(temp_path, path) != 0) {
+        unlink(temp_path);
+        return 0;
+    }
+
+    // The first store of a run scans the directory; later ones only scan
+    // again once the running total passes the limit
+    pthread_mutex_lock(&cache->lock);
+    size_t removed = 0;
+    if (cache->known_bytes < 0) {
+        removed = evict(cache);
+    } else {
+        cache->known_bytes += (int64_t)size;
+        if ((uint64_t)cache->known_bytes > cache->max_bytes) {
+            removed = evict(cache);
+        }
+    }
+    pthread_mutex_unlock(&cache->lock);
+    return removed;
+}
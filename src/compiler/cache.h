@@ -0,0 +1,47 @@
+#ifndef IBERY_CACHE_H
+#define IBERY_CACHE_H
+
+#include "source.h"
+#include <pthread.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+// On-disk cache of compiled modules. An entry is a module image stored as
+// <dir>/<key>.ibc, where the key hashes the source bytes together with the
+// compiler binary and the options that affect code generation. Entries are
+// written to a temporary file and renamed into place, so readers never see
+// a partial module. An entry's mtime is its last use; once the directory
+// grows past max_bytes, the least recently used entries are removed.
+// One cache can be shared by several threads.
+
+#define CACHE_DEFAULT_MAX_BYTES (256ull * 1024 * 1024)
+
+// Options that change the generated module, for cache_key
+#define CACHE_OPTION_OPTIMIZE 0x1u
+
+// 128-bit cache key
+typedef struct {
+    uint64_t high;
+    uint64_t low;
+} CacheKey;
+
+// A cache directory
+typedef struct {
+    char* dir;
+    uint64_t max_bytes;
+    uint64_t compiler_id;
+    pthread_mutex_t lock;
+    int64_t known_bytes;  // Size of the entries, or -1 before the first scan
+} Cache;
+
+// Function declarations
+const char* cache_default_dir(void);
+Cache* create_cache(const char* dir, uint64_t max_bytes);
+void destroy_cache(Cache* cache);
+CacheKey cache_hash(const char* data, size_t length, uint64_t seed);
+CacheKey cache_key(const Cache* cache, const char* source, size_t length, uint32_t options);
+bool cache_lookup(Cache* cache, CacheKey key, SourceFile* module);
+size_t cache_store(Cache* cache, CacheKey key, const uint8_t* image, size_t size);
+
+#endif // IBERY_CACHE_H
@@ -1,4 +1,6 @@
 #include "codegen.h"
+#include "varint.h"
+#include "error.h"
 #include <stdlib.h>
 #include <string.h>
 #include <stdarg.h>
@@ -6,29 +8,67 @@
 
 #define INITIAL_CAPACITY 1024
 
+// Parallel codegen: programs with fewer functions are generated serially,
+// and each worker gets up to this many runs of functions
+#define PARALLEL_CODEGEN_MIN_FUNCTIONS 64
+#define PARALLEL_CODEGEN_UNITS_PER_WORKER 4
+
 // Create a new code generator
-CodeGenerator* create_code_generator(void) {
+CodeGenerator* create_code_generator(Arena* arena, const InternTable* strings) {
     CodeGenerator* gen = (CodeGenerator*)malloc(sizeof(CodeGenerator));
     if (!gen) {
         return NULL;
     }
 
-    gen->instructions = (uint8_t*)malloc(INITIAL_CAPACITY);
-    if (!gen->instructions) {
-        free(gen);
-        return NULL;
-    }
-
+    gen->arena = arena;
+    gen->strings = strings;
+    gen->ast = NULL;
+    gen->resolver = NULL;
+    gen->call_targets = NULL;
+    gen->global_targets = NULL;
+    gen->instructions = (uint8_t*)arena_alloc(arena, INITIAL_CAPACITY);
     gen->capacity = INITIAL_CAPACITY;
     gen->size = 0;
     gen->label_counter = 0;
+    gen->constant_index = NULL;
+    gen->constant_index_capacity = 0;
+    gen->constants = NULL;
+    gen->constant_count = 0;
+    gen->constant_capacity = 0;
+    gen->functions = NULL;
+    gen->function_count = 0;
+    gen->function_capacity = 0;
+    gen->params = NULL;
+    gen->param_count = 0;
+    gen->param_capacity = 0;
+    gen->globals = NULL;
+    gen->global_count = 0;
+    gen->global_capacity = 0;
+    gen->track_relocations = false;
+    gen->relocations = NULL;
+    gen->relocation_count = 0;
+    gen->relocation_capacity = 0;
+    gen->optimize = false;
+    memset(&gen->optimize_report, 0, sizeof(OptimizeReport));
     return gen;
 }
 
-// Destroy a code generator
+// Empty a generator for the next unit, keeping its buffers
+void reset_code_generator(CodeGenerator* gen) {
+    for (int i = 0; i < gen->constant_count; i++) {
+        gen->constant_index[gen->constants[i]] = 0;
+    }
+    gen->size = 0;
+    gen->constant_count = 0;
+    gen->function_count = 0;
+    gen->param_count = 0;
+    gen->global_count = 0;
+    gen->relocation_count = 0;
+}
+
+// Destroy a code generator; the generated code is released with the arena
 void destroy_code_generator(CodeGenerator* gen) {
     if (gen) {
-        free(gen->instructions);
         free(gen);
     }
 }
@@ -40,17 +80,59 @@ static void ensure_capacity(CodeGenerator* gen, size_t needed) {
         while (gen->size + needed > new_capacity) {
             new_capacity *= 2;
         }
-        uint8_t* new_instructions = (uint8_t*)realloc(gen->instructions, new_capacity);
-        if (!new_instructions) {
-            fprintf(stderr, "Failed to allocate memory for code generation\n");
-            exit(1);
-        }
-        gen->instructions = new_instructions;
+        gen->instructions = (uint8_t*)arena_grow(gen->arena, gen->instructions,
+                                                 gen->capacity, new_capacity);
         gen->capacity = new_capacity;
     }
 }
 
-// Emit a single instruction with variable arguments
+// Get the constant pool index of an interned string, adding it on first use
+uint32_t add_constant(CodeGenerator* gen, StringId id) {
+    if (id >= gen->constant_index_capacity) {
+        size_t old_capacity = gen->constant_index_capacity;
+        gen->constant_index = (uint32_t*)arena_reserve(gen->arena, gen->constant_index,
+                                                       &gen->constant_index_capacity,
+                                                       (size_t)id + 1, sizeof(uint32_t));
+        memset(gen->constant_index + old_capacity, 0,
+               (gen->constant_index_capacity - old_capacity) * sizeof(uint32_t));
+    }
+    if (gen->constant_index[id] == 0) {
+        gen->constants = (StringId*)arena_reserve(gen->arena, gen->constants, &gen->constant_capacity,
+                                                  gen->constant_count + 1, sizeof(StringId));
+        gen->constants[gen->constant_count++] = id;
+        gen->constant_index[id] = (uint32_t)gen->constant_count;
+    }
+    return gen->constant_index[id] - 1;
+}
+
+// Add a global, numbered in the order globals are added; its name joins
+// the constant pool
+void add_global(CodeGenerator* gen, StringId name) {
+    gen->globals = (uint32_t*)arena_reserve(gen->arena, gen->globals, &gen->global_capacity,
+                                            gen->global_count + 1, sizeof(uint32_t));
+    gen->globals[gen->global_count++] = add_constant(gen, name);
+}
+
+// Write an unsigned varint operand
+static void emit_varint(CodeGenerator* gen, uint32_t value) {
+    ensure_capacity(gen, VARINT_MAX_BYTES);
+    gen->size += varint_encode_u32(gen->instructions + gen->size, value);
+}
+
+// Write a signed varint operand
+static void emit_signed_varint(CodeGenerator* gen, int64_t value) {
+    ensure_capacity(gen, VARINT64_MAX_BYTES);
+    gen->size += varint_encode_i64(gen->instructions + gen->size, value);
+}
+
+// Write a double operand
+static void emit_double(CodeGenerator* gen, double value) {
+    ensure_capacity(gen, DOUBLE_BYTES);
+    gen->size += double_encode(gen->instructions + gen->size, value);
+}
+
+// Emit a single instruction with variable arguments; string operands are
+// passed as interned ids and written as constant indices
 void emit_instruction(CodeGenerator* gen, uint8_t opcode, ...) {
     ensure_capacity(gen, 1);
     gen->instructions[gen->size++] = opcode;
@@ -58,48 +140,100 @@ void emit_instruction(CodeGenerator* gen, uint8_t opcode, ...) {
     va_list args;
     va_start(args, opcode);
     
-    switch (opcode) {
-        case OP_PUSH_NAME:
-        case OP_RUN_COMMAND:
-        case OP_CALL_FUNCTION:
-        case OP_PUSH_STRING:
-        case OP_PUSH_IDENTIFIER: {
-            const char* str = va_arg(args, const char*);
-            size_t len = strlen(str);
-            ensure_capacity(gen, len + 1);
-            gen->instructions[gen->size++] = (uint8_t)len;
-            memcpy(gen->instructions + gen->size, str, len);
-            gen->size += len;
+    switch (opcode_operand(opcode)) {
+        case OPERAND_CONSTANT: {
+            StringId id = va_arg(args, StringId);
+            if (gen->track_relocations) {
+                gen->relocations = (uint32_t*)arena_reserve(gen->arena, gen->relocations, &gen->relocation_capacity,
+                                                            gen->relocation_count + 1, sizeof(uint32_t));
+                gen->relocations[gen->relocation_count++] = (uint32_t)gen->size;
+            }
+            emit_varint(gen, add_constant(gen, id));
             break;
         }
-        case OP_PUSH_NUMBER:
-        case OP_FUNCTION_DEF: {
-            int num = va_arg(args, int);
-            ensure_capacity(gen, sizeof(int));
-            memcpy(gen->instructions + gen->size, &num, sizeof(int));
-            gen->size += sizeof(int);
+        case OPERAND_INT:
+            emit_signed_varint(gen, va_arg(args, int64_t));
+            break;
+        case OPERAND_DOUBLE:
+            emit_double(gen, va_arg(args, double));
+            break;
+        case OPERAND_INDEX:
+            emit_varint(gen, va_arg(args, uint32_t));
+            break;
+        case OPERAND_NONE:
             break;
-        }
     }
     
     va_end(args);
 }
 
+static void generate_node(CodeGenerator* gen, const ASTNode* node);
+static void generate_top_level(CodeGenerator* gen, const ASTNode* program);
+
+// Get the i-th child of a node
+static const ASTNode* child_node(CodeGenerator* gen, const ASTNode* node, uint32_t i) {
+    return ast_node(gen->ast, ast_child(gen->ast, node, i));
+}
+
+// Get what the resolver bound a call, identifier or assignment node to
+static Symbol node_symbol(CodeGenerator* gen, const ASTNode* node) {
+    if (!gen->resolver) {
+        Symbol none = { SYMBOL_NONE, 0 };
+        return none;
+    }
+    return resolved_symbol(gen->resolver, (NodeIndex)(node - gen->ast->nodes));
+}
+
+// Check if a node leaves a value on the stack
+static bool is_expression_node(const ASTNode* node) {
+    return node->type == NODE_FUNCTION_CALL ||
+           node->type == NODE_NUMBER_LITERAL ||
+           node->type == NODE_FLOAT_LITERAL ||
+           node->type == NODE_STRING_LITERAL ||
+           node->type == NODE_IDENTIFIER ||
+           node->type == NODE_ASSIGNMENT ||
+           node->type == NODE_BINARY_OP ||
+           node->type == NODE_UNARY_OP;
+}
+
+// Generate a statement, discarding the value of expression statements
+static void generate_statement(CodeGenerator* gen, const ASTNode* node) {
+    generate_node(gen, node);
+    if (is_expression_node(node)) {
+        emit_instruction(gen, OP_POP);
+    }
+}
+
 // Generate code from an AST node
-static void generate_node(CodeGenerator* gen, ASTNode* node) {
+static void generate_node(CodeGenerator* gen, const ASTNode* node) {
     switch (node->type) {
         case NODE_FUNCTION_DEF: {
-            // Function definition
-            ASTNode* name_node = node->children[0];
-            ASTNode* params_node = node->children[1];
-            ASTNode* body_node = node->children[2];
-            
-            emit_instruction(gen, OP_FUNCTION_DEF, params_node->children_count);
-            emit_instruction(gen, OP_PUSH_NAME, name_node->value);
+            // Function definition: table entry, then the body
+            const ASTNode* params_node = child_node(gen, node, 0);
+            const ASTNode* body_node = child_node(gen, node, 1);
+
+            gen->functions = (ModuleFunction*)arena_reserve(gen->arena, gen->functions, &gen->function_capacity,
+                                                            gen->function_count + 1, sizeof(ModuleFunction));
+            ModuleFunction* function = &gen->functions[gen->function_count++];
+            function->name = add_constant(gen, node->value);
+            function->param_count = params_node->child_count;
+            function->params = gen->param_count;
+            function->entry = gen->size;
+            function->local_count = gen->resolver
+                ? resolved_frame_size(gen->resolver, (NodeIndex)(node - gen->ast->nodes)) - params_node->child_count
+                : 0;
+
+            gen->params = (uint32_t*)arena_reserve(gen->arena, gen->params, &gen->param_capacity,
+                                                   gen->param_count + params_node->child_count,
+                                                   sizeof(uint32_t));
+            for (uint32_t i = 0; i < params_node->child_count; i++) {
+                const ASTNode* param = child_node(gen, params_node, i);
+                gen->params[gen->param_count++] = add_constant(gen, param->value);
+            }
             
             // Generate body
-            for (int i = 0; i < body_node->children_count; i++) {
-                generate_node(gen, body_node->children[i]);
+            for (uint32_t i = 0; i < body_node->child_count; i++) {
+                generate_statement(gen, child_node(gen, body_node, i));
             }
             
             emit_instruction(gen, OP_RETURN);
@@ -108,7 +242,7 @@ static void generate_node(CodeGenerator* gen, ASTNode* node) {
         
         case NODE_RUN_STATEMENT: {
             // Run statement
-            if (node->children_count > 0) {
+            if (node->child_count > 0) {
                 emit_instruction(gen, OP_QUANTUM_OP);
             }
             emit_instruction(gen, OP_RUN_COMMAND, node->value);
@@ -117,35 +251,45 @@ static void generate_node(CodeGenerator* gen, ASTNode* node) {
         
         case NODE_PRINT_STATEMENT: {
             // Print statement
-            generate_node(gen, node->children[0]);
+            generate_node(gen, child_node(gen, node, 0));
             emit_instruction(gen, OP_PRINT);
             break;
         }
         
         case NODE_RETURN_STATEMENT: {
             // Return statement
-            generate_node(gen, node->children[0]);
+            generate_node(gen, child_node(gen, node, 0));
             emit_instruction(gen, OP_RETURN);
             break;
         }
         
         case NODE_FUNCTION_CALL: {
             // Function call
-            ASTNode* args_node = node->children[0];
+            const ASTNode* args_node = child_node(gen, node, 0);
             
             // Push arguments
-            for (int i = 0; i < args_node->children_count; i++) {
-                generate_node(gen, args_node->children[i]);
+            for (uint32_t i = 0; i < args_node->child_count; i++) {
+                generate_node(gen, child_node(gen, args_node, i));
             }
             
-            emit_instruction(gen, OP_CALL_FUNCTION, node->value);
+            Symbol symbol = node_symbol(gen, node);
+            if (symbol.kind == SYMBOL_FUNCTION) {
+                emit_instruction(gen, OP_CALL_INDEX, symbol.index);
+            } else {
+                emit_instruction(gen, OP_CALL_FUNCTION, node->value);
+            }
             break;
         }
         
         case NODE_NUMBER_LITERAL: {
-            // Number literal
-            int num = atoi(node->value);
-            emit_instruction(gen, OP_PUSH_NUMBER, num);
+            // Integer literal
+            emit_instruction(gen, OP_PUSH_INT, ast_number(gen->ast, node).integer);
+            break;
+        }
+        
+        case NODE_FLOAT_LITERAL: {
+            // Double literal
+            emit_instruction(gen, OP_PUSH_DOUBLE, ast_number(gen->ast, node).real);
             break;
         }
         
@@ -157,27 +301,372 @@ static void generate_node(CodeGenerator* gen, ASTNode* node) {
         
         case NODE_IDENTIFIER: {
             // Identifier
-            emit_instruction(gen, OP_PUSH_IDENTIFIER, node->value);
+            Symbol symbol = node_symbol(gen, node);
+            if (symbol.kind == SYMBOL_LOCAL) {
+                emit_instruction(gen, OP_LOAD_LOCAL, symbol.index);
+            } else if (symbol.kind == SYMBOL_GLOBAL) {
+                emit_instruction(gen, OP_LOAD_GLOBAL, symbol.index);
+            } else {
+                emit_instruction(gen, OP_PUSH_IDENTIFIER, node->value);
+            }
+            break;
+        }
+
+        case NODE_ASSIGNMENT: {
+            // Assignment: the value, then a store that leaves it pushed
+            generate_node(gen, child_node(gen, node, 0));
+            Symbol symbol = node_symbol(gen, node);
+            if (symbol.kind == SYMBOL_LOCAL) {
+                emit_instruction(gen, OP_STORE_LOCAL, symbol.index);
+            } else if (symbol.kind == SYMBOL_GLOBAL) {
+                emit_instruction(gen, OP_STORE_GLOBAL, symbol.index);
+            } else {
+                emit_instruction(gen, OP_STORE_NAME, node->value);
+            }
+            break;
+        }
+
+        case NODE_BINARY_OP: {
+            // Binary operator: both operands, then the operator
+            generate_node(gen, child_node(gen, node, 0));
+            generate_node(gen, child_node(gen, node, 1));
+            emit_instruction(gen, operator_opcode((TokenType)node->value, false));
+            break;
+        }
+
+        case NODE_UNARY_OP: {
+            // Prefix operator
+            generate_node(gen, child_node(gen, node, 0));
+            emit_instruction(gen, operator_opcode((TokenType)node->value, true));
             break;
         }
         
         case NODE_PROGRAM: {
-            // Program
-            for (int i = 0; i < node->children_count; i++) {
-                generate_node(gen, node->children[i]);
+            // Program: top-level statements, then every function body
+            generate_top_level(gen, node);
+            for (uint32_t i = 0; i < node->child_count; i++) {
+                if (child_node(gen, node, i)->type == NODE_FUNCTION_DEF) {
+                    generate_node(gen, child_node(gen, node, i));
+                }
             }
             break;
         }
         
         default:
-            fprintf(stderr, "Unknown node type: %d\n", node->type);
-            exit(1);
+            raise_error("Unknown node type: %d", node->type);
+    }
+}
+
+// Generate the top-level statements of a program, ending with OP_RETURN
+static void generate_top_level(CodeGenerator* gen, const ASTNode* program) {
+    for (uint32_t i = 0; i < program->child_count; i++) {
+        if (child_node(gen, program, i)->type != NODE_FUNCTION_DEF) {
+            generate_statement(gen, child_node(gen, program, i));
+        }
+    }
+    emit_instruction(gen, OP_RETURN);
+}
+
+#define ALIGN4(n) (((n) + 3) & ~(size_t)3)
+
+// Lay out the constant pool, function table and code as a module image,
+// after the peephole pass if the generator has it enabled
+uint8_t* build_module(CodeGenerator* gen, size_t* output_size) {
+    if (gen->optimize) {
+        optimize_code(gen, &gen->optimize_report);
+    }
+
+    size_t string_bytes = 0;
+    for (int i = 0; i < gen->constant_count; i++) {
+        string_bytes += intern_length(gen->strings, gen->constants[i]) + 1;
     }
+
+    size_t constants_offset = sizeof(ModuleHeader);
+    size_t functions_offset = constants_offset + gen->constant_count * sizeof(ModuleConstant);
+    size_t params_offset = functions_offset + gen->function_count * sizeof(ModuleFunction);
+    size_t globals_offset = params_offset + gen->param_count * sizeof(uint32_t);
+    size_t strings_offset = globals_offset + gen->global_count * sizeof(uint32_t);
+    size_t code_offset = ALIGN4(strings_offset + string_bytes);
+    size_t size = code_offset + gen->size;
+    if (size > UINT32_MAX) {
+        raise_error("Module too large: %zu bytes", size);
+    }
+
+    uint8_t* image = (uint8_t*)arena_alloc(gen->arena, size);
+    memset(image, 0, size);
+
+    ModuleHeader* header = (ModuleHeader*)image;
+    memcpy(header->magic, MODULE_MAGIC, 4);
+    header->version = MODULE_VERSION;
+    header->size = (uint32_t)size;
+    header->constant_count = gen->constant_count;
+    header->constants_offset = (uint32_t)constants_offset;
+    header->function_count = gen->function_count;
+    header->functions_offset = (uint32_t)functions_offset;
+    header->params_offset = (uint32_t)params_offset;
+    header->global_count = gen->global_count;
+    header->globals_offset = (uint32_t)globals_offset;
+    header->code_offset = (uint32_t)code_offset;
+    header->code_size = (uint32_t)gen->size;
+
+    ModuleConstant* constants = (ModuleConstant*)(image + constants_offset);
+    size_t text_offset = strings_offset;
+    for (int i = 0; i < gen->constant_count; i++) {
+        int length = intern_length(gen->strings, gen->constants[i]);
+        constants[i].offset = (uint32_t)text_offset;
+        constants[i].length = (uint32_t)length;
+        memcpy(image + text_offset, intern_text(gen->strings, gen->constants[i]), length);
+        text_offset += length + 1;
+    }
+
+    if (gen->function_count > 0) {
+        memcpy(image + functions_offset, gen->functions,
+               gen->function_count * sizeof(ModuleFunction));
+    }
+    if (gen->param_count > 0) {
+        memcpy(image + params_offset, gen->params, gen->param_count * sizeof(uint32_t));
+    }
+    if (gen->global_count > 0) {
+        memcpy(image + globals_offset, gen->globals, gen->global_count * sizeof(uint32_t));
+    }
+    memcpy(image + code_offset, gen->instructions, gen->size);
+
+    *output_size = size;
+    return image;
+}
+
+// Resolve the names of a whole program unless that is already done. The
+// global names become the first constants, so linked units and serial
+// generation number them alike
+static void resolve_names(CodeGenerator* gen, const AST* ast) {
+    if (!gen->resolver) {
+        Resolver* resolver = create_resolver(gen->arena, ast);
+        resolve_program(resolver);
+        gen->resolver = resolver;
+        for (uint32_t i = 0; i < resolver->global_count; i++) {
+            add_global(gen, resolver->global_names[i]);
+        }
+    }
+}
+
+// Generate a module image from an AST
+uint8_t* generate_code(CodeGenerator* gen, const AST* ast, size_t* output_size) {
+    gen->ast = ast;
+    resolve_names(gen, ast);
+    generate_node(gen, ast_node(ast, ast->root));
+    return build_module(gen, output_size);
 }
 
-// Generate code from an AST
-uint8_t* generate_code(CodeGenerator* gen, ASTNode* ast, size_t* output_size) {
-    generate_node(gen, ast);
-    *output_size = gen->size;
-    return gen->instructions;
-} 
\ No newline at end of file
+// Generate one top-level item of a program, a function definition or a
+// statement, as a unit for link_unit. The caller has resolved the item
+void generate_item(CodeGenerator* gen, const AST* ast, NodeIndex item) {
+    gen->ast = ast;
+    const ASTNode* node = ast_node(ast, item);
+    if (node->type == NODE_FUNCTION_DEF) {
+        generate_node(gen, node);
+    } else {
+        generate_statement(gen, node);
+    }
+}
+
+// A piece of a program generated on its own: either the top-level code or
+// a run of consecutive function definitions
+typedef struct {
+    const CodeGenerator* parent;
+    const ASTNode* program;
+    const uint32_t* defs;     // Program child indices of the functions
+    uint32_t def_count;       // 0 for the top-level unit
+    Arena* arena;
+    CodeGenerator* gen;
+    bool failed;
+    char error[ERROR_MESSAGE_MAX];
+} CodegenUnit;
+
+// Generate one unit into a private arena and generator; the AST and the
+// interning table are only read. An error is kept in the unit for the
+// calling thread to raise
+static void generate_unit(void* userdata, size_t index) {
+    CodegenUnit* unit = &((CodegenUnit*)userdata)[index];
+    ErrorHandler handler;
+    error_push_handler(&handler);
+    if (setjmp(handler.jump) == 0) {
+        unit->arena = create_arena(0);
+        if (!unit->arena) {
+            raise_error("Out of memory");
+        }
+        unit->gen = create_code_generator(unit->arena, unit->parent->strings);
+        if (!unit->gen) {
+            raise_error("Out of memory");
+        }
+        unit->gen->ast = unit->parent->ast;
+        unit->gen->resolver = unit->parent->resolver;
+        unit->gen->track_relocations = true;
+
+        if (unit->def_count == 0) {
+            generate_top_level(unit->gen, unit->program);
+        }
+        for (uint32_t i = 0; i < unit->def_count; i++) {
+            generate_node(unit->gen, child_node(unit->gen, unit->program, unit->defs[i]));
+        }
+        error_pop_handler(&handler);
+    } else {
+        memcpy(unit->error, handler.message, sizeof(unit->error));
+        unit->failed = true;
+    }
+}
+
+// Release the units of a parallel generation
+static void destroy_units(CodegenUnit* units, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        destroy_code_generator(units[i].gen);
+        destroy_arena(units[i].arena);
+    }
+    free(units);
+}
+
+#define UNMAPPED UINT32_MAX
+
+// Rewrite the name instruction just copied to the module into its bound
+// form, if link_unit has a target for the name
+static bool bind_name(CodeGenerator* gen, uint8_t opcode, StringId name) {
+    const Scope* targets = opcode == OP_CALL_FUNCTION ? gen->call_targets : gen->global_targets;
+    if (!targets || (opcode != OP_CALL_FUNCTION && opcode != OP_PUSH_IDENTIFIER && opcode != OP_STORE_NAME)) {
+        return false;
+    }
+    Symbol target = scope_find(targets, name);
+    if (target.kind == SYMBOL_NONE) {
+        return false;
+    }
+    gen->instructions[gen->size - 1] = opcode == OP_CALL_FUNCTION ? OP_CALL_INDEX
+                                       : opcode == OP_PUSH_IDENTIFIER ? OP_LOAD_GLOBAL : OP_STORE_GLOBAL;
+    emit_varint(gen, target.index);
+    return true;
+}
+
+// Get the module constant of a unit constant, adding it on first use
+static uint32_t map_constant(CodeGenerator* gen, const CodeGenerator* unit, uint32_t* map, uint32_t constant) {
+    if (map[constant] == UNMAPPED) {
+        map[constant] = add_constant(gen, unit->constants[constant]);
+    }
+    return map[constant];
+}
+
+// Append a unit's code, functions and parameters to the module being
+// built. Constants are renumbered into the module's pool as the unit uses
+// them, a function's name and parameters at its entry, so linking the
+// units in program order numbers them exactly as serial generation would.
+// With call_targets set, calls by name to those functions become
+// OP_CALL_INDEX, and with global_targets set, loads and stores of those
+// names become global ones; their names are never added. Rewritten
+// operands can change length, which moves every later function entry of
+// the unit
+void link_unit(CodeGenerator* gen, const CodeGenerator* unit) {
+    uint32_t* map = (uint32_t*)arena_alloc(gen->arena, (unit->constant_count + 1) * sizeof(uint32_t));
+    for (int i = 0; i < unit->constant_count; i++) {
+        map[i] = UNMAPPED;
+    }
+
+    int first_function = gen->function_count;
+    gen->functions = (ModuleFunction*)arena_reserve(gen->arena, gen->functions, &gen->function_capacity,
+                                                    gen->function_count + unit->function_count,
+                                                    sizeof(ModuleFunction));
+    for (int i = 0; i < unit->function_count; i++) {
+        ModuleFunction function = unit->functions[i];
+        function.params += gen->param_count;
+        gen->functions[gen->function_count++] = function;
+    }
+    int first_param = gen->param_count;
+    gen->params = (uint32_t*)arena_reserve(gen->arena, gen->params, &gen->param_capacity,
+                                           gen->param_count + unit->param_count, sizeof(uint32_t));
+    gen->param_count += unit->param_count;
+
+    // Copy the code between operands, rewriting each operand and placing
+    // the entries that fall in each copied span
+    size_t from = 0;
+    int function = first_function;
+    for (int r = 0; r <= unit->relocation_count; r++) {
+        size_t at = r < unit->relocation_count ? unit->relocations[r] : unit->size;
+        while (function < gen->function_count && gen->functions[function].entry < at) {
+            ModuleFunction* entry = &gen->functions[function++];
+            const ModuleFunction* source = &unit->functions[function - 1 - first_function];
+            entry->entry = (uint32_t)(gen->size + entry->entry - from);
+            entry->name = map_constant(gen, unit, map, source->name);
+            for (uint32_t i = 0; i < source->param_count; i++) {
+                gen->params[first_param + source->params + i] =
+                    map_constant(gen, unit, map, unit->params[source->params + i]);
+            }
+        }
+        ensure_capacity(gen, at - from);
+        memcpy(gen->instructions + gen->size, unit->instructions + from, at - from);
+        gen->size += at - from;
+        if (r == unit->relocation_count) {
+            break;
+        }
+
+        uint32_t constant = 0;
+        size_t consumed = varint_decode_u32(unit->instructions + at, unit->size - at, &constant);
+        from = at + consumed;
+        if (bind_name(gen, unit->instructions[at - 1], unit->constants[constant])) {
+            continue;
+        }
+        emit_varint(gen, map_constant(gen, unit, map, constant));
+    }
+}
+
+// Generate a module image from an AST like generate_code, with the
+// top-level code and runs of functions generated on a worker pool and then
+// linked in program order. The image is identical to generate_code's
+uint8_t* generate_code_parallel(CodeGenerator* gen, const AST* ast, WorkerPool* pool, size_t* output_size) {
+    gen->ast = ast;
+    resolve_names(gen, ast);
+    const ASTNode* program = ast_node(ast, ast->root);
+    uint32_t workers = pool ? (uint32_t)pool->thread_count + 1 : 1;
+
+    uint32_t* defs = (uint32_t*)arena_alloc(gen->arena, (program->child_count + 1) * sizeof(uint32_t));
+    uint32_t def_count = 0;
+    for (uint32_t i = 0; i < program->child_count; i++) {
+        if (child_node(gen, program, i)->type == NODE_FUNCTION_DEF) {
+            defs[def_count++] = i;
+        }
+    }
+    if (workers < 2 || def_count < PARALLEL_CODEGEN_MIN_FUNCTIONS) {
+        return generate_code(gen, ast, output_size);
+    }
+
+    // Unit 0 is the top-level code; the functions are split evenly over the rest
+    uint32_t run_count = workers * PARALLEL_CODEGEN_UNITS_PER_WORKER;
+    if (run_count > def_count) {
+        run_count = def_count;
+    }
+    CodegenUnit* units = (CodegenUnit*)calloc(run_count + 1, sizeof(CodegenUnit));
+    if (!units) {
+        raise_error("Out of memory");
+    }
+    units[0].parent = gen;
+    units[0].program = program;
+    for (uint32_t i = 0; i < run_count; i++) {
+        uint32_t first = (uint32_t)((uint64_t)def_count * i / run_count);
+        uint32_t end = (uint32_t)((uint64_t)def_count * (i + 1) / run_count);
+        units[i + 1].parent = gen;
+        units[i + 1].program = program;
+        units[i + 1].defs = defs + first;
+        units[i + 1].def_count = end - first;
+    }
+    worker_pool_run(pool, generate_unit, units, run_count + 1);
+
+    // Raise the error of the first unit that failed
+    for (uint32_t i = 0; i <= run_count; i++) {
+        if (units[i].failed) {
+            char message[ERROR_MESSAGE_MAX];
+            memcpy(message, units[i].error, sizeof(message));
+            destroy_units(units, run_count + 1);
+            raise_error("%s", message);
+        }
+    }
+
+    for (uint32_t i = 0; i <= run_count; i++) {
+        link_unit(gen, units[i].gen);
+    }
+    destroy_units(units, run_count + 1);
+    return build_module(gen, output_size);
+}
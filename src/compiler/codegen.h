@@ -2,36 +2,179 @@
 #define IBERY_CODEGEN_H
 
 #include "parser.h"
+#include "module.h"
+#include "resolve.h"
+#include "optimize.h"
+#include "workers.h"
 #include <stdint.h>
+#include <stddef.h>
 
-// Opcodes for the binary format
+// Opcodes of the code section. String operands are constant indices as
+// unsigned LEB128 varints, integers are signed LEB128 and doubles their
+// eight IEEE bytes (see varint.h).
+// 0x01, 0x02 and 0x0B held inline function headers before the function
+// table existed and are not reused. Names the resolver binds are emitted
+// as OP_CALL_INDEX and the local and global opcodes with an unsigned varint
+// function index or slot; the name opcodes remain for unbound names.
+// OP_STORE_NAME only appears in units and is bound by link_unit. Operators
+// pop their operands and push the result; stores leave the value pushed.
 typedef enum {
-    OP_FUNCTION_DEF = 0x01,
-    OP_PUSH_NAME = 0x02,
     OP_RETURN = 0x03,
     OP_QUANTUM_OP = 0x04,
     OP_RUN_COMMAND = 0x05,
     OP_PRINT = 0x06,
     OP_CALL_FUNCTION = 0x07,
-    OP_PUSH_NUMBER = 0x08,
+    OP_PUSH_INT = 0x08,
     OP_PUSH_STRING = 0x09,
-    OP_PUSH_IDENTIFIER = 0x0A
+    OP_PUSH_IDENTIFIER = 0x0A,
+    OP_POP = 0x0C,
+    OP_CALL_INDEX = 0x0D,
+    OP_LOAD_LOCAL = 0x0E,
+    OP_STORE_LOCAL = 0x0F,
+    OP_LOAD_GLOBAL = 0x10,
+    OP_STORE_GLOBAL = 0x11,
+    OP_STORE_NAME = 0x12,
+    OP_ADD = 0x13,
+    OP_SUBTRACT = 0x14,
+    OP_MULTIPLY = 0x15,
+    OP_DIVIDE = 0x16,
+    OP_MODULO = 0x17,
+    OP_POWER = 0x18,
+    OP_SHIFT_LEFT = 0x19,
+    OP_SHIFT_RIGHT = 0x1A,
+    OP_SHIFT_RIGHT_UNSIGNED = 0x1B,
+    OP_BIT_AND = 0x1C,
+    OP_BIT_OR = 0x1D,
+    OP_BIT_XOR = 0x1E,
+    OP_EQUAL = 0x1F,
+    OP_NOT_EQUAL = 0x20,
+    OP_LESS = 0x21,
+    OP_LESS_EQUAL = 0x22,
+    OP_GREATER = 0x23,
+    OP_GREATER_EQUAL = 0x24,
+    OP_NEGATE = 0x25,
+    OP_NOT = 0x26,
+    OP_BIT_NOT = 0x27,
+    OP_PUSH_DOUBLE = 0x28
 } Opcode;
 
-// Code generator structure
-typedef struct {
+// What follows an opcode
+typedef enum {
+    OPERAND_NONE,
+    OPERAND_CONSTANT,  // Unsigned varint constant index
+    OPERAND_INT,       // Signed 64-bit varint
+    OPERAND_DOUBLE,    // Eight bytes
+    OPERAND_INDEX      // Unsigned varint function index or slot
+} OperandKind;
+
+// Get the operand kind of an opcode
+static inline OperandKind opcode_operand(uint8_t opcode) {
+    switch (opcode) {
+        case OP_RUN_COMMAND:
+        case OP_CALL_FUNCTION:
+        case OP_PUSH_STRING:
+        case OP_PUSH_IDENTIFIER:
+        case OP_STORE_NAME:
+            return OPERAND_CONSTANT;
+        case OP_PUSH_INT:
+            return OPERAND_INT;
+        case OP_PUSH_DOUBLE:
+            return OPERAND_DOUBLE;
+        case OP_CALL_INDEX:
+        case OP_LOAD_LOCAL:
+        case OP_STORE_LOCAL:
+        case OP_LOAD_GLOBAL:
+        case OP_STORE_GLOBAL:
+            return OPERAND_INDEX;
+        default:
+            return OPERAND_NONE;
+    }
+}
+
+// Get the opcode of a binary or unary operator token, or 0
+static inline uint8_t operator_opcode(TokenType type, bool unary) {
+    switch (type) {
+        case TOKEN_PLUS: return OP_ADD;
+        case TOKEN_MINUS: return unary ? OP_NEGATE : OP_SUBTRACT;
+        case TOKEN_MULTIPLY: return OP_MULTIPLY;
+        case TOKEN_DIVIDE: return OP_DIVIDE;
+        case TOKEN_MODULO: return OP_MODULO;
+        case TOKEN_POWER: return OP_POWER;
+        case TOKEN_LEFT_SHIFT: return OP_SHIFT_LEFT;
+        case TOKEN_RIGHT_SHIFT: return OP_SHIFT_RIGHT;
+        case TOKEN_UNSIGNED_RIGHT_SHIFT: return OP_SHIFT_RIGHT_UNSIGNED;
+        case TOKEN_BITWISE_AND: return OP_BIT_AND;
+        case TOKEN_BITWISE_OR: return OP_BIT_OR;
+        case TOKEN_BITWISE_XOR: return OP_BIT_XOR;
+        case TOKEN_EQUAL_EQUAL: return OP_EQUAL;
+        case TOKEN_NOT_EQUAL: return OP_NOT_EQUAL;
+        case TOKEN_LESS: return OP_LESS;
+        case TOKEN_LESS_EQUAL: return OP_LESS_EQUAL;
+        case TOKEN_GREATER: return OP_GREATER;
+        case TOKEN_GREATER_EQUAL: return OP_GREATER_EQUAL;
+        case TOKEN_NOT: return OP_NOT;
+        case TOKEN_BITWISE_NOT: return OP_BIT_NOT;
+        default: return 0;
+    }
+}
+
+// Code generator structure; every buffer lives in the arena and node values
+// are looked up in the parser's interning table
+typedef struct CodeGenerator {
+    Arena* arena;
+    const InternTable* strings;
+    const AST* ast;
+    const Resolver* resolver;     // Symbols of the AST's names
+    const Scope* call_targets;    // Functions link_unit binds name calls to
+    const Scope* global_targets;  // Globals link_unit binds names to
     uint8_t* instructions;
     size_t capacity;
     size_t size;
     int label_counter;
+
+    // Constant pool, deduplicated by interned id
+    uint32_t* constant_index;  // Pool index + 1 for each StringId, 0 if unused
+    size_t constant_index_capacity;
+    StringId* constants;
+    int constant_count;
+    size_t constant_capacity;
+
+    // Function table and parameter names
+    ModuleFunction* functions;
+    int function_count;
+    size_t function_capacity;
+    uint32_t* params;
+    int param_count;
+    size_t param_capacity;
+
+    // Global names as constant indices, by global index
+    uint32_t* globals;
+    int global_count;
+    size_t global_capacity;
+
+    // Code offsets of constant operands; only recorded for code that is
+    // linked into another generator's module
+    bool track_relocations;
+    uint32_t* relocations;
+    int relocation_count;
+    size_t relocation_capacity;
+
+    // Peephole pass run by build_module, see optimize.h
+    bool optimize;
+    OptimizeReport optimize_report;
 } CodeGenerator;
 
 // Function declarations
-CodeGenerator* create_code_generator(void);
+CodeGenerator* create_code_generator(Arena* arena, const InternTable* strings);
 void destroy_code_generator(CodeGenerator* gen);
-uint8_t* generate_code(CodeGenerator* gen, ASTNode* ast, size_t* output_size);
+void reset_code_generator(CodeGenerator* gen);
+uint8_t* generate_code(CodeGenerator* gen, const AST* ast, size_t* output_size);
+uint8_t* generate_code_parallel(CodeGenerator* gen, const AST* ast, WorkerPool* pool, size_t* output_size);
+void generate_item(CodeGenerator* gen, const AST* ast, NodeIndex item);
+void link_unit(CodeGenerator* gen, const CodeGenerator* unit);
+uint8_t* build_module(CodeGenerator* gen, size_t* output_size);
 void emit_instruction(CodeGenerator* gen, uint8_t opcode, ...);
-void emit_string(CodeGenerator* gen, const char* str);
-void emit_number(CodeGenerator* gen, int number);
+uint32_t add_constant(CodeGenerator* gen, StringId id);
+void add_global(CodeGenerator* gen, StringId name);
 
 #endif // IBERY_CODEGEN_H 
\ No newline at end of file
@@ -0,0 +1,36 @@
+#include "error.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+
+// Innermost handler of each thread
+static _Thread_local ErrorHandler* current_handler = NULL;
+
+// Install a handler for errors raised on this thread
+void error_push_handler(ErrorHandler* handler) {
+    handler->message[0] = '\0';
+    handler->previous = current_handler;
+    current_handler = handler;
+}
+
+// Remove a handler after the work it guarded finished without an error
+void error_pop_handler(ErrorHandler* handler) {
+    current_handler = handler->previous;
+}
+
+// Report an error to the innermost handler, or print it and exit
+void raise_error(const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    ErrorHandler* handler = current_handler;
+    if (!handler) {
+        vfprintf(stderr, format, args);
+        fputc('\n', stderr);
+        va_end(args);
+        exit(1);
+    }
+    vsnprintf(handler->message, sizeof(handler->message), format, args);
+    va_end(args);
+    current_handler = handler->previous;
+    longjmp(handler->jump, 1);
+}
@@ -0,0 +1,36 @@
+#ifndef IBERY_ERROR_H
+#define IBERY_ERROR_H
+
+#include <setjmp.h>
+
+#define ERROR_MESSAGE_MAX 512
+
+// Compile and runtime errors are raised with raise_error. With no handler
+// installed on the calling thread the message goes to stderr and the
+// process exits, which is what the command line wants. A library caller
+// installs a handler first and gets control back with the message:
+//
+//     ErrorHandler handler;
+//     error_push_handler(&handler);
+//     if (setjmp(handler.jump) == 0) {
+//         ...work that may raise...
+//         error_pop_handler(&handler);
+//     } else {
+//         ...handler.message holds the error; the handler is already popped
+//     }
+//
+// Everything allocated from an arena is released with the arena as usual;
+// anything else the work created must be reachable from volatile locals
+// so the caller can free it after the jump.
+typedef struct ErrorHandler {
+    jmp_buf jump;
+    char message[ERROR_MESSAGE_MAX];
+    struct ErrorHandler* previous;
+} ErrorHandler;
+
+// Function declarations
+void error_push_handler(ErrorHandler* handler);
+void error_pop_handler(ErrorHandler* handler);
+__attribute__((noreturn, format(printf, 1, 2))) void raise_error(const char* format, ...);
+
+#endif // IBERY_ERROR_H
@@ -0,0 +1,163 @@
+#include "fold.h"
+#include "arith.h"
+#include "error.h"
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Check if a node is a number literal
+static bool is_number(const ASTNode* node) {
+    return node->type == NODE_NUMBER_LITERAL || node->type == NODE_FLOAT_LITERAL;
+}
+
+// Check if a node is a literal
+static bool is_literal(const ASTNode* node) {
+    return is_number(node) || node->type == NODE_STRING_LITERAL;
+}
+
+// Get the value of a number literal node
+static Number literal_number(const AST* ast, const ASTNode* node) {
+    Number number;
+    number.is_double = node->type == NODE_FLOAT_LITERAL;
+    number.as = ast_number(ast, node);
+    return number;
+}
+
+// Turn a node into a number literal; the node keeps its position, and its
+// slot of the number table if it was a number already
+static NodeIndex make_number(AST* ast, NodeIndex index, Number value) {
+    ASTNode* node = &ast->nodes[index];
+    if (is_number(node)) {
+        ast->numbers[node->value] = value.as;
+    } else {
+        node->value = ast_add_number(ast, value.as);
+    }
+    node->type = value.is_double ? NODE_FLOAT_LITERAL : NODE_NUMBER_LITERAL;
+    node->child_count = 0;
+    return index;
+}
+
+// Get the text a literal has when concatenated
+static const char* literal_text(const AST* ast, const InternTable* strings, const ASTNode* node,
+                                char* buffer, int* length) {
+    if (node->type == NODE_STRING_LITERAL) {
+        *length = intern_length(strings, node->value);
+        return intern_text(strings, node->value);
+    }
+    *length = format_number(buffer, literal_number(ast, node));
+    return buffer;
+}
+
+// Append text to the parser's fold buffer
+static void append_text(Parser* parser, const char* text, int length) {
+    parser->fold_text = (char*)arena_reserve(parser->arena, parser->fold_text, &parser->fold_capacity,
+                                             parser->fold_length + length, 1);
+    memcpy(parser->fold_text + parser->fold_length, text, length);
+    parser->fold_length += length;
+}
+
+// Extend a run of concatenations with left + right. A run starts at two
+// literals whose sum is a string and goes on while literals are added;
+// returns false, leaving the run as it was, if the operation does not
+// continue it or the text would grow too long for a string
+bool fold_run_append(Parser* parser, FoldRun* run, TokenType type, NodeIndex left, NodeIndex right) {
+    const ASTNode* a = ast_node(parser->ast, left);
+    const ASTNode* b = ast_node(parser->ast, right);
+    if (type != TOKEN_PLUS || !is_literal(b)) {
+        return false;
+    }
+    if (!run->active && (!is_literal(a) || (is_number(a) && is_number(b)))) {
+        return false;
+    }
+
+    char buffer[NUMBER_TEXT_MAX];
+    int length;
+    const char* text;
+    if (!run->active) {
+        run->start = parser->fold_length;
+        text = literal_text(parser->ast, parser->strings, a, buffer, &length);
+        append_text(parser, text, length);
+    }
+    text = literal_text(parser->ast, parser->strings, b, buffer, &length);
+    if (parser->fold_length - run->start > (size_t)(INT_MAX - length)) {
+        if (!run->active) {
+            parser->fold_length = run->start;
+        }
+        return false;
+    }
+    append_text(parser, text, length);
+    run->active = true;
+    return true;
+}
+
+// End a run of concatenations: left becomes the string literal of its
+// text, interned once however many literals the run joined
+void fold_run_end(Parser* parser, FoldRun* run, NodeIndex left) {
+    if (!run->active) {
+        return;
+    }
+    StringId value = intern_string(parser->strings, parser->fold_text + run->start,
+                                   (int)(parser->fold_length - run->start));
+    parser->fold_length = run->start;
+    run->active = false;
+
+    ASTNode* node = &parser->ast->nodes[left];
+    node->type = NODE_STRING_LITERAL;
+    node->value = value;
+    node->child_count = 0;
+}
+
+// Fold a binary operator over two literals into the left one; returns
+// NODE_NONE if the result is not a compile-time constant
+NodeIndex fold_binary(AST* ast, InternTable* strings, TokenType type, NodeIndex left, NodeIndex right) {
+    const ASTNode* a = ast_node(ast, left);
+    const ASTNode* b = ast_node(ast, right);
+    if (!is_literal(a) || !is_literal(b)) {
+        return NODE_NONE;
+    }
+    uint8_t opcode = operator_opcode(type, false);
+
+    if (is_number(a) && is_number(b)) {
+        Number result;
+        if (arith_binary(opcode, literal_number(ast, a), literal_number(ast, b), &result) != ARITH_OK) {
+            return NODE_NONE;
+        }
+        return make_number(ast, left, result);
+    }
+    if (opcode == OP_ADD) {
+        // Concatenations fold as runs; one reaching here is too long
+        return NODE_NONE;
+    }
+    if (a->type == NODE_STRING_LITERAL && b->type == NODE_STRING_LITERAL && is_comparison(opcode)) {
+        int order = compare_text(intern_text(strings, a->value), intern_length(strings, a->value),
+                                 intern_text(strings, b->value), intern_length(strings, b->value));
+        return make_number(ast, left, make_integer(compare_result(opcode, order)));
+    }
+    if (opcode == OP_EQUAL || opcode == OP_NOT_EQUAL) {
+        // A number never equals a string
+        return make_number(ast, left, make_integer(opcode == OP_NOT_EQUAL));
+    }
+    return NODE_NONE;
+}
+
+// Fold a prefix operator over a literal into it; returns NODE_NONE if the
+// result is not a compile-time constant
+NodeIndex fold_unary(AST* ast, InternTable* strings, TokenType type, NodeIndex operand) {
+    const ASTNode* node = ast_node(ast, operand);
+    uint8_t opcode = operator_opcode(type, true);
+    if (node->type == NODE_STRING_LITERAL && opcode == OP_NOT) {
+        return make_number(ast, operand, make_integer(intern_length(strings, node->value) == 0));
+    }
+    if (!is_number(node)) {
+        return NODE_NONE;
+    }
+    Number value = literal_number(ast, node);
+    if (opcode == OP_NOT) {
+        return make_number(ast, operand, make_integer(number_is_zero(value)));
+    }
+    Number result;
+    if (arith_unary(opcode, value, &result) != ARITH_OK) {
+        return NODE_NONE;
+    }
+    return make_number(ast, operand, result);
+}
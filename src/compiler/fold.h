@@ -0,0 +1,27 @@
+#ifndef IBERY_FOLD_H
+#define IBERY_FOLD_H
+
+#include "parser.h"
+
+// Constant folding, applied by the parser as it builds each operator node.
+// Operands are already folded, so a constant expression of any depth
+// collapses into one literal. An expression whose result is only known at
+// runtime, or that would fail there (division by zero), is left alone so
+// the VM reports it
+
+// A run of string concatenations being folded by one level of the
+// parser: `"a" + "b" + 1 + ...` appends each literal's text to the
+// parser's fold buffer and interns the whole once the run ends, so a long
+// chain folds in linear time. Runs nested in an operand stack after it
+typedef struct {
+    bool active;
+    size_t start;  // Where the run's text starts in the fold buffer
+} FoldRun;
+
+// Function declarations
+bool fold_run_append(Parser* parser, FoldRun* run, TokenType type, NodeIndex left, NodeIndex right);
+void fold_run_end(Parser* parser, FoldRun* run, NodeIndex left);
+NodeIndex fold_binary(AST* ast, InternTable* strings, TokenType type, NodeIndex left, NodeIndex right);
+NodeIndex fold_unary(AST* ast, InternTable* strings, TokenType type, NodeIndex operand);
+
+#endif // IBERY_FOLD_H
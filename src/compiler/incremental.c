@@ -0,0 +1,346 @@
+#include "incremental.h"
+#include "varint.h"
+#include "error.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define COMPARE_BLOCK 4096
+
+// Create an empty program; the first update compiles everything
+IncrementalProgram* create_incremental_program(void) {
+    IncrementalProgram* program = (IncrementalProgram*)calloc(1, sizeof(IncrementalProgram));
+    if (!program) {
+        return NULL;
+    }
+    program->arena = create_arena(0);
+    program->string_arena = create_arena(0);
+    program->strings = create_intern_table(program->string_arena);
+    program->source = (char*)calloc(1, 1);
+    return program;
+}
+
+// Free the units of a range of items
+static void free_units(ProgramItem* items, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        free(items[i].unit);
+    }
+}
+
+// Destroy a program and the code of every item
+void destroy_incremental_program(IncrementalProgram* program) {
+    if (!program) return;
+
+    free_units(program->items, program->item_count);
+    free_units(program->pending, program->pending_count);
+    free(program->items);
+    free(program->source);
+    destroy_intern_table(program->strings);
+    destroy_arena(program->string_arena);
+    destroy_arena(program->arena);
+    free(program);
+}
+
+// Count the leading bytes two buffers have in common
+static size_t common_prefix(const char* a, const char* b, size_t limit) {
+    size_t n = 0;
+    while (n + COMPARE_BLOCK <= limit && memcmp(a + n, b + n, COMPARE_BLOCK) == 0) {
+        n += COMPARE_BLOCK;
+    }
+    while (n < limit && a[n] == b[n]) {
+        n++;
+    }
+    return n;
+}
+
+// Count the trailing bytes two buffers have in common
+static size_t common_suffix(const char* a_end, const char* b_end, size_t limit) {
+    size_t n = 0;
+    while (n + COMPARE_BLOCK <= limit &&
+           memcmp(a_end - n - COMPARE_BLOCK, b_end - n - COMPARE_BLOCK, COMPARE_BLOCK) == 0) {
+        n += COMPARE_BLOCK;
+    }
+    while (n < limit && a_end[-(ptrdiff_t)n - 1] == b_end[-(ptrdiff_t)n - 1]) {
+        n++;
+    }
+    return n;
+}
+
+// Count the items that start before a source offset
+static size_t items_before(const IncrementalProgram* program, size_t offset) {
+    size_t low = 0;
+    size_t high = program->item_count;
+    while (low < high) {
+        size_t mid = low + (high - low) / 2;
+        if (program->items[mid].start < offset) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return low;
+}
+
+#define ALIGN8(n) (((n) + 7) & ~(size_t)7)
+
+// Copy size bytes, where src may be NULL when size is 0; returns dst
+static void* copy_bytes(void* dst, const void* src, size_t size) {
+    if (size > 0) {
+        memcpy(dst, src, size);
+    }
+    return dst;
+}
+
+// Copy a generated unit into a single allocation that outlives the arena
+static CodeGenerator* pack_unit(const CodeGenerator* gen) {
+    size_t code_bytes = ALIGN8(gen->size);
+    size_t constant_bytes = ALIGN8(gen->constant_count * sizeof(StringId));
+    size_t function_bytes = gen->function_count * sizeof(ModuleFunction);
+    size_t param_bytes = gen->param_count * sizeof(uint32_t);
+    size_t relocation_bytes = gen->relocation_count * sizeof(uint32_t);
+    uint8_t* block = (uint8_t*)malloc(ALIGN8(sizeof(CodeGenerator)) + code_bytes + constant_bytes +
+                                      function_bytes + param_bytes + relocation_bytes);
+    if (!block) {
+        raise_error("Out of memory");
+    }
+
+    CodeGenerator* unit = (CodeGenerator*)block;
+    *unit = *gen;
+    unit->arena = NULL;
+    unit->ast = NULL;
+    unit->constant_index = NULL;
+    unit->constant_index_capacity = 0;
+
+    uint8_t* data = block + ALIGN8(sizeof(CodeGenerator));
+    unit->instructions = (uint8_t*)copy_bytes(data, gen->instructions, gen->size);
+    unit->capacity = gen->size;
+    data += code_bytes;
+    unit->constants = (StringId*)copy_bytes(data, gen->constants, gen->constant_count * sizeof(StringId));
+    unit->constant_capacity = gen->constant_count;
+    data += constant_bytes;
+    unit->functions = (ModuleFunction*)copy_bytes(data, gen->functions, function_bytes);
+    unit->function_capacity = gen->function_count;
+    data += function_bytes;
+    unit->params = (uint32_t*)copy_bytes(data, gen->params, param_bytes);
+    unit->param_capacity = gen->param_count;
+    data += param_bytes;
+    unit->relocations = (uint32_t*)copy_bytes(data, gen->relocations, relocation_bytes);
+    unit->relocation_capacity = gen->relocation_count;
+    return unit;
+}
+
+// Record an item parsed by the update in progress
+static void add_pending(IncrementalProgram* program, size_t start, bool is_function, CodeGenerator* unit) {
+    program->pending = (ProgramItem*)arena_reserve(program->arena, program->pending, &program->pending_capacity,
+                                                   program->pending_count + 1, sizeof(ProgramItem));
+    ProgramItem* item = &program->pending[program->pending_count++];
+    item->start = start;
+    item->is_function = is_function;
+    item->unit = unit;
+}
+
+// Make room for count items
+static void reserve_items(IncrementalProgram* program, size_t count) {
+    if (count <= program->item_capacity) {
+        return;
+    }
+    size_t capacity = program->item_capacity ? program->item_capacity : 64;
+    while (capacity < count) {
+        capacity *= 2;
+    }
+    ProgramItem* items = (ProgramItem*)realloc(program->items, capacity * sizeof(ProgramItem));
+    if (!items) {
+        raise_error("Out of memory");
+    }
+    program->items = items;
+    program->item_capacity = capacity;
+}
+
+// Replace items [first, resume) with the pending items; later items move
+// by shift bytes. The caller has reserved room for them
+static void commit_items(IncrementalProgram* program, size_t first, size_t resume, ptrdiff_t shift) {
+    size_t kept = program->item_count - resume;
+    free_units(program->items + first, resume - first);
+    ProgramItem* tail = program->items + first + program->pending_count;
+    memmove(tail, program->items + resume, kept * sizeof(ProgramItem));
+    for (size_t i = 0; i < kept; i++) {
+        tail[i].start += shift;
+    }
+    copy_bytes(program->items + first, program->pending, program->pending_count * sizeof(ProgramItem));
+    program->item_count = first + program->pending_count + kept;
+    program->pending_count = 0;
+}
+
+// Keep a copy of the compiled source to diff the next version against
+static void commit_source(IncrementalProgram* program, const char* source, size_t length) {
+    char* copy = (char*)realloc(program->source, length + 1);
+    if (!copy) {
+        raise_error("Out of memory");
+    }
+    program->source = copy;
+    memcpy(copy, source, length);
+    copy[length] = '\0';
+    program->length = length;
+}
+
+// Number the globals top-level statements assign in the order their
+// stores appear, as resolve_program does
+static void declare_globals(IncrementalProgram* program, CodeGenerator* gen, Scope* globals) {
+    for (size_t i = 0; i < program->item_count; i++) {
+        const CodeGenerator* unit = program->items[i].unit;
+        if (program->items[i].is_function) {
+            continue;
+        }
+        for (int r = 0; r < unit->relocation_count; r++) {
+            size_t at = unit->relocations[r];
+            if (unit->instructions[at - 1] != OP_STORE_NAME) {
+                continue;
+            }
+            uint32_t constant = 0;
+            varint_decode_u32(unit->instructions + at, unit->size - at, &constant);
+            StringId name = unit->constants[constant];
+            if (scope_define(globals, program->arena, name, (uint32_t)gen->global_count)) {
+                add_global(gen, name);
+            }
+        }
+    }
+}
+
+// Link every item into a module: top-level statements first, then the
+// function bodies, each in program order. Items are generated without
+// knowing the other items' functions and globals, so calls and global
+// names are bound here
+static uint8_t* link_items(IncrementalProgram* program, CodeGenerator* gen, size_t* module_size) {
+    Scope functions;
+    scope_init(&functions, SYMBOL_FUNCTION, NULL);
+    uint32_t function_count = 0;
+    for (size_t i = 0; i < program->item_count; i++) {
+        const CodeGenerator* unit = program->items[i].unit;
+        if (program->items[i].is_function) {
+            scope_define(&functions, program->arena, unit->constants[unit->functions[0].name],
+                         function_count++);
+        }
+    }
+
+    reset_code_generator(gen);
+    Scope globals;
+    scope_init(&globals, SYMBOL_GLOBAL, NULL);
+    declare_globals(program, gen, &globals);
+
+    gen->track_relocations = false;
+    gen->call_targets = &functions;
+    gen->global_targets = &globals;
+    for (size_t i = 0; i < program->item_count; i++) {
+        if (!program->items[i].is_function) {
+            link_unit(gen, program->items[i].unit);
+        }
+    }
+    emit_instruction(gen, OP_RETURN);
+    for (size_t i = 0; i < program->item_count; i++) {
+        if (program->items[i].is_function) {
+            link_unit(gen, program->items[i].unit);
+        }
+    }
+    gen->call_targets = NULL;
+    gen->global_targets = NULL;
+    return build_module(gen, module_size);
+}
+
+// Compile a new version of the program's source; source[length] must be
+// '\0'. Only the items from just before the first changed byte up to the
+// first unchanged item after the last one are re-lexed, re-parsed and
+// regenerated. On an error the program keeps its previous version. The
+// module lives in the program until the next update
+uint8_t* incremental_compile(IncrementalProgram* program, const char* source, size_t length,
+                             size_t* module_size) {
+    if (program->module && length == program->length && memcmp(source, program->source, length) == 0) {
+        program->relexed_bytes = 0;
+        program->reparsed_items = 0;
+        program->reused_items = program->item_count;
+        *module_size = program->module_size;
+        return program->module;
+    }
+    arena_reset(program->arena);
+    program->module = NULL;
+    program->pending = NULL;
+    program->pending_capacity = 0;
+
+    // The edit replaced old bytes [prefix, old_end) with new bytes [prefix, new_end)
+    size_t old_length = program->length;
+    size_t limit = length < old_length ? length : old_length;
+    size_t prefix = common_prefix(source, program->source, limit);
+    size_t suffix = common_suffix(source + length, program->source + old_length, limit - prefix);
+    size_t old_end = old_length - suffix;
+    size_t new_end = length - suffix;
+
+    // Whether an item ends where it did depends on the first token of the
+    // next one, so re-parsing starts an item before the one the edit is in
+    size_t before = items_before(program, prefix);
+    size_t first = before >= 2 ? before - 2 : 0;
+    size_t lex_start = first > 0 ? program->items[first].start : 0;
+
+    Lexer* volatile lexer = NULL;
+    Parser* volatile parser = NULL;
+    CodeGenerator* volatile gen = NULL;
+    ErrorHandler handler;
+    error_push_handler(&handler);
+    if (setjmp(handler.jump) == 0) {
+        lexer = create_lexer_from_buffer(source, length, program->arena);
+        lexer->position = lex_start;
+        parser = create_parser_with_strings(lexer, NULL, program->strings);
+        Resolver* resolver = create_resolver(program->arena, parser->ast);
+        resolver->resolve_globals = false;
+        gen = create_code_generator(program->arena, program->strings);
+        gen->track_relocations = true;
+        gen->resolver = resolver;
+
+        // Parse items until one starts at an old item boundary past the
+        // edit. From there the tokens are the old ones, and a newline in
+        // between keeps their columns, so the old items parse the same
+        size_t resume = first;
+        size_t stop = length;
+        while (parser->current_token.type != TOKEN_EOF) {
+            size_t start = token_source_start(&parser->current_token);
+            if (start >= new_end) {
+                size_t old_start = start - new_end + old_end;
+                while (resume < program->item_count && program->items[resume].start < old_start) {
+                    resume++;
+                }
+                if (resume < program->item_count && program->items[resume].start == old_start &&
+                    memchr(source + new_end, '\n', start - new_end)) {
+                    stop = start;
+                    break;
+                }
+            }
+
+            bool is_function = parser->current_token.type == TOKEN_DEF;
+            NodeIndex item = is_function ? parse_function_definition(parser) : parse_statement(parser);
+            resolve_item(resolver, item);
+            reset_code_generator(gen);
+            generate_item(gen, parser->ast, item);
+            add_pending(program, start, is_function, pack_unit(gen));
+        }
+        if (stop == length) {
+            resume = program->item_count;
+        }
+
+        program->relexed_bytes = stop - lex_start;
+        program->reparsed_items = program->pending_count;
+        program->reused_items = first + (program->item_count - resume);
+        reserve_items(program, first + program->pending_count + program->item_count - resume);
+        commit_source(program, source, length);
+        commit_items(program, first, resume, (ptrdiff_t)length - (ptrdiff_t)old_length);
+        program->module = link_items(program, gen, &program->module_size);
+        error_pop_handler(&handler);
+    }
+    destroy_code_generator(gen);
+    destroy_parser(parser);
+    destroy_lexer(lexer);
+
+    if (!program->module) {
+        free_units(program->pending, program->pending_count);
+        program->pending_count = 0;
+        raise_error("%s", handler.message);
+    }
+    *module_size = program->module_size;
+    return program->module;
+}
@@ -0,0 +1,47 @@
+#ifndef IBERY_INCREMENTAL_H
+#define IBERY_INCREMENTAL_H
+
+#include "codegen.h"
+#include <stdbool.h>
+#include <stddef.h>
+
+// A top-level item of a program, a function definition or a statement,
+// with its generated code as a unit for link_unit
+typedef struct {
+    size_t start;          // Source offset of the item's first token, see token_source_start
+    bool is_function;
+    CodeGenerator* unit;   // One allocation holding the unit and its arrays
+} ProgramItem;
+
+// A program compiled item by item so that a new version of its source only
+// re-lexes and re-parses the items around the edited bytes. Every other
+// item keeps the code generated for it; the module is then linked from the
+// items in program order, byte for byte what generate_code would produce
+typedef struct {
+    Arena* arena;          // Memory of one update, including its module
+    Arena* string_arena;   // Backs the interning table every unit refers to
+    InternTable* strings;
+    char* source;          // The last source compiled, NUL-terminated
+    size_t length;
+    ProgramItem* items;
+    size_t item_count;
+    size_t item_capacity;
+    ProgramItem* pending;  // Items of an update in progress, in the arena
+    size_t pending_count;
+    size_t pending_capacity;
+    uint8_t* module;       // Module of the last update, NULL after an error
+    size_t module_size;
+
+    // Work done by the last update
+    size_t relexed_bytes;
+    size_t reparsed_items;
+    size_t reused_items;
+} IncrementalProgram;
+
+// Function declarations
+IncrementalProgram* create_incremental_program(void);
+void destroy_incremental_program(IncrementalProgram* program);
+uint8_t* incremental_compile(IncrementalProgram* program, const char* source, size_t length,
+                             size_t* module_size);
+
+#endif // IBERY_INCREMENTAL_H
@@ -0,0 +1,99 @@
+#include "intern.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define INITIAL_STRINGS 256
+#define INITIAL_SLOTS 512
+
+// FNV-1a hash of a string
+static uint32_t hash_string(const char* chars, int length) {
+    uint32_t hash = 2166136261u;
+    for (int i = 0; i < length; i++) {
+        hash = (hash ^ (unsigned char)chars[i]) * 16777619u;
+    }
+    return hash;
+}
+
+// Create a new interning table
+InternTable* create_intern_table(Arena* arena) {
+    InternTable* table = (InternTable*)malloc(sizeof(InternTable));
+    if (!table) {
+        return NULL;
+    }
+
+    table->arena = arena;
+    table->strings = (InternedString*)arena_alloc(arena, INITIAL_STRINGS * sizeof(InternedString));
+    table->strings[STRING_ID_NONE] = (InternedString){ NULL, 0, 0 };
+    table->count = 1;
+    table->capacity = INITIAL_STRINGS;
+    table->slots = (StringId*)arena_alloc(arena, INITIAL_SLOTS * sizeof(StringId));
+    memset(table->slots, 0, INITIAL_SLOTS * sizeof(StringId));
+    table->slot_mask = INITIAL_SLOTS - 1;
+    return table;
+}
+
+// Destroy an interning table; the strings are released with the arena
+void destroy_intern_table(InternTable* table) {
+    if (table) {
+        free(table);
+    }
+}
+
+// Double the slot array and reinsert every id using its stored hash
+static void grow_slots(InternTable* table) {
+    int slot_count = (table->slot_mask + 1) * 2;
+    StringId* slots = (StringId*)arena_alloc(table->arena, slot_count * sizeof(StringId));
+    memset(slots, 0, slot_count * sizeof(StringId));
+
+    int mask = slot_count - 1;
+    for (int id = 1; id < table->count; id++) {
+        uint32_t index = table->strings[id].hash & mask;
+        while (slots[index] != STRING_ID_NONE) {
+            index = (index + 1) & mask;
+        }
+        slots[index] = (StringId)id;
+    }
+    table->slots = slots;
+    table->slot_mask = mask;
+}
+
+// Intern a string slice, copying it into the arena the first time it is seen
+StringId intern_string(InternTable* table, const char* chars, int length) {
+    uint32_t hash = hash_string(chars, length);
+    uint32_t index = hash & table->slot_mask;
+
+    StringId id;
+    while ((id = table->slots[index]) != STRING_ID_NONE) {
+        const InternedString* entry = &table->strings[id];
+        if (entry->hash == hash && entry->length == length &&
+            memcmp(entry->chars, chars, length) == 0) {
+            return id;
+        }
+        index = (index + 1) & table->slot_mask;
+    }
+
+    if (table->count == table->capacity) {
+        int new_capacity = table->capacity * 2;
+        table->strings = (InternedString*)arena_grow(table->arena, table->strings,
+                                                     table->capacity * sizeof(InternedString),
+                                                     new_capacity * sizeof(InternedString));
+        table->capacity = new_capacity;
+    }
+
+    id = (StringId)table->count++;
+    table->strings[id].chars = arena_strndup(table->arena, chars, length);
+    table->strings[id].length = length;
+    table->strings[id].hash = hash;
+    table->slots[index] = id;
+
+    // Keep the load factor at or below one half
+    if (table->count * 2 > table->slot_mask + 1) {
+        grow_slots(table);
+    }
+    return id;
+}
+
+// Intern a NUL-terminated string
+StringId intern_cstring(InternTable* table, const char* chars) {
+    return intern_string(table, chars, (int)strlen(chars));
+}
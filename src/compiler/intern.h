@@ -0,0 +1,46 @@
+#ifndef IBERY_INTERN_H
+#define IBERY_INTERN_H
+
+#include "arena.h"
+#include <stdint.h>
+
+// Handle for an interned string; equal strings get equal ids
+typedef uint32_t StringId;
+
+#define STRING_ID_NONE 0
+
+// An interned string; chars is NUL-terminated and lives in the arena
+typedef struct {
+    const char* chars;
+    int length;
+    uint32_t hash;
+} InternedString;
+
+// Interning table: an open-addressed hash of ids over a dense string array.
+// Hashes are stored with each string so growing never rehashes text.
+typedef struct {
+    Arena* arena;
+    InternedString* strings;  // Indexed by id; entry 0 is STRING_ID_NONE
+    int count;
+    int capacity;
+    StringId* slots;          // 0 marks an empty slot
+    int slot_mask;
+} InternTable;
+
+// Function declarations
+InternTable* create_intern_table(Arena* arena);
+void destroy_intern_table(InternTable* table);
+StringId intern_string(InternTable* table, const char* chars, int length);
+StringId intern_cstring(InternTable* table, const char* chars);
+
+// Get the text of an interned string, or NULL for STRING_ID_NONE
+static inline const char* intern_text(const InternTable* table, StringId id) {
+    return id == STRING_ID_NONE ? NULL : table->strings[id].chars;
+}
+
+// Get the length of an interned string
+static inline int intern_length(const InternTable* table, StringId id) {
+    return table->strings[id].length;
+}
+
+#endif // IBERY_INTERN_H
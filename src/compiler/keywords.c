@@ -0,0 +1,26 @@
+#include "keywords.h"
+#include <string.h>
+
+// A keyword of the perfect hash table
+typedef struct {
+    const char* keyword;
+    int length;
+    TokenType type;
+} KeywordEntry;
+
+// Generated from keywords.def by tools/gen_keywords.c
+#include "keyword_table.h"
+
+// Get the token type for an identifier: keyword type or TOKEN_IDENTIFIER
+TokenType lookup_keyword(const char* text, int length) {
+    if (length < KEYWORD_MIN_LENGTH || length > KEYWORD_MAX_LENGTH) {
+        return TOKEN_IDENTIFIER;
+    }
+
+    uint32_t slot = keyword_slot(text, length, KEYWORD_HASH_SEED, KEYWORD_HASH_BITS);
+    const KeywordEntry* entry = &keyword_entries[keyword_slots[slot]];
+    if (entry->length == length && memcmp(entry->keyword, text, length) == 0) {
+        return entry->type;
+    }
+    return TOKEN_IDENTIFIER;
+}
@@ -0,0 +1,22 @@
+#ifndef IBERY_KEYWORDS_H
+#define IBERY_KEYWORDS_H
+
+#include "lexer.h"
+#include <stdint.h>
+
+// Seeded FNV-1a hash of an identifier, mixed so its top bits select a slot
+// of a table with 2^bits entries
+static inline uint32_t keyword_slot(const char* text, int length, uint64_t seed, int bits) {
+    uint64_t hash = seed ^ (uint64_t)length;
+    for (int i = 0; i < length; i++) {
+        hash = (hash ^ (unsigned char)text[i]) * 0x100000001B3ULL;
+    }
+    hash ^= hash >> 29;
+    hash *= 0xBF58476D1CE4E5B9ULL;
+    return (uint32_t)(hash >> (64 - bits));
+}
+
+// Function declarations
+TokenType lookup_keyword(const char* text, int length);
+
+#endif // IBERY_KEYWORDS_H
@@ -1,57 +1,168 @@
 #include "lexer.h"
+#include "keywords.h"
+#include "number.h"
+#include "error.h"
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
 #include <stdio.h>
+#include <stdint.h>
 
-// Create a new lexer
-Lexer* create_lexer(const char* input) {
+#define STREAM_CHUNK_SIZE (64 * 1024)
+#define STREAM_LOW_WATER 4096
+
+// Parallel lexing: chunks are at least this large, and there are up to
+// this many per worker
+#ifndef PARALLEL_LEX_MIN_CHUNK
+#define PARALLEL_LEX_MIN_CHUNK (256 * 1024)
+#endif
+#define PARALLEL_LEX_CHUNKS_PER_WORKER 4
+
+// Create a lexer over a NUL-terminated string
+Lexer* create_lexer(const char* input, Arena* arena) {
+    return create_lexer_from_buffer(input, strlen(input), arena);
+}
+
+// Create a lexer over length bytes of input; input[length] must be '\0'
+Lexer* create_lexer_from_buffer(const char* input, size_t length, Arena* arena) {
     Lexer* lexer = (Lexer*)malloc(sizeof(Lexer));
     if (!lexer) {
         return NULL;
     }
 
     lexer->input = input;
+    lexer->length = length;
     lexer->position = 0;
-    lexer->line = 1;
-    lexer->column = 1;
+    lexer->base = 0;
+    lexer->arena = arena;
+    lexer->line_starts = NULL;
+    lexer->line_count = 0;
+    lexer->after_operand = false;
+    lexer->scanner = select_scanner();
+    lexer->reader = NULL;
+    lexer->reader_userdata = NULL;
+    lexer->window = NULL;
+    lexer->window_capacity = 0;
+    lexer->keep = 0;
+    lexer->at_end = true;
+    lexer->base_line = 0;
+    lexer->base_line_start = 0;
+    lexer->base_line_blank = true;
+    return lexer;
+}
+
+// Create a lexer that pulls its input from a reader in chunks
+Lexer* create_streaming_lexer(LexerReader reader, void* userdata, Arena* arena) {
+    char* window = (char*)malloc(STREAM_CHUNK_SIZE);
+    if (!window) {
+        return NULL;
+    }
+    window[0] = '\0';
+
+    Lexer* lexer = create_lexer_from_buffer(window, 0, arena);
+    if (!lexer) {
+        free(window);
+        return NULL;
+    }
+    lexer->reader = reader;
+    lexer->reader_userdata = userdata;
+    lexer->window = window;
+    lexer->window_capacity = STREAM_CHUNK_SIZE;
+    lexer->at_end = false;
     return lexer;
 }
 
 // Destroy a lexer
 void destroy_lexer(Lexer* lexer) {
     if (lexer) {
+        free(lexer->window);
         free(lexer);
     }
 }
 
-// Create a new token
-static Token* create_token(TokenType type, const char* value, int line, int column) {
-    Token* token = (Token*)malloc(sizeof(Token));
-    if (!token) {
-        return NULL;
+// Append at least one byte of streamed input to the window, or note the
+// end of the input
+static void refill(Lexer* lexer) {
+    if (lexer->at_end) {
+        return;
+    }
+    if (lexer->length + 1 == lexer->window_capacity) {
+        // A single token fills the window
+        size_t new_capacity = lexer->window_capacity * 2;
+        char* window = (char*)realloc(lexer->window, new_capacity);
+        if (!window) {
+            raise_error("Failed to grow the lexer window to %zu bytes", new_capacity);
+        }
+        lexer->window = window;
+        lexer->window_capacity = new_capacity;
+        lexer->input = window;
     }
 
-    token->type = type;
-    token->value = value ? strdup(value) : NULL;
-    token->line = line;
-    token->column = column;
-    return token;
+    size_t space = lexer->window_capacity - lexer->length - 1;
+    size_t read = lexer->reader(lexer->reader_userdata, lexer->window + lexer->length, space);
+    if (read == 0) {
+        lexer->at_end = true;
+    }
+    lexer->length += read;
+    lexer->window[lexer->length] = '\0';
 }
 
-// Destroy a token
-void destroy_token(Token* token) {
-    if (token) {
-        if (token->value) {
-            free(token->value);
+// Drop the window before the last significant token and top it up; only
+// called between tokens, so no reader holds a window offset
+static void slide_window(Lexer* lexer) {
+    size_t discard = lexer->keep;
+    if (discard > 0) {
+        const char* text = lexer->window;
+        for (size_t i = 0; i < discard; i++) {
+            if (text[i] == '\n') {
+                lexer->base_line++;
+                lexer->base_line_start = lexer->base + i + 1;
+                lexer->base_line_blank = true;
+            } else if (text[i] != ' ' && text[i] != '\t' && text[i] != '\r') {
+                lexer->base_line_blank = false;
+            }
         }
-        free(token);
+        memmove(lexer->window, lexer->window + discard, lexer->length - discard + 1);
+        lexer->base += discard;
+        lexer->length -= discard;
+        lexer->position -= discard;
+        lexer->keep = 0;
+    }
+    while (!lexer->at_end && lexer->window_capacity - lexer->length - 1 >= STREAM_LOW_WATER) {
+        refill(lexer);
+    }
+}
+
+// Create a token covering source bytes [start, start + length)
+static Token create_token(TokenType type, size_t start, size_t length) {
+    Token token;
+    token.type = type;
+    token.length = (uint32_t)length;
+    token.start = start;
+    token.number.integer = 0;
+    return token;
+}
+
+// Report an error at a window offset and stop
+__attribute__((noreturn))
+static void lexer_error(Lexer* lexer, size_t position, const char* message) {
+    size_t line, column;
+    lexer_location(lexer, lexer->base + position, &line, &column);
+    raise_error("%s at line %zu, column %zu", message, line, column);
+}
+
+// Create a token from a window offset to the current position; a token
+// is at most UINT32_MAX bytes long
+static Token make_token(Lexer* lexer, TokenType type, size_t start) {
+    if (lexer->position - start > UINT32_MAX) {
+        lexer_error(lexer, start, "Token too long");
     }
+    return create_token(type, lexer->base + start, lexer->position - start);
 }
 
-// Check if a character is whitespace
-static bool is_whitespace(char c) {
-    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+// Copy a token's text into the arena as a NUL-terminated string
+char* token_materialize(Lexer* lexer, const Token* token) {
+    return arena_strndup(lexer->arena, lexer_text(lexer, token->start), token->length);
 }
 
 // Check if a character is a digit
@@ -64,57 +175,164 @@ static bool is_alpha(char c) {
     return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_';
 }
 
-// Check if a character is alphanumeric
-static bool is_alphanumeric(char c) {
-    return is_alpha(c) || is_digit(c);
-}
-
 // Get the current character
 static char peek(Lexer* lexer) {
-    return lexer->input[lexer->position] ? lexer->input[lexer->position] : '\0';
+    char c = lexer->input[lexer->position];
+    if (c == '\0' && lexer->position == lexer->length && !lexer->at_end) {
+        refill(lexer);
+        c = lexer->input[lexer->position];
+    }
+    return c;
+}
+
+// Get the character after the current one
+static char peek_next(Lexer* lexer) {
+    if (peek(lexer) == '\0') {
+        return '\0';
+    }
+    if (lexer->position + 1 == lexer->length && !lexer->at_end) {
+        refill(lexer);
+    }
+    return lexer->input[lexer->position + 1];
 }
 
 // Advance to the next character
 static char advance(Lexer* lexer) {
     char c = peek(lexer);
     lexer->position++;
-    if (c == '\n') {
-        lexer->line++;
-        lexer->column = 1;
-    } else {
-        lexer->column++;
-    }
     return c;
 }
 
+// Advance over a run of characters of one class in bulk
+static void advance_run(Lexer* lexer, ScanClass cls) {
+    for (;;) {
+        lexer->position += lexer->scanner->scan[cls](lexer->input + lexer->position,
+                                                     lexer->length - lexer->position);
+        if (lexer->position < lexer->length || lexer->at_end) {
+            return;
+        }
+        refill(lexer);
+    }
+}
+
+// Build the table of line start offsets
+static void build_line_table(Lexer* lexer) {
+    size_t capacity = 64;
+    size_t count = 0;
+    size_t* starts = (size_t*)arena_alloc(lexer->arena, capacity * sizeof(size_t));
+    starts[count++] = 0;
+
+    const char* input = lexer->input;
+    const char* end = input + lexer->length;
+    const char* newline = input;
+    while ((newline = memchr(newline, '\n', end - newline)) != NULL) {
+        newline++;
+        if (count == capacity) {
+            starts = (size_t*)arena_grow(lexer->arena, starts,
+                                         capacity * sizeof(size_t), capacity * 2 * sizeof(size_t));
+            capacity *= 2;
+        }
+        starts[count++] = (size_t)(newline - input);
+    }
+
+    lexer->line_starts = starts;
+    lexer->line_count = count;
+}
+
+// Get the 1-based line and column of a source offset
+void lexer_location(Lexer* lexer, size_t offset, size_t* line, size_t* column) {
+    if (lexer->reader) {
+        // Only the window is available: count its newlines on top of the
+        // ones already dropped
+        size_t newlines = lexer->base_line;
+        const char* text = lexer->input;
+        for (size_t i = 0; i < offset - lexer->base; i++) {
+            newlines += text[i] == '\n';
+        }
+        *line = newlines + 1;
+        *column = lexer_column(lexer, offset);
+        return;
+    }
+
+    if (!lexer->line_starts) {
+        build_line_table(lexer);
+    }
+
+    // Find the last line starting at or before offset
+    size_t low = 0;
+    size_t high = lexer->line_count - 1;
+    while (low < high) {
+        size_t mid = low + (high - low + 1) / 2;
+        if (lexer->line_starts[mid] <= offset) {
+            low = mid;
+        } else {
+            high = mid - 1;
+        }
+    }
+    *line = low + 1;
+    *column = offset - lexer->line_starts[low] + 1;
+}
+
+// Get the 1-based column of a source offset by scanning back to its line
+// start; cheaper than lexer_location when only the indentation matters
+size_t lexer_column(const Lexer* lexer, size_t offset) {
+    size_t start = offset - lexer->base;
+    while (start > 0 && lexer->input[start - 1] != '\n') {
+        start--;
+    }
+    size_t line_start = start > 0 ? lexer->base + start : lexer->base_line_start;
+    return offset - line_start + 1;
+}
+
+// Check if only blanks precede offset on its line; for a streaming lexer
+// the offset must be at or after the last significant token
+bool lexer_at_line_start(const Lexer* lexer, size_t offset) {
+    size_t start = offset - lexer->base;
+    while (start > 0 && (lexer->input[start - 1] == ' ' || lexer->input[start - 1] == '\t' ||
+                         lexer->input[start - 1] == '\r')) {
+        start--;
+    }
+    return start > 0 ? lexer->input[start - 1] == '\n' : lexer->base_line_blank;
+}
+
 // Skip whitespace
 static void skip_whitespace(Lexer* lexer) {
-    while (is_whitespace(peek(lexer))) {
-        advance(lexer);
-    }
+    advance_run(lexer, SCAN_WHITESPACE);
 }
 
-// Read a number
-static char* read_number(Lexer* lexer) {
-    int start = lexer->position;
+// Read a number and convert its value. A decimal literal with a fraction
+// or an exponent is a TOKEN_FLOAT; hex, octal and binary literals are
+// integers only and may use all 64 bits. A trailing 'n' makes a
+// TOKEN_BIGINT, which keeps no value
+static Token read_number(Lexer* lexer) {
+    size_t start = lexer->position;
+    size_t digits = start;  // After a radix prefix
     TokenType type = TOKEN_NUMBER;
+    int base = 10;
+    bool real = false;
     
     if (peek(lexer) == '0') {
         advance(lexer);
         if (peek(lexer) == 'x' || peek(lexer) == 'X') {
             advance(lexer);
             type = TOKEN_HEX;
+            base = 16;
+            digits = lexer->position;
             while (isxdigit(peek(lexer))) {
                 advance(lexer);
             }
         } else if (peek(lexer) == 'b' || peek(lexer) == 'B') {
             advance(lexer);
             type = TOKEN_BINARY;
+            base = 2;
+            digits = lexer->position;
             while (peek(lexer) == '0' || peek(lexer) == '1') {
                 advance(lexer);
             }
         } else if (isdigit(peek(lexer))) {
             type = TOKEN_OCTAL;
+            base = 8;
+            digits = lexer->position;
             while (isdigit(peek(lexer)) && peek(lexer) < '8') {
                 advance(lexer);
             }
@@ -127,6 +345,7 @@ static char* read_number(Lexer* lexer) {
     
     if (peek(lexer) == '.') {
         advance(lexer);
+        real = true;
         while (isdigit(peek(lexer))) {
             advance(lexer);
         }
@@ -134,6 +353,7 @@ static char* read_number(Lexer* lexer) {
     
     if (peek(lexer) == 'e' || peek(lexer) == 'E') {
         advance(lexer);
+        real = true;
         if (peek(lexer) == '+' || peek(lexer) == '-') {
             advance(lexer);
         }
@@ -144,259 +364,93 @@ static char* read_number(Lexer* lexer) {
     
     if (peek(lexer) == 'n') {
         advance(lexer);
-        type = TOKEN_BIGINT;
+        return make_token(lexer, TOKEN_BIGINT, start);
     }
     
-    int length = lexer->position - start;
-    char* number = (char*)malloc(length + 1);
-    strncpy(number, lexer->input + start, length);
-    number[length] = '\0';
-    
-    return create_token(type, number, lexer->line, lexer->column);
+    Token token = make_token(lexer, type, start);
+    if (real) {
+        if (type != TOKEN_NUMBER ||
+            !parse_double(lexer->input + start, lexer->position - start, &token.number.real)) {
+            lexer_error(lexer, start, "Malformed number literal");
+        }
+        token.type = TOKEN_FLOAT;
+        return token;
+    }
+    uint64_t value;
+    if (lexer->position == digits) {
+        lexer_error(lexer, start, "Malformed number literal");
+    }
+    if (!parse_integer(lexer->input + digits, lexer->position - digits, base, &value) ||
+        (base == 10 && value > INT64_MAX)) {
+        lexer_error(lexer, start, "Integer literal out of range");
+    }
+    token.number.integer = (int64_t)value;
+    return token;
 }
 
 // Read an identifier
-static char* read_identifier(Lexer* lexer) {
-    int start = lexer->position;
-    while (is_alphanumeric(peek(lexer))) {
-        advance(lexer);
-    }
-    int length = lexer->position - start;
-    char* identifier = (char*)malloc(length + 1);
-    strncpy(identifier, lexer->input + start, length);
-    identifier[length] = '\0';
-    return identifier;
+static Token read_identifier(Lexer* lexer) {
+    size_t start = lexer->position;
+    advance_run(lexer, SCAN_IDENTIFIER);
+    return make_token(lexer, TOKEN_IDENTIFIER, start);
 }
 
 // Read a string
-static char* read_string(Lexer* lexer) {
+static Token read_string(Lexer* lexer) {
     advance(lexer); // Skip opening quote
-    int start = lexer->position;
+    size_t start = lexer->position;
     
-    while (peek(lexer) != '"' && peek(lexer) != '\0') {
-        advance(lexer);
-    }
+    advance_run(lexer, SCAN_STRING_BODY);
     
     if (peek(lexer) == '\0') {
-        fprintf(stderr, "Unterminated string at line %d, column %d\n", 
-                lexer->line, lexer->column);
-        exit(1);
+        lexer_error(lexer, start - 1, "Unterminated string");
     }
     
-    int length = lexer->position - start;
-    char* str = (char*)malloc(length + 1);
-    strncpy(str, lexer->input + start, length);
-    str[length] = '\0';
-    
+    Token token = make_token(lexer, TOKEN_STRING, start);
     advance(lexer); // Skip closing quote
-    return str;
+    return token;
 }
 
 // Read a comment
 static void read_comment(Lexer* lexer) {
-    while (peek(lexer) != '\n' && peek(lexer) != '\0') {
-        advance(lexer);
-    }
+    advance_run(lexer, SCAN_LINE_COMMENT);
 }
 
-// Get the token type for a keyword
-static TokenType get_keyword_token_type(const char* identifier) {
-    static const struct {
-        const char* keyword;
-        TokenType type;
-    } keywords[] = {
-        {"def", TOKEN_DEF},
-        {"run", TOKEN_RUN},
-        {"quantum", TOKEN_QUANTUM},
-        {"print", TOKEN_PRINT},
-        {"return", TOKEN_RETURN},
-        {"hoist", TOKEN_HOIST},
-        {"surge", TOKEN_SURGE},
-        {"domain", TOKEN_DOMAIN},
-        {"import", TOKEN_IMPORT},
-        {"export", TOKEN_EXPORT},
-        {"async", TOKEN_ASYNC},
-        {"await", TOKEN_AWAIT},
-        {"stream", TOKEN_STREAM},
-        {"class", TOKEN_CLASS},
-        {"interface", TOKEN_INTERFACE},
-        {"implements", TOKEN_IMPLEMENTS},
-        {"extends", TOKEN_EXTENDS},
-        {"public", TOKEN_PUBLIC},
-        {"private", TOKEN_PRIVATE},
-        {"protected", TOKEN_PROTECTED},
-        {"static", TOKEN_STATIC},
-        {"final", TOKEN_FINAL},
-        {"abstract", TOKEN_ABSTRACT},
-        {"virtual", TOKEN_VIRTUAL},
-        {"override", TOKEN_OVERRIDE},
-        {"new", TOKEN_NEW},
-        {"this", TOKEN_THIS},
-        {"super", TOKEN_SUPER},
-        {"instanceof", TOKEN_INSTANCEOF},
-        {"typeof", TOKEN_TYPEOF},
-        {"delete", TOKEN_DELETE},
-        {"in", TOKEN_IN},
-        {"of", TOKEN_OF},
-        {"yield", TOKEN_YIELD},
-        {"generator", TOKEN_GENERATOR},
-        {"try", TOKEN_TRY},
-        {"catch", TOKEN_CATCH},
-        {"finally", TOKEN_FINALLY},
-        {"throw", TOKEN_THROW},
-        {"raise", TOKEN_RAISE},
-        {"with", TOKEN_WITH},
-        {"switch", TOKEN_SWITCH},
-        {"case", TOKEN_CASE},
-        {"default", TOKEN_DEFAULT},
-        {"break", TOKEN_BREAK},
-        {"continue", TOKEN_CONTINUE},
-        {"if", TOKEN_IF},
-        {"else", TOKEN_ELSE},
-        {"elif", TOKEN_ELIF},
-        {"while", TOKEN_WHILE},
-        {"do", TOKEN_DO},
-        {"for", TOKEN_FOR},
-        {"foreach", TOKEN_FOREACH},
-        {"match", TOKEN_MATCH},
-        {"when", TOKEN_WHEN},
-        {"where", TOKEN_WHERE},
-        {"let", TOKEN_LET},
-        {"const", TOKEN_CONST},
-        {"var", TOKEN_VAR},
-        {"type", TOKEN_TYPE},
-        {"enum", TOKEN_ENUM},
-        {"union", TOKEN_UNION},
-        {"intersection", TOKEN_INTERSECTION},
-        {"namespace", TOKEN_NAMESPACE},
-        {"using", TOKEN_USING},
-        {"as", TOKEN_AS},
-        {"is", TOKEN_IS},
-        {"null", TOKEN_NULL},
-        {"undefined", TOKEN_UNDEFINED},
-        {"true", TOKEN_TRUE},
-        {"false", TOKEN_FALSE},
-        {"infinity", TOKEN_INFINITY},
-        {"nan", TOKEN_NAN},
-        
-        // AI and API Integration
-        {"ai", TOKEN_AI},
-        {"apiKey", TOKEN_API_KEY},
-        {"openai", TOKEN_OPENAI},
-        {"model", TOKEN_MODEL},
-        {"prompt", TOKEN_PROMPT},
-        {"completion", TOKEN_COMPLETION},
-        {"temperature", TOKEN_TEMPERATURE},
-        {"maxTokens", TOKEN_MAX_TOKENS},
-        {"response", TOKEN_RESPONSE},
-        {"context", TOKEN_CONTEXT},
-        {"system", TOKEN_SYSTEM},
-        {"user", TOKEN_USER},
-        {"assistant", TOKEN_ASSISTANT},
-        
-        // Server and API
-        {"server", TOKEN_SERVER},
-        {"route", TOKEN_ROUTE},
-        {"get", TOKEN_GET},
-        {"post", TOKEN_POST},
-        {"put", TOKEN_PUT},
-        {"patch", TOKEN_PATCH},
-        {"options", TOKEN_OPTIONS},
-        {"head", TOKEN_HEAD},
-        {"middleware", TOKEN_MIDDLEWARE},
-        {"request", TOKEN_REQUEST},
-        {"params", TOKEN_PARAMS},
-        {"query", TOKEN_QUERY},
-        {"body", TOKEN_BODY},
-        {"headers", TOKEN_HEADERS},
-        {"cookies", TOKEN_COOKIES},
-        {"session", TOKEN_SESSION},
-        {"auth", TOKEN_AUTH},
-        {"jwt", TOKEN_JWT},
-        {"bearer", TOKEN_BEARER},
-        {"cors", TOKEN_CORS},
-        {"port", TOKEN_PORT},
-        {"host", TOKEN_HOST},
-        {"database", TOKEN_DATABASE},
-        {"connect", TOKEN_CONNECT},
-        {"disconnect", TOKEN_DISCONNECT},
-        {"websocket", TOKEN_WEBSOCKET},
-        {"socket", TOKEN_SOCKET},
-        {"emit", TOKEN_EMIT},
-        {"on", TOKEN_ON},
-        {"off", TOKEN_OFF},
-        
-        // Styling and UI
-        {"style", TOKEN_STYLE},
-        {"css", TOKEN_CSS},
-        {"html", TOKEN_HTML},
-        {"component", TOKEN_COMPONENT},
-        {"template", TOKEN_TEMPLATE},
-        {"layout", TOKEN_LAYOUT},
-        {"view", TOKEN_VIEW},
-        {"page", TOKEN_PAGE},
-        {"section", TOKEN_SECTION},
-        {"div", TOKEN_DIV},
-        {"span", TOKEN_SPAN},
-        {"color", TOKEN_COLOR},
-        {"background", TOKEN_BACKGROUND},
-        {"font", TOKEN_FONT},
-        {"size", TOKEN_SIZE},
-        {"margin", TOKEN_MARGIN},
-        {"padding", TOKEN_PADDING},
-        {"border", TOKEN_BORDER},
-        {"flex", TOKEN_FLEX},
-        {"grid", TOKEN_GRID},
-        {"align", TOKEN_ALIGN},
-        {"justify", TOKEN_JUSTIFY},
-        {"width", TOKEN_WIDTH},
-        {"height", TOKEN_HEIGHT},
-        {"position", TOKEN_POSITION},
-        {"animation", TOKEN_ANIMATION},
-        {"transition", TOKEN_TRANSITION},
-        {"media", TOKEN_MEDIA},
-        {"responsive", TOKEN_RESPONSIVE},
-        {"theme", TOKEN_THEME},
-        {"dark", TOKEN_DARK},
-        {"light", TOKEN_LIGHT},
-        
-        // AI Lab Integration
-        {"lab", TOKEN_LAB},
-        {"experiment", TOKEN_EXPERIMENT},
-        {"dataset", TOKEN_DATASET},
-        {"train", TOKEN_TRAIN},
-        {"test", TOKEN_TEST},
-        {"validate", TOKEN_VALIDATE},
-        {"metrics", TOKEN_METRICS},
-        {"accuracy", TOKEN_ACCURACY},
-        {"loss", TOKEN_LOSS},
-        {"epoch", TOKEN_EPOCH},
-        {"batch", TOKEN_BATCH},
-        {"learningRate", TOKEN_LEARNING_RATE},
-        {"optimizer", TOKEN_OPTIMIZER},
-        {"checkpoint", TOKEN_CHECKPOINT},
-        {"save", TOKEN_SAVE},
-        {"load", TOKEN_LOAD},
-        {"exportModel", TOKEN_EXPORT_MODEL},
-        {"importModel", TOKEN_IMPORT_MODEL},
-        {"predict", TOKEN_PREDICT},
-        {"inference", TOKEN_INFERENCE},
-        
-        {NULL, TOKEN_IDENTIFIER}
-    };
-
-    for (int i = 0; keywords[i].keyword; i++) {
-        if (strcmp(identifier, keywords[i].keyword) == 0) {
-            return keywords[i].type;
-        }
+// Check if a token can end an operand, after which a slash divides
+// rather than starting a regex
+static bool token_ends_operand(TokenType type) {
+    switch (type) {
+        case TOKEN_IDENTIFIER:
+        case TOKEN_NUMBER:
+        case TOKEN_FLOAT:
+        case TOKEN_BIGINT:
+        case TOKEN_HEX:
+        case TOKEN_OCTAL:
+        case TOKEN_BINARY:
+        case TOKEN_STRING:
+        case TOKEN_CHAR:
+        case TOKEN_REGEX:
+        case TOKEN_TEMPLATE_STRING:
+        case TOKEN_NULL:
+        case TOKEN_UNDEFINED:
+        case TOKEN_TRUE:
+        case TOKEN_FALSE:
+        case TOKEN_INFINITY:
+        case TOKEN_NAN:
+        case TOKEN_THIS:
+        case TOKEN_SUPER:
+        case TOKEN_RIGHT_PAREN:
+        case TOKEN_RIGHT_BRACKET:
+            return true;
+        default:
+            return false;
     }
-    return TOKEN_IDENTIFIER;
 }
 
 // Read a regex pattern
-static char* read_regex(Lexer* lexer) {
+static Token read_regex(Lexer* lexer) {
     advance(lexer); // Skip opening slash
-    int start = lexer->position;
+    size_t start = lexer->position;
     
     while (peek(lexer) != '/' && peek(lexer) != '\0') {
         if (peek(lexer) == '\\') {
@@ -406,24 +460,18 @@ static char* read_regex(Lexer* lexer) {
     }
     
     if (peek(lexer) == '\0') {
-        fprintf(stderr, "Unterminated regex at line %d, column %d\n", 
-                lexer->line, lexer->column);
-        exit(1);
+        lexer_error(lexer, start - 1, "Unterminated regex");
     }
     
-    int length = lexer->position - start;
-    char* regex = (char*)malloc(length + 1);
-    strncpy(regex, lexer->input + start, length);
-    regex[length] = '\0';
-    
+    Token token = make_token(lexer, TOKEN_REGEX, start);
     advance(lexer); // Skip closing slash
-    return regex;
+    return token;
 }
 
 // Read a template string
-static char* read_template_string(Lexer* lexer) {
+static Token read_template_string(Lexer* lexer) {
     advance(lexer); // Skip opening backtick
-    int start = lexer->position;
+    size_t start = lexer->position;
     
     while (peek(lexer) != '`' && peek(lexer) != '\0') {
         if (peek(lexer) == '\\') {
@@ -433,24 +481,18 @@ static char* read_template_string(Lexer* lexer) {
     }
     
     if (peek(lexer) == '\0') {
-        fprintf(stderr, "Unterminated template string at line %d, column %d\n", 
-                lexer->line, lexer->column);
-        exit(1);
+        lexer_error(lexer, start - 1, "Unterminated template string");
     }
     
-    int length = lexer->position - start;
-    char* template = (char*)malloc(length + 1);
-    strncpy(template, lexer->input + start, length);
-    template[length] = '\0';
-    
+    Token token = make_token(lexer, TOKEN_TEMPLATE_STRING, start);
     advance(lexer); // Skip closing backtick
-    return template;
+    return token;
 }
 
 // Read a character literal
-static char* read_char(Lexer* lexer) {
+static Token read_char(Lexer* lexer) {
     advance(lexer); // Skip opening quote
-    int start = lexer->position;
+    size_t start = lexer->position;
     
     if (peek(lexer) == '\\') {
         advance(lexer); // Skip escape character
@@ -458,51 +500,44 @@ static char* read_char(Lexer* lexer) {
     advance(lexer);
     
     if (peek(lexer) != '\'') {
-        fprintf(stderr, "Unterminated character literal at line %d, column %d\n", 
-                lexer->line, lexer->column);
-        exit(1);
+        lexer_error(lexer, start - 1, "Unterminated character literal");
     }
     
-    int length = lexer->position - start;
-    char* ch = (char*)malloc(length + 1);
-    strncpy(ch, lexer->input + start, length);
-    ch[length] = '\0';
-    
+    Token token = make_token(lexer, TOKEN_CHAR, start);
     advance(lexer); // Skip closing quote
-    return create_token(TOKEN_CHAR, ch, lexer->line, lexer->column);
+    return token;
 }
 
 // Read a multiline comment
 static void read_multiline_comment(Lexer* lexer) {
+    size_t start = lexer->position;
     advance(lexer); // Skip opening #
     advance(lexer); // Skip opening [
     
     while (peek(lexer) != '\0') {
+        advance_run(lexer, SCAN_BLOCK_COMMENT);
         if (peek(lexer) == ']' && peek_next(lexer) == '#') {
             advance(lexer);
             advance(lexer);
             return;
         }
-        advance(lexer);
+        if (peek(lexer) != '\0') {
+            advance(lexer);
+        }
     }
     
-    fprintf(stderr, "Unterminated multiline comment at line %d, column %d\n", 
-            lexer->line, lexer->column);
-    exit(1);
+    lexer_error(lexer, start, "Unterminated multiline comment");
 }
 
-// Get the next token
-Token* get_next_token(Lexer* lexer) {
-    skip_whitespace(lexer);
+// Scan the token at the current position; whitespace is already skipped
+static Token scan_token(Lexer* lexer) {
+    char c = peek(lexer);
+    size_t start = lexer->position;
 
-    if (peek(lexer) == '\0') {
-        return create_token(TOKEN_EOF, NULL, lexer->line, lexer->column);
+    if (c == '\0') {
+        return create_token(TOKEN_EOF, lexer->base + start, 0);
     }
 
-    char c = peek(lexer);
-    int line = lexer->line;
-    int column = lexer->column;
-
     // Handle numbers
     if (is_digit(c)) {
         return read_number(lexer);
@@ -510,9 +545,9 @@ Token* get_next_token(Lexer* lexer) {
 
     // Handle identifiers and keywords
     if (is_alpha(c)) {
-        char* identifier = read_identifier(lexer);
-        TokenType type = get_keyword_token_type(identifier);
-        return create_token(type, identifier, line, column);
+        Token token = read_identifier(lexer);
+        token.type = lookup_keyword(lexer_text(lexer, token.start), token.length);
+        return token;
     }
 
     // Handle strings
@@ -520,34 +555,37 @@ Token* get_next_token(Lexer* lexer) {
         if (c == '\'') {
             return read_char(lexer);
         }
-        char* str = read_string(lexer);
-        return create_token(TOKEN_STRING, str, line, column);
+        return read_string(lexer);
+    }
+
+    // Handle line comments
+    if (c == '/' && peek_next(lexer) == '/') {
+        read_comment(lexer);
+        return make_token(lexer, TOKEN_COMMENT, start);
     }
 
-    // Handle regex patterns
-    if (c == '/') {
-        char* regex = read_regex(lexer);
-        return create_token(TOKEN_REGEX, regex, line, column);
+    // Handle regex patterns; a slash after an operand is division
+    if (c == '/' && !lexer->after_operand) {
+        return read_regex(lexer);
     }
 
     // Handle template strings
     if (c == '`') {
-        char* template = read_template_string(lexer);
-        return create_token(TOKEN_TEMPLATE_STRING, template, line, column);
+        return read_template_string(lexer);
     }
 
     // Handle comments
     if (c == '#') {
         if (peek_next(lexer) == '[') {
             read_multiline_comment(lexer);
-            return create_token(TOKEN_MULTILINE_COMMENT, NULL, line, column);
+            return make_token(lexer, TOKEN_MULTILINE_COMMENT, start);
         } else if (peek_next(lexer) == '#') {
             advance(lexer);
             read_comment(lexer);
-            return create_token(TOKEN_DOC_COMMENT, NULL, line, column);
+            return make_token(lexer, TOKEN_DOC_COMMENT, start);
         }
         read_comment(lexer);
-        return create_token(TOKEN_COMMENT, NULL, line, column);
+        return make_token(lexer, TOKEN_COMMENT, start);
     }
 
     // Handle operators and punctuation
@@ -556,53 +594,53 @@ Token* get_next_token(Lexer* lexer) {
             advance(lexer);
             if (peek(lexer) == '=') {
                 advance(lexer);
-                return create_token(TOKEN_PLUS_EQUALS, "+=", line, column);
+                return make_token(lexer, TOKEN_PLUS_EQUALS, start);
             } else if (peek(lexer) == '+') {
                 advance(lexer);
-                return create_token(TOKEN_INCREMENT, "++", line, column);
+                return make_token(lexer, TOKEN_INCREMENT, start);
             }
-            return create_token(TOKEN_PLUS, "+", line, column);
+            return make_token(lexer, TOKEN_PLUS, start);
             
         case '-':
             advance(lexer);
             if (peek(lexer) == '=') {
                 advance(lexer);
-                return create_token(TOKEN_MINUS_EQUALS, "-=", line, column);
+                return make_token(lexer, TOKEN_MINUS_EQUALS, start);
             } else if (peek(lexer) == '-') {
                 advance(lexer);
-                return create_token(TOKEN_DECREMENT, "--", line, column);
+                return make_token(lexer, TOKEN_DECREMENT, start);
             } else if (peek(lexer) == '>') {
                 advance(lexer);
                 if (peek(lexer) == '>') {
                     advance(lexer);
-                    return create_token(TOKEN_DOUBLE_ARROW, "->>", line, column);
+                    return make_token(lexer, TOKEN_DOUBLE_ARROW, start);
                 }
-                return create_token(TOKEN_ARROW, "->", line, column);
+                return make_token(lexer, TOKEN_ARROW, start);
             }
-            return create_token(TOKEN_MINUS, "-", line, column);
+            return make_token(lexer, TOKEN_MINUS, start);
             
         case '*':
             advance(lexer);
             if (peek(lexer) == '=') {
                 advance(lexer);
-                return create_token(TOKEN_MULTIPLY_EQUALS, "*=", line, column);
+                return make_token(lexer, TOKEN_MULTIPLY_EQUALS, start);
             } else if (peek(lexer) == '*') {
                 advance(lexer);
-                return create_token(TOKEN_POWER, "**", line, column);
+                return make_token(lexer, TOKEN_POWER, start);
             }
-            return create_token(TOKEN_MULTIPLY, "*", line, column);
+            return make_token(lexer, TOKEN_MULTIPLY, start);
             
         case '/':
             advance(lexer);
             if (peek(lexer) == '=') {
                 advance(lexer);
-                return create_token(TOKEN_DIVIDE_EQUALS, "/=", line, column);
+                return make_token(lexer, TOKEN_DIVIDE_EQUALS, start);
             }
-            return create_token(TOKEN_DIVIDE, "/", line, column);
+            return make_token(lexer, TOKEN_DIVIDE, start);
             
         case '%':
             advance(lexer);
-            return create_token(TOKEN_MODULO, "%", line, column);
+            return make_token(lexer, TOKEN_MODULO, start);
             
         case '=':
             advance(lexer);
@@ -610,11 +648,11 @@ Token* get_next_token(Lexer* lexer) {
                 advance(lexer);
                 if (peek(lexer) == '=') {
                     advance(lexer);
-                    return create_token(TOKEN_EQUAL_EQUAL_EQUAL, "===", line, column);
+                    return make_token(lexer, TOKEN_EQUAL_EQUAL_EQUAL, start);
                 }
-                return create_token(TOKEN_EQUAL_EQUAL, "==", line, column);
+                return make_token(lexer, TOKEN_EQUAL_EQUAL, start);
             }
-            return create_token(TOKEN_EQUALS, "=", line, column);
+            return make_token(lexer, TOKEN_EQUALS, start);
             
         case '!':
             advance(lexer);
@@ -622,75 +660,75 @@ Token* get_next_token(Lexer* lexer) {
                 advance(lexer);
                 if (peek(lexer) == '=') {
                     advance(lexer);
-                    return create_token(TOKEN_NOT_EQUAL_EQUAL, "!==", line, column);
+                    return make_token(lexer, TOKEN_NOT_EQUAL_EQUAL, start);
                 }
-                return create_token(TOKEN_NOT_EQUAL, "!=", line, column);
+                return make_token(lexer, TOKEN_NOT_EQUAL, start);
             }
-            return create_token(TOKEN_NOT, "!", line, column);
+            return make_token(lexer, TOKEN_NOT, start);
             
         case '>':
             advance(lexer);
             if (peek(lexer) == '=') {
                 advance(lexer);
-                return create_token(TOKEN_GREATER_EQUAL, ">=", line, column);
+                return make_token(lexer, TOKEN_GREATER_EQUAL, start);
             } else if (peek(lexer) == '>') {
                 advance(lexer);
                 if (peek(lexer) == '>') {
                     advance(lexer);
-                    return create_token(TOKEN_UNSIGNED_RIGHT_SHIFT, ">>>", line, column);
+                    return make_token(lexer, TOKEN_UNSIGNED_RIGHT_SHIFT, start);
                 }
-                return create_token(TOKEN_RIGHT_SHIFT, ">>", line, column);
+                return make_token(lexer, TOKEN_RIGHT_SHIFT, start);
             }
-            return create_token(TOKEN_GREATER, ">", line, column);
+            return make_token(lexer, TOKEN_GREATER, start);
             
         case '<':
             advance(lexer);
             if (peek(lexer) == '=') {
                 advance(lexer);
-                return create_token(TOKEN_LESS_EQUAL, "<=", line, column);
+                return make_token(lexer, TOKEN_LESS_EQUAL, start);
             } else if (peek(lexer) == '<') {
                 advance(lexer);
-                return create_token(TOKEN_LEFT_SHIFT, "<<", line, column);
+                return make_token(lexer, TOKEN_LEFT_SHIFT, start);
             }
-            return create_token(TOKEN_LESS, "<", line, column);
+            return make_token(lexer, TOKEN_LESS, start);
             
         case '&':
             advance(lexer);
             if (peek(lexer) == '&') {
                 advance(lexer);
-                return create_token(TOKEN_AND, "&&", line, column);
+                return make_token(lexer, TOKEN_AND, start);
             }
-            return create_token(TOKEN_BITWISE_AND, "&", line, column);
+            return make_token(lexer, TOKEN_BITWISE_AND, start);
             
         case '|':
             advance(lexer);
             if (peek(lexer) == '|') {
                 advance(lexer);
-                return create_token(TOKEN_OR, "||", line, column);
+                return make_token(lexer, TOKEN_OR, start);
             } else if (peek(lexer) == '>') {
                 advance(lexer);
-                return create_token(TOKEN_PIPE, "|>", line, column);
+                return make_token(lexer, TOKEN_PIPE, start);
             }
-            return create_token(TOKEN_BITWISE_OR, "|", line, column);
+            return make_token(lexer, TOKEN_BITWISE_OR, start);
             
         case '^':
             advance(lexer);
-            return create_token(TOKEN_BITWISE_XOR, "^", line, column);
+            return make_token(lexer, TOKEN_BITWISE_XOR, start);
             
         case '~':
             advance(lexer);
-            return create_token(TOKEN_BITWISE_NOT, "~", line, column);
+            return make_token(lexer, TOKEN_BITWISE_NOT, start);
             
         case '?':
             advance(lexer);
             if (peek(lexer) == '?') {
                 advance(lexer);
-                return create_token(TOKEN_NULLISH_COALESCING, "??", line, column);
+                return make_token(lexer, TOKEN_NULLISH_COALESCING, start);
             } else if (peek(lexer) == '.') {
                 advance(lexer);
-                return create_token(TOKEN_OPTIONAL_CHAINING, "?.", line, column);
+                return make_token(lexer, TOKEN_OPTIONAL_CHAINING, start);
             }
-            return create_token(TOKEN_QUESTION, "?", line, column);
+            return make_token(lexer, TOKEN_QUESTION, start);
             
         case '.':
             advance(lexer);
@@ -698,44 +736,465 @@ Token* get_next_token(Lexer* lexer) {
                 advance(lexer);
                 if (peek(lexer) == '.') {
                     advance(lexer);
-                    return create_token(TOKEN_SPREAD, "...", line, column);
+                    return make_token(lexer, TOKEN_SPREAD, start);
                 }
-                return create_token(TOKEN_DOUBLE_DOT, "..", line, column);
+                return make_token(lexer, TOKEN_DOUBLE_DOT, start);
             }
-            return create_token(TOKEN_DOT, ".", line, column);
+            return make_token(lexer, TOKEN_DOT, start);
             
         case '@':
             advance(lexer);
-            return create_token(TOKEN_AT, "@", line, column);
+            return make_token(lexer, TOKEN_AT, start);
             
         case '$':
             advance(lexer);
-            return create_token(TOKEN_DOLLAR, "$", line, column);
+            return make_token(lexer, TOKEN_DOLLAR, start);
             
         case '`':
             advance(lexer);
-            return create_token(TOKEN_BACKTICK, "`", line, column);
+            return make_token(lexer, TOKEN_BACKTICK, start);
             
-        case '(': advance(lexer); return create_token(TOKEN_LEFT_PAREN, "(", line, column);
-        case ')': advance(lexer); return create_token(TOKEN_RIGHT_PAREN, ")", line, column);
-        case '{': advance(lexer); return create_token(TOKEN_LEFT_BRACE, "{", line, column);
-        case '}': advance(lexer); return create_token(TOKEN_RIGHT_BRACE, "}", line, column);
-        case '[': advance(lexer); return create_token(TOKEN_LEFT_BRACKET, "[", line, column);
-        case ']': advance(lexer); return create_token(TOKEN_RIGHT_BRACKET, "]", line, column);
-        case '<': advance(lexer); return create_token(TOKEN_LEFT_ANGLE, "<", line, column);
-        case '>': advance(lexer); return create_token(TOKEN_RIGHT_ANGLE, ">", line, column);
-        case ',': advance(lexer); return create_token(TOKEN_COMMA, ",", line, column);
+        case '(': advance(lexer); return make_token(lexer, TOKEN_LEFT_PAREN, start);
+        case ')': advance(lexer); return make_token(lexer, TOKEN_RIGHT_PAREN, start);
+        case '{': advance(lexer); return make_token(lexer, TOKEN_LEFT_BRACE, start);
+        case '}': advance(lexer); return make_token(lexer, TOKEN_RIGHT_BRACE, start);
+        case '[': advance(lexer); return make_token(lexer, TOKEN_LEFT_BRACKET, start);
+        case ']': advance(lexer); return make_token(lexer, TOKEN_RIGHT_BRACKET, start);
+        case ',': advance(lexer); return make_token(lexer, TOKEN_COMMA, start);
         case ':': 
             advance(lexer);
             if (peek(lexer) == ':') {
                 advance(lexer);
-                return create_token(TOKEN_DOUBLE_COLON, "::", line, column);
+                return make_token(lexer, TOKEN_DOUBLE_COLON, start);
             }
-            return create_token(TOKEN_COLON, ":", line, column);
-        case ';': advance(lexer); return create_token(TOKEN_SEMICOLON, ";", line, column);
+            return make_token(lexer, TOKEN_COLON, start);
+        case ';': advance(lexer); return make_token(lexer, TOKEN_SEMICOLON, start);
     }
 
-    fprintf(stderr, "Unexpected character: '%c' at line %d, column %d\n", 
-            c, line, column);
-    exit(1);
-} 
\ No newline at end of file
+    char message[32];
+    snprintf(message, sizeof(message), "Unexpected character: '%c'", c);
+    lexer_error(lexer, start, message);
+    return create_token(TOKEN_EOF, lexer->base + start, 0);
+}
+
+// Get the next token
+Token get_next_token(Lexer* lexer) {
+    if (lexer->reader && lexer->length - lexer->position < STREAM_LOW_WATER) {
+        slide_window(lexer);
+    }
+    skip_whitespace(lexer);
+    Token token = scan_token(lexer);
+    if (!token_is_comment(token.type)) {
+        lexer->keep = token.start - lexer->base;
+        lexer->after_operand = token_ends_operand(token.type);
+    }
+    return token;
+}
+
+// Get the source offset a token's text begins at, including the opening
+// delimiter that string-like tokens leave out; lexing can restart there
+size_t token_source_start(const Token* token) {
+    switch (token->type) {
+        case TOKEN_STRING:
+        case TOKEN_REGEX:
+        case TOKEN_TEMPLATE_STRING:
+        case TOKEN_CHAR:
+            return token->start - 1;
+        default:
+            return token->start;
+    }
+}
+
+// Check if a token type is a comment
+bool token_is_comment(TokenType type) {
+    return type == TOKEN_COMMENT ||
+           type == TOKEN_DOC_COMMENT ||
+           type == TOKEN_MULTILINE_COMMENT;
+}
+
+// Grow every array of a token buffer to a new capacity
+static void grow_token_buffer(Arena* arena, TokenBuffer* buffer, size_t new_capacity) {
+    size_t old_count = buffer->capacity;
+    size_t new_count = new_capacity;
+    buffer->types = (uint16_t*)arena_grow(arena, buffer->types,
+                                          old_count * sizeof(uint16_t), new_count * sizeof(uint16_t));
+    buffer->starts = (size_t*)arena_grow(arena, buffer->starts,
+                                         old_count * sizeof(size_t), new_count * sizeof(size_t));
+    buffer->lengths = (uint32_t*)arena_grow(arena, buffer->lengths,
+                                            old_count * sizeof(uint32_t), new_count * sizeof(uint32_t));
+    buffer->numbers = (NumberValue*)arena_grow(arena, buffer->numbers, old_count * sizeof(NumberValue),
+                                               new_count * sizeof(NumberValue));
+    buffer->capacity = new_capacity;
+}
+
+// Create an empty token buffer with room for capacity tokens
+static TokenBuffer* create_token_buffer(Arena* arena, size_t capacity) {
+    TokenBuffer* buffer = (TokenBuffer*)arena_alloc(arena, sizeof(TokenBuffer));
+    buffer->types = NULL;
+    buffer->starts = NULL;
+    buffer->lengths = NULL;
+    buffer->numbers = NULL;
+    buffer->count = 0;
+    buffer->capacity = 0;
+    grow_token_buffer(arena, buffer, capacity);
+    return buffer;
+}
+
+// Append every token that starts before end, dropping comments; stops
+// after TOKEN_EOF if the input ends first. Whitespace is skipped before
+// the check, so a lexer that stops at end never scans the token there
+static void lex_range(Lexer* lexer, TokenBuffer* buffer, size_t end) {
+    for (;;) {
+        skip_whitespace(lexer);
+        if (lexer->position >= end) {
+            return;
+        }
+        Token token = scan_token(lexer);
+        if (token_is_comment(token.type)) {
+            continue;
+        }
+        lexer->after_operand = token_ends_operand(token.type);
+        if (buffer->count == buffer->capacity) {
+            grow_token_buffer(lexer->arena, buffer, buffer->capacity * 2);
+        }
+        size_t i = buffer->count++;
+        buffer->types[i] = (uint16_t)token.type;
+        buffer->starts[i] = token.start;
+        buffer->lengths[i] = token.length;
+        buffer->numbers[i] = token.number;
+        if (token.type == TOKEN_EOF) {
+            return;
+        }
+    }
+}
+
+// Tokenize the whole remaining input, dropping comments; the input must be
+// in memory because a token buffer refers back to every token's text
+TokenBuffer* lex_all(Lexer* lexer) {
+    if (lexer->reader) {
+        raise_error("lex_all needs the whole input in memory");
+    }
+
+    // Source averages well over four bytes per token, so this rarely grows
+    TokenBuffer* buffer = create_token_buffer(lexer->arena, (lexer->length - lexer->position) / 4 + 16);
+    lex_range(lexer, buffer, SIZE_MAX);
+    return buffer;
+}
+
+// Byte classes for the split pre-scan. Every byte that can start a token
+// outside a literal is BLANK, WORD, CLOSE, PUNCT or LITERAL; anything
+// else, including '\0', is STOP because the lexer would end or reject the
+// input there. The classes other than BLANK tell what the previous token
+// was, which decides whether a slash divides
+enum {
+    SPLIT_STOP,
+    SPLIT_BLANK,
+    SPLIT_NEWLINE,
+    SPLIT_WORD,
+    SPLIT_CLOSE,
+    SPLIT_PUNCT,
+    SPLIT_LITERAL
+};
+
+static const unsigned char split_classes[256] = {
+    [' '] = SPLIT_BLANK, ['\t'] = SPLIT_BLANK, ['\r'] = SPLIT_BLANK,
+    ['\n'] = SPLIT_NEWLINE,
+    ['a' ... 'z'] = SPLIT_WORD, ['A' ... 'Z'] = SPLIT_WORD,
+    ['0' ... '9'] = SPLIT_WORD, ['_'] = SPLIT_WORD,
+    [')'] = SPLIT_CLOSE, [']'] = SPLIT_CLOSE,
+    ['+'] = SPLIT_PUNCT, ['-'] = SPLIT_PUNCT, ['*'] = SPLIT_PUNCT, ['%'] = SPLIT_PUNCT,
+    ['='] = SPLIT_PUNCT, ['!'] = SPLIT_PUNCT, ['>'] = SPLIT_PUNCT, ['<'] = SPLIT_PUNCT,
+    ['&'] = SPLIT_PUNCT, ['|'] = SPLIT_PUNCT, ['^'] = SPLIT_PUNCT, ['~'] = SPLIT_PUNCT,
+    ['?'] = SPLIT_PUNCT, ['.'] = SPLIT_PUNCT, ['@'] = SPLIT_PUNCT, ['$'] = SPLIT_PUNCT,
+    ['('] = SPLIT_PUNCT, ['['] = SPLIT_PUNCT, ['{'] = SPLIT_PUNCT, ['}'] = SPLIT_PUNCT,
+    [','] = SPLIT_PUNCT, [':'] = SPLIT_PUNCT, [';'] = SPLIT_PUNCT,
+    ['"'] = SPLIT_LITERAL, ['\''] = SPLIT_LITERAL, ['/'] = SPLIT_LITERAL,
+    ['`'] = SPLIT_LITERAL, ['#'] = SPLIT_LITERAL,
+};
+
+// Skip a regex or template string body up to its closing delimiter, the
+// way read_regex and read_template_string do; returns SIZE_MAX where they
+// would fail
+static size_t skip_delimited(const char* text, size_t length, size_t p, char delimiter) {
+    while (p < length && text[p] != delimiter) {
+        if (text[p] == '\0') {
+            return SIZE_MAX;
+        }
+        if (text[p] == '\\') {
+            p++;
+            if (p >= length || text[p] == '\0') {
+                return SIZE_MAX;
+            }
+        }
+        p++;
+    }
+    return p < length ? p + 1 : SIZE_MAX;
+}
+
+// Skip the identifier, keyword or number starting at p and note whether
+// it ends an operand. A number's run may continue past one '.', as
+// read_number's does, so that "1./2" divides here too
+static size_t skip_word(const char* text, size_t p, bool* after_operand) {
+    size_t start = p;
+    while (split_classes[(unsigned char)text[p]] == SPLIT_WORD) {
+        p++;
+    }
+    if (is_digit(text[start])) {
+        if (text[p] == '.') {
+            p++;
+            while (split_classes[(unsigned char)text[p]] == SPLIT_WORD) {
+                p++;
+            }
+        }
+        *after_operand = true;
+    } else {
+        *after_operand = token_ends_operand(lookup_keyword(text + start, (int)(p - start)));
+    }
+    return p;
+}
+
+// Skip the string, character, regex, template or comment starting at p,
+// or a dividing slash, mirroring scan_token; returns the offset just past
+// it, or SIZE_MAX where the lexer would report an error. Comments leave
+// after_operand as it was
+static size_t skip_literal(const Lexer* lexer, size_t p, bool* after_operand) {
+    const char* text = lexer->input;
+    size_t length = lexer->length;
+    const Scanner* scanner = lexer->scanner;
+    size_t q;
+
+    switch (text[p]) {
+        case '"':
+            *after_operand = true;
+            q = p + 1 + scanner->scan[SCAN_STRING_BODY](text + p + 1, length - p - 1);
+            return q < length ? q + 1 : SIZE_MAX;
+
+        case '\'':
+            *after_operand = true;
+            q = p + 1;
+            if (text[q] == '\\') {
+                q++;
+            }
+            if (q >= length || text[q] == '\0' || text[q + 1] != '\'') {
+                return SIZE_MAX;
+            }
+            return q + 2;
+
+        case '/':
+            if (text[p + 1] == '/') {
+                return p + 2 + scanner->scan[SCAN_LINE_COMMENT](text + p + 2, length - p - 2);
+            }
+            if (*after_operand) {
+                *after_operand = false;
+                return p + 1;
+            }
+            *after_operand = true;
+            return skip_delimited(text, length, p + 1, '/');
+
+        case '`':
+            *after_operand = true;
+            return skip_delimited(text, length, p + 1, '`');
+
+        default:
+            if (text[p + 1] != '[') {
+                return p + 1 + scanner->scan[SCAN_LINE_COMMENT](text + p + 1, length - p - 1);
+            }
+            q = p + 2;
+            while (q < length && text[q] != '\0') {
+                q += scanner->scan[SCAN_BLOCK_COMMENT](text + q, length - q);
+                if (q >= length) {
+                    break;
+                }
+                if (text[q + 1] == '#') {
+                    return q + 2;
+                }
+                q++;
+            }
+            return SIZE_MAX;
+    }
+}
+
+// A chunk boundary of a parallel lex and whether the token before it
+// ends an operand
+typedef struct {
+    size_t offset;
+    bool after_operand;
+} LexSplit;
+
+// Pick up to max_splits chunk boundaries about step bytes apart. Each one
+// is the start of a line the lexer reaches between tokens, so no literal
+// or comment straddles it. Scanning gives up at the first byte the lexer
+// would reject, which keeps any lexer error inside the last chunk
+static size_t find_splits(const Lexer* lexer, size_t step, LexSplit* splits, size_t max_splits) {
+    const unsigned char* text = (const unsigned char*)lexer->input;
+    size_t length = lexer->length;
+    size_t p = lexer->position;
+    size_t target = p + step;
+    size_t count = 0;
+    bool after_operand = lexer->after_operand;
+
+    while (count < max_splits && p < length) {
+        switch (split_classes[text[p]]) {
+            case SPLIT_BLANK:
+                p++;
+                break;
+            case SPLIT_NEWLINE:
+                p++;
+                if (p >= target && p < length) {
+                    splits[count].offset = p;
+                    splits[count].after_operand = after_operand;
+                    count++;
+                    target = p + step;
+                }
+                break;
+            case SPLIT_WORD:
+                p = skip_word(lexer->input, p, &after_operand);
+                break;
+            case SPLIT_CLOSE:
+                after_operand = true;
+                p++;
+                break;
+            case SPLIT_PUNCT:
+                after_operand = false;
+                p++;
+                break;
+            case SPLIT_LITERAL:
+                p = skip_literal(lexer, p, &after_operand);
+                if (p == SIZE_MAX) {
+                    return count;
+                }
+                break;
+            default:
+                return count;
+        }
+    }
+    return count;
+}
+
+// One chunk of a parallel lex, with its own lexer and arena
+typedef struct {
+    const Lexer* source;
+    size_t start;
+    size_t end;
+    bool after_operand;  // The lexer state at start
+    Arena* arena;
+    Lexer* lexer;
+    TokenBuffer* tokens;
+    bool failed;
+    char error[ERROR_MESSAGE_MAX];  // The chunk's first error, if it failed
+} LexChunk;
+
+// Lex one chunk; every chunk lexer sees the whole input, so its token
+// offsets are already source offsets. An error is kept in the chunk so
+// that the caller can report the first one in source order
+static void lex_chunk(void* userdata, size_t index) {
+    LexChunk* chunk = &((LexChunk*)userdata)[index];
+    ErrorHandler handler;
+    error_push_handler(&handler);
+    if (setjmp(handler.jump) == 0) {
+        chunk->arena = create_arena(0);
+        chunk->lexer = create_lexer_from_buffer(chunk->source->input, chunk->source->length,
+                                                chunk->arena);
+        chunk->lexer->position = chunk->start;
+        chunk->lexer->after_operand = chunk->after_operand;
+        size_t span = chunk->end == SIZE_MAX ? chunk->source->length - chunk->start
+                                             : chunk->end - chunk->start;
+        chunk->tokens = create_token_buffer(chunk->arena, span / 4 + 16);
+        lex_range(chunk->lexer, chunk->tokens, chunk->end);
+        error_pop_handler(&handler);
+    } else {
+        memcpy(chunk->error, handler.message, sizeof(chunk->error));
+        chunk->failed = true;
+    }
+}
+
+// Release the chunks of a parallel lex
+static void destroy_chunks(LexChunk* chunks, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        destroy_lexer(chunks[i].lexer);
+        destroy_arena(chunks[i].arena);
+    }
+    free(chunks);
+}
+
+// Tokenize the whole remaining input like lex_all, splitting it into
+// chunks that are lexed on a worker pool and concatenated. The result is
+// identical to lex_all's; small inputs are simply lexed in place
+TokenBuffer* lex_all_parallel(Lexer* lexer, WorkerPool* pool) {
+    size_t workers = pool ? (size_t)pool->thread_count + 1 : 1;
+    size_t remaining = lexer->length - lexer->position;
+    if (lexer->reader || workers < 2 || remaining < 2 * PARALLEL_LEX_MIN_CHUNK) {
+        return lex_all(lexer);
+    }
+
+    // A few chunks per worker evens out differences in token density
+    size_t max_chunks = workers * PARALLEL_LEX_CHUNKS_PER_WORKER;
+    size_t step = remaining / max_chunks;
+    if (step < PARALLEL_LEX_MIN_CHUNK) {
+        step = PARALLEL_LEX_MIN_CHUNK;
+    }
+    LexSplit* splits = (LexSplit*)malloc(max_chunks * sizeof(LexSplit));
+    if (!splits) {
+        raise_error("Out of memory");
+    }
+    size_t chunk_count = find_splits(lexer, step, splits, max_chunks - 1) + 1;
+    if (chunk_count == 1) {
+        free(splits);
+        return lex_all(lexer);
+    }
+
+    LexChunk* chunks = (LexChunk*)calloc(chunk_count, sizeof(LexChunk));
+    if (!chunks) {
+        free(splits);
+        raise_error("Out of memory");
+    }
+    for (size_t i = 0; i < chunk_count; i++) {
+        chunks[i].source = lexer;
+        chunks[i].start = i == 0 ? lexer->position : splits[i - 1].offset;
+        chunks[i].after_operand = i == 0 ? lexer->after_operand : splits[i - 1].after_operand;
+        chunks[i].end = i + 1 < chunk_count ? splits[i].offset : SIZE_MAX;
+    }
+    worker_pool_run(pool, lex_chunk, chunks, chunk_count);
+    free(splits);
+
+    // The lowest failed chunk holds the error lex_all would have raised
+    for (size_t i = 0; i < chunk_count; i++) {
+        if (chunks[i].failed) {
+            char message[ERROR_MESSAGE_MAX];
+            memcpy(message, chunks[i].error, sizeof(message));
+            destroy_chunks(chunks, chunk_count);
+            raise_error("%s", message);
+        }
+    }
+
+    // Stitch the chunks together in source order
+    size_t total = 0;
+    for (size_t i = 0; i < chunk_count; i++) {
+        total += chunks[i].tokens->count;
+    }
+    TokenBuffer* buffer = create_token_buffer(lexer->arena, total);
+    for (size_t i = 0; i < chunk_count; i++) {
+        const TokenBuffer* tokens = chunks[i].tokens;
+        memcpy(buffer->types + buffer->count, tokens->types, tokens->count * sizeof(uint16_t));
+        memcpy(buffer->starts + buffer->count, tokens->starts, tokens->count * sizeof(size_t));
+        memcpy(buffer->lengths + buffer->count, tokens->lengths, tokens->count * sizeof(uint32_t));
+        memcpy(buffer->numbers + buffer->count, tokens->numbers, tokens->count * sizeof(NumberValue));
+        buffer->count += tokens->count;
+    }
+    lexer->position = chunks[chunk_count - 1].lexer->position;
+    lexer->after_operand = chunks[chunk_count - 1].lexer->after_operand;
+
+    destroy_chunks(chunks, chunk_count);
+    return buffer;
+}
+
+// Get the token at an index; indices past the end yield the final EOF
+Token token_at(const TokenBuffer* buffer, size_t index) {
+    if (index >= buffer->count) {
+        index = buffer->count - 1;
+    }
+    Token token = create_token((TokenType)buffer->types[index], buffer->starts[index],
+                               buffer->lengths[index]);
+    token.number = buffer->numbers[index];
+    return token;
+}
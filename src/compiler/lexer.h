@@ -1,7 +1,11 @@
 #ifndef IBERY_LEXER_H
 #define IBERY_LEXER_H
 
+#include "arena.h"
+#include "scan.h"
+#include "workers.h"
 #include <stdbool.h>
+#include <stdint.h>
 
 // Token types
 typedef enum {
@@ -84,6 +88,7 @@ typedef enum {
     // Identifiers and literals
     TOKEN_IDENTIFIER,
     TOKEN_NUMBER,
+    TOKEN_FLOAT,
     TOKEN_STRING,
     TOKEN_REGEX,
     TOKEN_TEMPLATE_STRING,
@@ -112,6 +117,8 @@ typedef enum {
     TOKEN_NOT,
     TOKEN_EQUAL_EQUAL,
     TOKEN_NOT_EQUAL,
+    TOKEN_EQUAL_EQUAL_EQUAL,
+    TOKEN_NOT_EQUAL_EQUAL,
     TOKEN_GREATER,
     TOKEN_LESS,
     TOKEN_GREATER_EQUAL,
@@ -127,7 +134,6 @@ typedef enum {
     TOKEN_OPTIONAL_CHAINING,
     TOKEN_SPREAD,
     TOKEN_REST,
-    TOKEN_PIPE,
     TOKEN_ARROW,
     TOKEN_DOUBLE_ARROW,
     TOKEN_DOUBLE_QUESTION,
@@ -148,11 +154,6 @@ typedef enum {
     TOKEN_STAR,
     TOKEN_SLASH,
     TOKEN_BACKSLASH,
-    TOKEN_PLUS,
-    TOKEN_MINUS,
-    TOKEN_EQUALS,
-    TOKEN_LESS,
-    TOKEN_GREATER,
     TOKEN_COMMA,
     TOKEN_DOT,
     TOKEN_COLON,
@@ -205,13 +206,11 @@ typedef enum {
     TOKEN_GET,
     TOKEN_POST,
     TOKEN_PUT,
-    TOKEN_DELETE,
     TOKEN_PATCH,
     TOKEN_OPTIONS,
     TOKEN_HEAD,
     TOKEN_MIDDLEWARE,
     TOKEN_REQUEST,
-    TOKEN_RESPONSE,
     TOKEN_PARAMS,
     TOKEN_QUERY,
     TOKEN_BODY,
@@ -293,26 +292,88 @@ typedef enum {
     TOKEN_EOF
 } TokenType;
 
-// Token structure
+// Value of a number token, converted once by the lexer: integer for
+// TOKEN_NUMBER, TOKEN_HEX, TOKEN_OCTAL and TOKEN_BINARY, real for
+// TOKEN_FLOAT. Zero for every other token
+typedef union {
+    int64_t integer;
+    double real;
+} NumberValue;
+
+// Token structure: a view of source bytes [start, start + length); string-like
+// tokens cover only the text between their delimiters. Line and column are
+// recovered from the offset on demand with lexer_location
 typedef struct {
     TokenType type;
-    char* value;
-    int line;
-    int column;
+    uint32_t length;
+    size_t start;
+    NumberValue number;
 } Token;
 
-// Lexer structure
+// Every significant token of an input, in parallel arrays; the last
+// token is always TOKEN_EOF
+typedef struct {
+    uint16_t* types;
+    size_t* starts;
+    uint32_t* lengths;
+    NumberValue* numbers;
+    size_t count;
+    size_t capacity;
+} TokenBuffer;
+
+// Reads up to capacity bytes of streamed input into buffer; returns 0 at
+// the end of the input
+typedef size_t (*LexerReader)(void* userdata, char* buffer, size_t capacity);
+
+// Lexer structure. The source is seen through a window: input[i] is source
+// byte base + i and input[length] is always '\0'. An in-memory lexer's
+// window is the whole source. A streaming lexer refills its window from a
+// reader and, between tokens, drops everything before the last significant
+// token, so only that token's text stays addressable. Materialized token
+// text and the line table are allocated from the arena
 typedef struct {
     const char* input;
-    int position;
-    int line;
-    int column;
+    size_t length;
+    size_t position;  // Relative to input
+    size_t base;
+    Arena* arena;
+    const Scanner* scanner;
+    size_t* line_starts;  // Offset of each line, built on first lexer_location
+    size_t line_count;
+    bool after_operand;   // The last significant token ends an operand
+
+    // Streaming input; reader is NULL and at_end is true for in-memory input
+    LexerReader reader;
+    void* reader_userdata;
+    char* window;
+    size_t window_capacity;
+    size_t keep;             // Window offset of the last significant token
+    bool at_end;
+    size_t base_line;        // Newlines before base
+    size_t base_line_start;  // Source offset of the line containing base
+    bool base_line_blank;    // Only blanks lie between base_line_start and base
 } Lexer;
 
+// Get a pointer to the source byte at offset; for a streaming lexer the
+// offset must be at or after the last significant token
+static inline const char* lexer_text(const Lexer* lexer, size_t offset) {
+    return lexer->input + (offset - lexer->base);
+}
+
 // Function declarations
-Lexer* create_lexer(const char* input);
+Lexer* create_lexer(const char* input, Arena* arena);
+Lexer* create_lexer_from_buffer(const char* input, size_t length, Arena* arena);
+Lexer* create_streaming_lexer(LexerReader reader, void* userdata, Arena* arena);
 void destroy_lexer(Lexer* lexer);
-Token* get_next_token(Lexer* lexer);
-void destroy_token(Token* token);
+Token get_next_token(Lexer* lexer);
+char* token_materialize(Lexer* lexer, const Token* token);
+size_t token_source_start(const Token* token);
+bool token_is_comment(TokenType type);
+TokenBuffer* lex_all(Lexer* lexer);
+TokenBuffer* lex_all_parallel(Lexer* lexer, WorkerPool* pool);
+Token token_at(const TokenBuffer* buffer, size_t index);
+void lexer_location(Lexer* lexer, size_t offset, size_t* line, size_t* column);
+size_t lexer_column(const Lexer* lexer, size_t offset);
+bool lexer_at_line_start(const Lexer* lexer, size_t offset);
 
-#endif // IBERY_LEXER_H 
\ No newline at end of file
+#endif // IBERY_LEXER_H
@@ -0,0 +1,274 @@
+#include "module.h"
+#include "codegen.h"
+#include "varint.h"
+#include "error.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+// Check that a section of count elements lies inside the image
+static bool section_fits(const ModuleHeader* header, uint32_t offset, uint32_t count, size_t element_size) {
+    return offset % 4 == 0 && offset <= header->size &&
+           (uint64_t)count * element_size <= header->size - offset;
+}
+
+// Check if a buffer starts with a module header
+bool module_is_image(const uint8_t* image, size_t size) {
+    return size >= sizeof(ModuleHeader) && memcmp(image, MODULE_MAGIC, 4) == 0;
+}
+
+// Find what is wrong with the code section, or return NULL. There are no
+// jumps, so the stack depth after every instruction is known: no code may
+// pop below its frame or push past MODULE_STACK_MAX. Code after a return,
+// or after a call that is always a runtime error because its function is
+// undefined or has more parameters than there are values, is unreachable
+// up to the next function entry and only has to decode. callees maps a
+// constant index to the first function of that name, or UINT32_MAX
+static const char* code_problem(const ModuleHeader* header, const uint32_t* callees) {
+    const uint8_t* code = module_code(header);
+    size_t size = header->code_size;
+    const ModuleFunction* functions = module_functions(header);
+    uint32_t next_function = 0;
+    uint64_t frame_size = 0;
+    uint64_t depth = 0;
+    bool reachable = true;
+    size_t pos = 0;
+
+    while (pos < size) {
+        while (next_function < header->function_count && functions[next_function].entry == pos) {
+            frame_size = (uint64_t)functions[next_function].param_count +
+                         functions[next_function].local_count;
+            depth = 0;
+            reachable = true;
+            next_function++;
+        }
+
+        uint8_t opcode = code[pos++];
+        uint32_t index = 0;
+        int64_t integer;
+        size_t length = 0;
+        switch (opcode_operand(opcode)) {
+            case OPERAND_CONSTANT:
+            case OPERAND_INDEX:
+                length = varint_decode_u32(code + pos, size - pos, &index);
+                break;
+            case OPERAND_INT:
+                length = varint_decode_i64(code + pos, size - pos, &integer);
+                break;
+            case OPERAND_DOUBLE:
+                length = size - pos >= DOUBLE_BYTES ? DOUBLE_BYTES : 0;
+                break;
+            case OPERAND_NONE:
+                break;
+        }
+        if (length == 0 && opcode_operand(opcode) != OPERAND_NONE) {
+            return "malformed code";
+        }
+        pos += length;
+
+        uint64_t pops = 0;
+        uint64_t pushes = 0;
+        bool ends = false;  // Nothing after the instruction runs
+        switch (opcode) {
+            case OP_RETURN:
+                ends = true;
+                break;
+            case OP_QUANTUM_OP:
+            case OP_RUN_COMMAND:
+                pops = 0;
+                pushes = 0;
+                break;
+            case OP_PRINT:
+            case OP_POP:
+                pops = 1;
+                pushes = 0;
+                break;
+            case OP_PUSH_INT:
+            case OP_PUSH_DOUBLE:
+            case OP_PUSH_STRING:
+            case OP_PUSH_IDENTIFIER:
+            case OP_LOAD_LOCAL:
+            case OP_LOAD_GLOBAL:
+                pops = 0;
+                pushes = 1;
+                break;
+            case OP_STORE_LOCAL:
+            case OP_STORE_GLOBAL:
+            case OP_NEGATE:
+            case OP_NOT:
+            case OP_BIT_NOT:
+                pops = 1;
+                pushes = 1;
+                break;
+            case OP_CALL_INDEX:
+            case OP_CALL_FUNCTION: {
+                if (opcode == OP_CALL_FUNCTION) {
+                    if (index >= header->constant_count) {
+                        return "constant index out of range";
+                    }
+                    index = callees[index];
+                } else if (index >= header->function_count) {
+                    return "function index out of range";
+                }
+                const ModuleFunction* callee = index < header->function_count ? &functions[index] : NULL;
+                if (!callee || callee->param_count > depth) {
+                    ends = true;
+                    break;
+                }
+                pops = callee->param_count;
+                pushes = 1;
+                break;
+            }
+            case OP_ADD:
+            case OP_SUBTRACT:
+            case OP_MULTIPLY:
+            case OP_DIVIDE:
+            case OP_MODULO:
+            case OP_POWER:
+            case OP_SHIFT_LEFT:
+            case OP_SHIFT_RIGHT:
+            case OP_SHIFT_RIGHT_UNSIGNED:
+            case OP_BIT_AND:
+            case OP_BIT_OR:
+            case OP_BIT_XOR:
+            case OP_EQUAL:
+            case OP_NOT_EQUAL:
+            case OP_LESS:
+            case OP_LESS_EQUAL:
+            case OP_GREATER:
+            case OP_GREATER_EQUAL:
+                pops = 2;
+                pushes = 1;
+                break;
+            default:
+                return "unknown opcode";
+        }
+        if (!reachable) {
+            continue;
+        }
+        if (depth < pops) {
+            return "stack underflow";
+        }
+        depth = depth - pops + pushes;
+        if (frame_size + depth > MODULE_STACK_MAX) {
+            return "stack overflow";
+        }
+        reachable = !ends;
+    }
+    if (next_function < header->function_count) {
+        return "bad function entry";
+    }
+    return NULL;
+}
+
+// Check the code section of a module whose tables are in bounds
+static const char* check_code(const ModuleHeader* header) {
+    // One spare entry, so that a module without constants still allocates
+    uint32_t* callees = (uint32_t*)malloc((header->constant_count + 1) * sizeof(uint32_t));
+    if (!callees) {
+        return "out of memory";
+    }
+    memset(callees, 0xFF, (header->constant_count + 1) * sizeof(uint32_t));
+    const ModuleFunction* functions = module_functions(header);
+    for (uint32_t i = header->function_count; i-- > 0;) {
+        callees[functions[i].name] = i;
+    }
+    const char* problem = code_problem(header, callees);
+    free(callees);
+    return problem;
+}
+
+// Find what is wrong with a module image, or return NULL if the VM can
+// index it, and pop its stack, without bounds checks
+static const char* module_problem(const uint8_t* image, size_t size) {
+    if (!module_is_image(image, size)) {
+        return "bad magic";
+    }
+    const ModuleHeader* header = (const ModuleHeader*)image;
+    if (header->version != MODULE_VERSION) {
+        return "unsupported version";
+    }
+    if (header->size != size) {
+        return "size mismatch";
+    }
+    if (!section_fits(header, header->constants_offset, header->constant_count, sizeof(ModuleConstant)) ||
+        !section_fits(header, header->functions_offset, header->function_count, sizeof(ModuleFunction)) ||
+        !section_fits(header, header->code_offset, header->code_size, 1)) {
+        return "section out of bounds";
+    }
+
+    const ModuleConstant* constants = module_constants(header);
+    for (uint32_t i = 0; i < header->constant_count; i++) {
+        if ((uint64_t)constants[i].offset + constants[i].length >= size ||
+            image[constants[i].offset + constants[i].length] != '\0') {
+            return "constant out of bounds";
+        }
+    }
+
+    const ModuleFunction* functions = module_functions(header);
+    uint32_t param_total = 0;
+    uint32_t last_entry = 0;
+    for (uint32_t i = 0; i < header->function_count; i++) {
+        const ModuleFunction* function = &functions[i];
+        if (function->name >= header->constant_count) {
+            return "function name out of range";
+        }
+        if (function->params != param_total || function->param_count > size) {
+            return "bad parameter range";
+        }
+        if (function->entry >= header->code_size || function->entry < last_entry) {
+            return "bad function entry";
+        }
+        if (function->local_count > size) {
+            return "bad local count";
+        }
+        param_total += function->param_count;
+        last_entry = function->entry;
+    }
+    if (!section_fits(header, header->params_offset, param_total, sizeof(uint32_t))) {
+        return "section out of bounds";
+    }
+    const uint32_t* params = module_params(header);
+    for (uint32_t i = 0; i < param_total; i++) {
+        if (params[i] >= header->constant_count) {
+            return "parameter name out of range";
+        }
+    }
+    if (!section_fits(header, header->globals_offset, header->global_count, sizeof(uint32_t))) {
+        return "section out of bounds";
+    }
+    const uint32_t* globals = module_globals(header);
+    for (uint32_t i = 0; i < header->global_count; i++) {
+        if (globals[i] >= header->constant_count) {
+            return "global name out of range";
+        }
+    }
+    return check_code(header);
+}
+
+// Check if a module image is well formed
+bool module_is_valid(const uint8_t* image, size_t size) {
+    return module_problem(image, size) == NULL;
+}
+
+// Validate a module image so the VM can index it without bounds checks
+const ModuleHeader* module_open(const uint8_t* image, size_t size) {
+    const char* problem = module_problem(image, size);
+    if (problem) {
+        raise_error("Invalid module: %s", problem);
+    }
+    return (const ModuleHeader*)image;
+}
+
+// Write a module image to a file
+void module_write(const char* path, const uint8_t* image, size_t size) {
+    FILE* file = fopen(path, "wb");
+    if (!file) {
+        raise_error("Error opening output file: %s", strerror(errno));
+    }
+    bool written = fwrite(image, 1, size, file) == size;
+    if (fclose(file) != 0 || !written) {
+        raise_error("Error writing module: %s", strerror(errno));
+    }
+}
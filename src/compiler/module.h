@@ -0,0 +1,92 @@
+#ifndef IBERY_MODULE_H
+#define IBERY_MODULE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+// Compiled module image. Every offset is from the start of the image and
+// every section is 4-byte aligned, so an image can be mapped read-only and
+// used in place. Header and table integers are stored in host byte order;
+// operands in the code section are LEB128 varints.
+//
+//   ModuleHeader
+//   ModuleConstant[constant_count]   constant pool
+//   ModuleFunction[function_count]   function table, sorted by entry
+//   uint32_t[]                       parameter names as constant indices
+//   uint32_t[global_count]           global names as constant indices
+//   char[]                           constant text, each NUL-terminated
+//   uint8_t[code_size]               top-level code, then function bodies
+
+#define MODULE_MAGIC "IBRY"
+#define MODULE_VERSION 5
+#define MODULE_STACK_MAX 4096  // Stack slots the code of a module may use
+
+// Module file header
+typedef struct {
+    char magic[4];
+    uint32_t version;
+    uint32_t size;
+    uint32_t constant_count;
+    uint32_t constants_offset;
+    uint32_t function_count;
+    uint32_t functions_offset;
+    uint32_t params_offset;
+    uint32_t code_offset;
+    uint32_t code_size;
+    uint32_t global_count;
+    uint32_t globals_offset;
+} ModuleHeader;
+
+// A constant pool entry
+typedef struct {
+    uint32_t offset;
+    uint32_t length;
+} ModuleConstant;
+
+// A function table entry
+typedef struct {
+    uint32_t name;         // Constant index
+    uint32_t param_count;
+    uint32_t params;       // Index of the first parameter name
+    uint32_t entry;        // Offset of the body within the code section
+    uint32_t local_count;  // Frame slots after the parameters
+} ModuleFunction;
+
+// Function declarations
+bool module_is_image(const uint8_t* image, size_t size);
+bool module_is_valid(const uint8_t* image, size_t size);
+const ModuleHeader* module_open(const uint8_t* image, size_t size);
+void module_write(const char* path, const uint8_t* image, size_t size);
+
+// Get the constant pool of an opened module
+static inline const ModuleConstant* module_constants(const ModuleHeader* header) {
+    return (const ModuleConstant*)((const uint8_t*)header + header->constants_offset);
+}
+
+// Get the function table of an opened module
+static inline const ModuleFunction* module_functions(const ModuleHeader* header) {
+    return (const ModuleFunction*)((const uint8_t*)header + header->functions_offset);
+}
+
+// Get the parameter name array of an opened module
+static inline const uint32_t* module_params(const ModuleHeader* header) {
+    return (const uint32_t*)((const uint8_t*)header + header->params_offset);
+}
+
+// Get the global name array of an opened module
+static inline const uint32_t* module_globals(const ModuleHeader* header) {
+    return (const uint32_t*)((const uint8_t*)header + header->globals_offset);
+}
+
+// Get the code section of an opened module
+static inline const uint8_t* module_code(const ModuleHeader* header) {
+    return (const uint8_t*)header + header->code_offset;
+}
+
+// Get the text of a constant
+static inline const char* module_constant_text(const ModuleHeader* header, uint32_t index) {
+    return (const char*)header + module_constants(header)[index].offset;
+}
+
+#endif // IBERY_MODULE_H
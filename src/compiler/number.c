@@ -0,0 +1,246 @@
+#include "number.h"
+#include <float.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Generated by tools/gen_pow5.c
+#include "pow5_table.h"
+
+// Most decimal digits a uint64_t significand always holds
+#define MAX_SIGNIFICANT_DIGITS 19
+
+// Exponents are clamped well past where every literal is zero or infinite
+#define EXPONENT_LIMIT 100000
+
+#define MANTISSA_BITS 52
+#define EXPONENT_BIAS 1023
+#define INFINITE_POWER 0x7FF
+#define INFINITY_BITS ((uint64_t)INFINITE_POWER << MANTISSA_BITS)
+
+// Powers of ten a double holds exactly, for the fast path
+static const double exact_powers[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+#define FAST_PATH_MAX_EXPONENT 22
+#define FAST_PATH_MAX_SIGNIFICAND ((uint64_t)1 << 53)
+
+// Get the value of a digit in any base up to 16, or 16 if it is not one
+static int digit_value(char c) {
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    } else if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    } else if (c >= 'A' && c <= 'F') {
+        return c - 'A' + 10;
+    }
+    return 16;
+}
+
+// Parse length digits of an integer in base 2, 8, 10 or 16, without any
+// prefix; returns false if a digit is invalid or the value exceeds 64 bits
+bool parse_integer(const char* text, size_t length, int base, uint64_t* value) {
+    if (length == 0) {
+        return false;
+    }
+    uint64_t result = 0;
+    for (size_t i = 0; i < length; i++) {
+        int digit = digit_value(text[i]);
+        if (digit >= base || result > (UINT64_MAX - (uint64_t)digit) / (uint64_t)base) {
+            return false;
+        }
+        result = result * (uint64_t)base + (uint64_t)digit;
+    }
+    *value = result;
+    return true;
+}
+
+// Multiply two 64-bit values into a 128-bit product
+static void multiply_128(uint64_t a, uint64_t b, uint64_t* high, uint64_t* low) {
+#ifdef __SIZEOF_INT128__
+    unsigned __int128 product = (unsigned __int128)a * b;
+    *high = (uint64_t)(product >> 64);
+    *low = (uint64_t)product;
+#else
+    uint64_t a_low = (uint32_t)a;
+    uint64_t a_high = a >> 32;
+    uint64_t b_low = (uint32_t)b;
+    uint64_t b_high = b >> 32;
+    uint64_t low_low = a_low * b_low;
+    uint64_t low_high = a_low * b_high;
+    uint64_t middle = a_high * b_low + (low_low >> 32) + (uint32_t)low_high;
+    *high = a_high * b_high + (middle >> 32) + (low_high >> 32);
+    *low = (middle << 32) | (uint32_t)low_low;
+#endif
+}
+
+// Count the leading zero bits of a nonzero value
+static int leading_zeros(uint64_t value) {
+#if defined(__GNUC__)
+    return __builtin_clzll(value);
+#else
+    int count = 0;
+    while (!(value & ((uint64_t)1 << 63))) {
+        value <<= 1;
+        count++;
+    }
+    return count;
+#endif
+}
+
+// Get the bits of the double nearest to w * 10^q (Eisel-Lemire). The
+// product of w with the truncated 5^q is exact enough to round correctly
+// for every 64-bit w: the table's low words are only needed when the bits
+// below the 55 kept ones are all set
+static uint64_t eisel_lemire(int64_t q, uint64_t w) {
+    if (w == 0 || q < POW5_MIN_EXPONENT) {
+        return 0;
+    }
+    if (q > POW5_MAX_EXPONENT) {
+        return INFINITY_BITS;
+    }
+    int zeros = leading_zeros(w);
+    w <<= zeros;
+
+    size_t index = 2 * (size_t)(q - POW5_MIN_EXPONENT);
+    uint64_t high, low;
+    multiply_128(w, pow5_table[index], &high, &low);
+    const uint64_t precision_mask = UINT64_MAX >> (MANTISSA_BITS + 3);
+    if ((high & precision_mask) == precision_mask) {
+        uint64_t second_high, second_low;
+        multiply_128(w, pow5_table[index + 1], &second_high, &second_low);
+        low += second_high;
+        if (second_high > low) {
+            high++;
+        }
+    }
+
+    // Keep 54 bits: the mantissa with its hidden bit and a rounding bit.
+    // The binary exponent is floor(q * log2(10)) from a fixed-point product
+    int upper_bit = (int)(high >> 63);
+    int shift = upper_bit + 64 - MANTISSA_BITS - 3;
+    uint64_t mantissa = high >> shift;
+    int64_t power2 = ((((int64_t)152170 + 65536) * q) >> 16) + 63 + upper_bit - zeros + EXPONENT_BIAS;
+
+    if (power2 <= 0) {
+        // Subnormal; rounding up may carry into the smallest normal number
+        if (-power2 + 1 >= 64) {
+            return 0;
+        }
+        mantissa >>= -power2 + 1;
+        mantissa += mantissa & 1;
+        mantissa >>= 1;
+        return mantissa;
+    }
+
+    // A product exactly halfway between two doubles rounds to even; it can
+    // only be exact for small exponents
+    if (low <= 1 && q >= -4 && q <= 23 && (mantissa & 3) == 1 && (mantissa << shift) == high) {
+        mantissa &= ~(uint64_t)1;
+    }
+    mantissa += mantissa & 1;
+    mantissa >>= 1;
+    if (mantissa >= ((uint64_t)2 << MANTISSA_BITS)) {
+        mantissa = (uint64_t)1 << MANTISSA_BITS;
+        power2++;
+    }
+    mantissa &= ~((uint64_t)1 << MANTISSA_BITS);
+    if (power2 >= INFINITE_POWER) {
+        return INFINITY_BITS;
+    }
+    return mantissa | ((uint64_t)power2 << MANTISSA_BITS);
+}
+
+// Convert with the C library, for literals the fast paths cannot round
+static double parse_double_slow(const char* text, size_t length) {
+    char* copy = (char*)malloc(length + 1);
+    if (!copy) {
+        return 0.0;
+    }
+    memcpy(copy, text, length);
+    copy[length] = '\0';
+    double value = strtod(copy, NULL);
+    free(copy);
+    return value;
+}
+
+// Parse a decimal literal of digits, an optional fraction and an optional
+// exponent into the nearest double; returns false if it is malformed
+bool parse_double(const char* text, size_t length, double* value) {
+    uint64_t significand = 0;
+    int digits = 0;
+    int64_t exponent = 0;     // Of the significand's last digit
+    bool truncated = false;   // Nonzero digits did not fit the significand
+    size_t i = 0;
+
+    // Leading zeros are not significant; digits past the first 19 only
+    // scale the significand
+    size_t integer_start = i;
+    for (; i < length && text[i] >= '0' && text[i] <= '9'; i++) {
+        int digit = text[i] - '0';
+        if (digits < MAX_SIGNIFICANT_DIGITS) {
+            significand = significand * 10 + (uint64_t)digit;
+            digits += significand != 0;
+        } else {
+            exponent++;
+            truncated |= digit != 0;
+        }
+    }
+    if (i == integer_start) {
+        return false;
+    }
+    if (i < length && text[i] == '.') {
+        for (i++; i < length && text[i] >= '0' && text[i] <= '9'; i++) {
+            int digit = text[i] - '0';
+            if (digits < MAX_SIGNIFICANT_DIGITS) {
+                significand = significand * 10 + (uint64_t)digit;
+                digits += significand != 0;
+                exponent--;
+            } else {
+                truncated |= digit != 0;
+            }
+        }
+    }
+    if (i < length && (text[i] == 'e' || text[i] == 'E')) {
+        i++;
+        bool negative = i < length && text[i] == '-';
+        if (i < length && (text[i] == '+' || text[i] == '-')) {
+            i++;
+        }
+        size_t exponent_start = i;
+        int64_t written = 0;
+        for (; i < length && text[i] >= '0' && text[i] <= '9'; i++) {
+            if (written < EXPONENT_LIMIT) {
+                written = written * 10 + (text[i] - '0');
+            }
+        }
+        if (i == exponent_start) {
+            return false;
+        }
+        exponent += negative ? -written : written;
+    }
+    if (i != length) {
+        return false;
+    }
+
+#if FLT_EVAL_METHOD == 0
+    // Clinger's fast path: both operands are exact, so the one rounding of
+    // the multiply or divide is the correct one
+    if (!truncated && significand <= FAST_PATH_MAX_SIGNIFICAND &&
+        exponent >= -FAST_PATH_MAX_EXPONENT && exponent <= FAST_PATH_MAX_EXPONENT) {
+        double d = (double)significand;
+        *value = exponent < 0 ? d / exact_powers[-exponent] : d * exact_powers[exponent];
+        return true;
+    }
+#endif
+
+    uint64_t bits = eisel_lemire(exponent, significand);
+    if (truncated && bits != eisel_lemire(exponent, significand + 1)) {
+        // The dropped digits decide the rounding
+        *value = parse_double_slow(text, length);
+        return true;
+    }
+    memcpy(value, &bits, sizeof(double));
+    return true;
+}
@@ -0,0 +1,19 @@
+#ifndef IBERY_NUMBER_H
+#define IBERY_NUMBER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Number literal conversion, done once by the lexer. Integers are exact
+// 64-bit values. Decimal literals with a fraction or an exponent become
+// the nearest double: most take an exact fast path, the rest the
+// Eisel-Lemire algorithm over a table of 128-bit powers of five, and only
+// a literal with more than 19 significant digits that lies too close to a
+// rounding boundary falls back to strtod.
+
+// Function declarations
+bool parse_integer(const char* text, size_t length, int base, uint64_t* value);
+bool parse_double(const char* text, size_t length, double* value);
+
+#endif // IBERY_NUMBER_H
@@ -0,0 +1,192 @@
+#include "optimize.h"
+#include "codegen.h"
+#include "varint.h"
+#include <string.h>
+
+// Pushes an OP_POP can still cancel; the oldest of a longer run of pushes
+// is kept
+#define PUSH_RUN_MAX 16
+
+#define UNUSED_CONSTANT UINT32_MAX
+
+// An instruction of generated code
+typedef struct {
+    uint8_t opcode;
+    bool has_constant;
+    uint32_t constant;
+    size_t length;       // Opcode and operand bytes
+} Instruction;
+
+// Decode the instruction at pos; generated code is well formed
+static void decode(const uint8_t* code, size_t size, size_t pos, Instruction* out) {
+    const uint8_t* operand = code + pos + 1;
+    size_t available = size - pos - 1;
+    out->opcode = code[pos];
+    out->has_constant = false;
+    out->constant = 0;
+    out->length = 1;
+
+    switch (opcode_operand(out->opcode)) {
+        case OPERAND_CONSTANT:
+            out->has_constant = true;
+            out->length += varint_decode_u32(operand, available, &out->constant);
+            break;
+        case OPERAND_INT: {
+            int64_t integer;
+            out->length += varint_decode_i64(operand, available, &integer);
+            break;
+        }
+        case OPERAND_DOUBLE:
+            out->length += DOUBLE_BYTES;
+            break;
+        case OPERAND_INDEX: {
+            uint32_t index;
+            out->length += varint_decode_u32(operand, available, &index);
+            break;
+        }
+        case OPERAND_NONE:
+            break;
+    }
+}
+
+// Check if an instruction only pushes a value. OP_PUSH_IDENTIFIER and
+// OP_LOAD_GLOBAL are not: loading an unbound name or an unassigned global
+// is a runtime error
+static bool is_pure_push(uint8_t opcode) {
+    return opcode == OP_PUSH_INT || opcode == OP_PUSH_DOUBLE || opcode == OP_PUSH_STRING ||
+           opcode == OP_LOAD_LOCAL;
+}
+
+// Drop the code after each OP_RETURN up to the next function entry, and
+// every value that is pushed and then popped. The code only shrinks, so it
+// is rewritten in place
+static void remove_dead_code(CodeGenerator* gen, OptimizeReport* report) {
+    uint8_t* code = gen->instructions;
+    size_t pushes[PUSH_RUN_MAX];
+    int push_count = 0;
+    bool reachable = true;
+    int function = 0;
+    size_t write = 0;
+
+    for (size_t read = 0; read < gen->size;) {
+        while (function < gen->function_count && gen->functions[function].entry == read) {
+            gen->functions[function++].entry = (uint32_t)write;
+            reachable = true;
+            push_count = 0;
+        }
+        Instruction instr;
+        decode(code, gen->size, read, &instr);
+        size_t start = read;
+        read += instr.length;
+
+        if (!reachable) {
+            report->unreachable_bytes += instr.length;
+            if (instr.opcode == OP_RETURN) {
+                report->redundant_returns++;
+            }
+            continue;
+        }
+        if (instr.opcode == OP_POP && push_count > 0) {
+            write = pushes[--push_count];
+            report->push_pop_pairs++;
+            continue;
+        }
+
+        if (!is_pure_push(instr.opcode)) {
+            push_count = 0;
+        } else if (push_count == PUSH_RUN_MAX) {
+            memmove(pushes, pushes + 1, (PUSH_RUN_MAX - 1) * sizeof(size_t));
+            pushes[PUSH_RUN_MAX - 1] = write;
+        } else {
+            pushes[push_count++] = write;
+        }
+        memmove(code + write, code + start, instr.length);
+        write += instr.length;
+        reachable = instr.opcode != OP_RETURN;
+    }
+    gen->size = write;
+}
+
+// Drop the constants that only removed code used, renumbering the rest in
+// pool order. Operands only get shorter, so the code is rewritten in place
+static void remove_unused_constants(CodeGenerator* gen, OptimizeReport* report) {
+    uint32_t* map = (uint32_t*)arena_alloc(gen->arena, (gen->constant_count + 1) * sizeof(uint32_t));
+    for (int i = 0; i < gen->constant_count; i++) {
+        map[i] = UNUSED_CONSTANT;
+    }
+    for (int i = 0; i < gen->function_count; i++) {
+        map[gen->functions[i].name] = 0;
+    }
+    for (int i = 0; i < gen->param_count; i++) {
+        map[gen->params[i]] = 0;
+    }
+    for (int i = 0; i < gen->global_count; i++) {
+        map[gen->globals[i]] = 0;
+    }
+    for (size_t pos = 0; pos < gen->size;) {
+        Instruction instr;
+        decode(gen->instructions, gen->size, pos, &instr);
+        if (instr.has_constant) {
+            map[instr.constant] = 0;
+        }
+        pos += instr.length;
+    }
+
+    int count = 0;
+    for (int i = 0; i < gen->constant_count; i++) {
+        StringId id = gen->constants[i];
+        if (map[i] == UNUSED_CONSTANT) {
+            gen->constant_index[id] = 0;
+            report->constants_removed++;
+            report->constant_bytes_saved += sizeof(ModuleConstant) + intern_length(gen->strings, id) + 1;
+        } else {
+            map[i] = (uint32_t)count;
+            gen->constants[count++] = id;
+            gen->constant_index[id] = (uint32_t)count;
+        }
+    }
+    if (count == gen->constant_count) {
+        return;
+    }
+    gen->constant_count = count;
+
+    for (int i = 0; i < gen->function_count; i++) {
+        gen->functions[i].name = map[gen->functions[i].name];
+    }
+    for (int i = 0; i < gen->param_count; i++) {
+        gen->params[i] = map[gen->params[i]];
+    }
+    for (int i = 0; i < gen->global_count; i++) {
+        gen->globals[i] = map[gen->globals[i]];
+    }
+    uint8_t* code = gen->instructions;
+    int function = 0;
+    size_t write = 0;
+    for (size_t read = 0; read < gen->size;) {
+        while (function < gen->function_count && gen->functions[function].entry == read) {
+            gen->functions[function++].entry = (uint32_t)write;
+        }
+        Instruction instr;
+        decode(code, gen->size, read, &instr);
+        if (instr.has_constant) {
+            code[write] = instr.opcode;
+            write += 1 + varint_encode_u32(code + write + 1, map[instr.constant]);
+        } else {
+            memmove(code + write, code + read, instr.length);
+            write += instr.length;
+        }
+        read += instr.length;
+    }
+    gen->size = write;
+}
+
+// Run the peephole pass over a whole program's code, before build_module
+// lays it out. Constants are already unique per interned string, so
+// merging duplicates comes down to dropping the ones left unused
+void optimize_code(CodeGenerator* gen, OptimizeReport* report) {
+    memset(report, 0, sizeof(OptimizeReport));
+    report->code_bytes_before = gen->size;
+    remove_dead_code(gen, report);
+    remove_unused_constants(gen, report);
+    report->code_bytes_after = gen->size;
+}
@@ -0,0 +1,22 @@
+#ifndef IBERY_OPTIMIZE_H
+#define IBERY_OPTIMIZE_H
+
+#include <stddef.h>
+
+typedef struct CodeGenerator CodeGenerator;
+
+// What the peephole pass removed from a program
+typedef struct {
+    size_t code_bytes_before;
+    size_t code_bytes_after;
+    size_t unreachable_bytes;    // Code after an OP_RETURN, up to the next function
+    size_t redundant_returns;    // OP_RETURNs among the unreachable code
+    size_t push_pop_pairs;       // Values pushed only to be popped
+    size_t constants_removed;    // Pool entries no remaining code refers to
+    size_t constant_bytes_saved; // Their pool entries and text
+} OptimizeReport;
+
+// Function declarations
+void optimize_code(CodeGenerator* gen, OptimizeReport* report);
+
+#endif // IBERY_OPTIMIZE_H
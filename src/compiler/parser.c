@@ -1,133 +1,230 @@
 #include "parser.h"
+#include "fold.h"
+#include "error.h"
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
 
+// Get the next token from the lexer, skipping comments
+static Token next_significant_token(Lexer* lexer) {
+    Token token = get_next_token(lexer);
+    while (token_is_comment(token.type)) {
+        token = get_next_token(lexer);
+    }
+    return token;
+}
+
+// Create an empty AST in the arena
+static AST* create_ast(Arena* arena) {
+    AST* ast = (AST*)arena_alloc(arena, sizeof(AST));
+    ast->arena = arena;
+    ast->nodes = NULL;
+    ast->node_count = 0;
+    ast->node_capacity = 0;
+    ast->children = NULL;
+    ast->child_count = 0;
+    ast->child_capacity = 0;
+    ast->numbers = NULL;
+    ast->number_count = 0;
+    ast->number_capacity = 0;
+    ast->root = NODE_NONE;
+    return ast;
+}
+
 // Create a new parser
 Parser* create_parser(Lexer* lexer) {
+    Parser* parser = create_parser_with_strings(lexer, NULL, NULL);
+    if (parser) {
+        parser->strings = create_intern_table(lexer->arena);
+        parser->owns_strings = true;
+    }
+    return parser;
+}
+
+// Create a parser over a token buffer produced by lex_all
+Parser* create_buffered_parser(Lexer* lexer, const TokenBuffer* tokens) {
+    Parser* parser = create_parser_with_strings(lexer, tokens, NULL);
+    if (parser) {
+        parser->strings = create_intern_table(lexer->arena);
+        parser->owns_strings = true;
+    }
+    return parser;
+}
+
+// Create a parser over a token buffer, or over the lexer when tokens is
+// NULL, that interns into an existing table; the table may outlive the
+// lexer's arena and is not destroyed with the parser
+Parser* create_parser_with_strings(Lexer* lexer, const TokenBuffer* tokens, InternTable* strings) {
     Parser* parser = (Parser*)malloc(sizeof(Parser));
     if (!parser) {
         return NULL;
     }
 
     parser->lexer = lexer;
-    parser->current_token = get_next_token(lexer);
-    parser->peek_token = get_next_token(lexer);
+    parser->arena = lexer->arena;
+    parser->strings = strings;
+    parser->owns_strings = false;
+    parser->ast = create_ast(lexer->arena);
+    parser->scratch = NULL;
+    parser->scratch_count = 0;
+    parser->scratch_capacity = 0;
+    parser->fold_text = NULL;
+    parser->fold_length = 0;
+    parser->fold_capacity = 0;
+    parser->tokens = tokens;
+    parser->index = 0;
+    parser->paren_depth = 0;
+    if (tokens) {
+        parser->current_token = token_at(tokens, 0);
+        parser->peek_token = token_at(tokens, 1);
+    } else {
+        parser->current_token = next_significant_token(lexer);
+        parser->peek_token = next_significant_token(lexer);
+    }
     return parser;
 }
 
-// Destroy a parser
+// Destroy a parser; its nodes and strings are released with the arena
 void destroy_parser(Parser* parser) {
     if (parser) {
-        destroy_token(parser->current_token);
-        destroy_token(parser->peek_token);
+        if (parser->owns_strings) {
+            destroy_intern_table(parser->strings);
+        }
         free(parser);
     }
 }
 
-// Create a new AST node
-ASTNode* create_ast_node(NodeType type, char* value, Token* token) {
-    ASTNode* node = (ASTNode*)malloc(sizeof(ASTNode));
-    if (!node) {
-        return NULL;
-    }
-
-    node->type = type;
-    node->value = value ? strdup(value) : NULL;
-    node->children = NULL;
-    node->children_count = 0;
-    node->token = token;
-    return node;
-}
-
-// Add a child to an AST node
-void add_child(ASTNode* parent, ASTNode* child) {
-    parent->children_count++;
-    parent->children = (ASTNode**)realloc(parent->children, 
-                                        parent->children_count * sizeof(ASTNode*));
-    parent->children[parent->children_count - 1] = child;
+// Push a finished node as a child of the node being parsed
+static void push_child(Parser* parser, NodeIndex child) {
+    parser->scratch = (NodeIndex*)arena_reserve(parser->arena, parser->scratch, &parser->scratch_capacity,
+                                                parser->scratch_count + 1, sizeof(NodeIndex));
+    parser->scratch[parser->scratch_count++] = child;
 }
 
-// Destroy an AST node and its children
-void destroy_ast_node(ASTNode* node) {
-    if (!node) return;
+// Create a new AST node whose children are the scratch entries pushed
+// since mark
+static NodeIndex create_ast_node(Parser* parser, NodeType type, StringId value, size_t position,
+                                 uint32_t mark) {
+    AST* ast = parser->ast;
+    uint32_t count = parser->scratch_count - mark;
 
-    if (node->value) {
-        free(node->value);
+    ast->children = (NodeIndex*)arena_reserve(parser->arena, ast->children, &ast->child_capacity,
+                                              ast->child_count + count, sizeof(NodeIndex));
+    if (count > 0) {
+        memcpy(ast->children + ast->child_count, parser->scratch + mark, count * sizeof(NodeIndex));
+        parser->scratch_count = mark;
     }
 
-    for (int i = 0; i < node->children_count; i++) {
-        destroy_ast_node(node->children[i]);
-    }
+    ast->nodes = (ASTNode*)arena_reserve(parser->arena, ast->nodes, &ast->node_capacity,
+                                         ast->node_count + 1, sizeof(ASTNode));
+    ASTNode* node = &ast->nodes[ast->node_count];
+    node->type = type;
+    node->value = value;
+    node->position = position;
+    node->first_child = ast->child_count;
+    node->child_count = count;
+    ast->child_count += count;
+    return ast->node_count++;
+}
 
-    if (node->children) {
-        free(node->children);
-    }
+// Add a value to the AST's number table; returns its index, which is the
+// value of a number or float literal node
+uint32_t ast_add_number(AST* ast, NumberValue value) {
+    ast->numbers = (NumberValue*)arena_reserve(ast->arena, ast->numbers, &ast->number_capacity,
+                                               ast->number_count + 1, sizeof(NumberValue));
+    ast->numbers[ast->number_count] = value;
+    return ast->number_count++;
+}
 
-    free(node);
+// Intern the text of the current token
+static StringId current_text(Parser* parser) {
+    const Token* token = &parser->current_token;
+    return intern_string(parser->strings, lexer_text(parser->lexer, token->start), token->length);
 }
 
 // Advance to the next token
 void advance_tokens(Parser* parser) {
-    destroy_token(parser->current_token);
+    if (parser->tokens) {
+        parser->index++;
+        parser->current_token = parser->peek_token;
+        parser->peek_token = token_at(parser->tokens, parser->index + 1);
+        return;
+    }
     parser->current_token = parser->peek_token;
-    parser->peek_token = get_next_token(parser->lexer);
+    parser->peek_token = next_significant_token(parser->lexer);
+}
+
+// Look ahead of the current token; beyond the peek token this needs a
+// buffered parser
+Token parser_lookahead(Parser* parser, int distance) {
+    if (distance == 0) {
+        return parser->current_token;
+    }
+    if (parser->tokens) {
+        return token_at(parser->tokens, parser->index + distance);
+    }
+    if (distance > 1) {
+        raise_error("Lookahead of %d tokens requires a buffered parser", distance);
+    }
+    return parser->peek_token;
 }
 
 // Expect a specific token type
 void expect_token(Parser* parser, TokenType expected_type) {
-    if (parser->current_token->type == expected_type) {
+    if (parser->current_token.type == expected_type) {
         advance_tokens(parser);
     } else {
-        fprintf(stderr, "Expected token type %d, got %d at line %d, column %d\n",
-                expected_type, parser->current_token->type,
-                parser->current_token->line, parser->current_token->column);
-        exit(1);
+        size_t line, column;
+        lexer_location(parser->lexer, parser->current_token.start, &line, &column);
+        raise_error("Expected token type %d, got %d at line %zu, column %zu",
+                    expected_type, parser->current_token.type, line, column);
     }
 }
 
 // Parse a function definition
-ASTNode* parse_function_definition(Parser* parser) {
+NodeIndex parse_function_definition(Parser* parser) {
+    uint32_t mark = parser->scratch_count;
+    size_t position = parser->current_token.start;
+    size_t def_column = lexer_column(parser->lexer, position);
     expect_token(parser, TOKEN_DEF);
     
-    char* name = strdup(parser->current_token->value);
+    StringId name = current_text(parser);
     expect_token(parser, TOKEN_IDENTIFIER);
-    expect_token(parser, TOKEN_LPAREN);
-
-    ASTNode* params_node = create_ast_node(NODE_PARAMETERS, NULL, NULL);
-    while (parser->current_token->type != TOKEN_RPAREN) {
-        ASTNode* param = create_ast_node(NODE_IDENTIFIER, 
-                                       parser->current_token->value, 
-                                       parser->current_token);
-        add_child(params_node, param);
+    expect_token(parser, TOKEN_LEFT_PAREN);
+
+    uint32_t params_mark = parser->scratch_count;
+    while (parser->current_token.type != TOKEN_RIGHT_PAREN) {
+        push_child(parser, create_ast_node(parser, NODE_IDENTIFIER,
+                                           current_text(parser),
+                                           parser->current_token.start, parser->scratch_count));
         expect_token(parser, TOKEN_IDENTIFIER);
         
-        if (parser->current_token->type == TOKEN_COMMA) {
+        if (parser->current_token.type == TOKEN_COMMA) {
             expect_token(parser, TOKEN_COMMA);
         }
     }
-    expect_token(parser, TOKEN_RPAREN);
+    expect_token(parser, TOKEN_RIGHT_PAREN);
     expect_token(parser, TOKEN_COLON);
+    push_child(parser, create_ast_node(parser, NODE_PARAMETERS, STRING_ID_NONE, NO_POSITION, params_mark));
 
-    ASTNode* body_node = create_ast_node(NODE_BODY, NULL, NULL);
-    while (parser->current_token->type != TOKEN_EOF) {
-        ASTNode* statement = parse_statement(parser);
-        add_child(body_node, statement);
+    // The body is every statement indented past the `def` keyword
+    uint32_t body_mark = parser->scratch_count;
+    while (parser->current_token.type != TOKEN_EOF &&
+           lexer_column(parser->lexer, parser->current_token.start) > def_column) {
+        push_child(parser, parse_statement(parser));
     }
+    push_child(parser, create_ast_node(parser, NODE_BODY, STRING_ID_NONE, NO_POSITION, body_mark));
 
-    ASTNode* func_def = create_ast_node(NODE_FUNCTION_DEF, name, NULL);
-    add_child(func_def, params_node);
-    add_child(func_def, body_node);
-    return func_def;
+    return create_ast_node(parser, NODE_FUNCTION_DEF, name, position, mark);
 }
 
 // Parse a statement
-ASTNode* parse_statement(Parser* parser) {
-    if (parser->current_token->type == TOKEN_RUN) {
+NodeIndex parse_statement(Parser* parser) {
+    if (parser->current_token.type == TOKEN_RUN) {
         return parse_run_statement(parser);
-    } else if (parser->current_token->type == TOKEN_PRINT) {
+    } else if (parser->current_token.type == TOKEN_PRINT) {
         return parse_print_statement(parser);
-    } else if (parser->current_token->type == TOKEN_RETURN) {
+    } else if (parser->current_token.type == TOKEN_RETURN) {
         return parse_return_statement(parser);
     } else {
         return parse_expression(parser);
@@ -135,97 +232,296 @@ ASTNode* parse_statement(Parser* parser) {
 }
 
 // Parse a run statement
-ASTNode* parse_run_statement(Parser* parser) {
+NodeIndex parse_run_statement(Parser* parser) {
+    uint32_t mark = parser->scratch_count;
+    size_t position = parser->current_token.start;
     expect_token(parser, TOKEN_RUN);
-    bool is_quantum = parser->current_token->type == TOKEN_QUANTUM;
+    bool is_quantum = parser->current_token.type == TOKEN_QUANTUM;
     if (is_quantum) {
         expect_token(parser, TOKEN_QUANTUM);
     }
-    char* command = strdup(parser->current_token->value);
+    StringId command = current_text(parser);
     expect_token(parser, TOKEN_STRING);
 
-    ASTNode* run_node = create_ast_node(NODE_RUN_STATEMENT, command, NULL);
     if (is_quantum) {
-        ASTNode* quantum_node = create_ast_node(NODE_IDENTIFIER, "quantum", NULL);
-        add_child(run_node, quantum_node);
+        push_child(parser, create_ast_node(parser, NODE_IDENTIFIER,
+                                           intern_cstring(parser->strings, "quantum"), NO_POSITION,
+                                           parser->scratch_count));
     }
-    return run_node;
+    return create_ast_node(parser, NODE_RUN_STATEMENT, command, position, mark);
 }
 
 // Parse a print statement
-ASTNode* parse_print_statement(Parser* parser) {
+NodeIndex parse_print_statement(Parser* parser) {
+    uint32_t mark = parser->scratch_count;
+    size_t position = parser->current_token.start;
     expect_token(parser, TOKEN_PRINT);
-    ASTNode* value = parse_expression(parser);
-    ASTNode* print_node = create_ast_node(NODE_PRINT_STATEMENT, NULL, NULL);
-    add_child(print_node, value);
-    return print_node;
+    push_child(parser, parse_expression(parser));
+    return create_ast_node(parser, NODE_PRINT_STATEMENT, STRING_ID_NONE, position, mark);
 }
 
 // Parse a return statement
-ASTNode* parse_return_statement(Parser* parser) {
+NodeIndex parse_return_statement(Parser* parser) {
+    uint32_t mark = parser->scratch_count;
+    size_t position = parser->current_token.start;
     expect_token(parser, TOKEN_RETURN);
-    ASTNode* value = parse_expression(parser);
-    ASTNode* return_node = create_ast_node(NODE_RETURN_STATEMENT, NULL, NULL);
-    add_child(return_node, value);
-    return return_node;
+    push_child(parser, parse_expression(parser));
+    return create_ast_node(parser, NODE_RETURN_STATEMENT, STRING_ID_NONE, position, mark);
 }
 
-// Parse an expression
-ASTNode* parse_expression(Parser* parser) {
-    if (parser->current_token->type == TOKEN_NUMBER) {
-        char* value = strdup(parser->current_token->value);
-        expect_token(parser, TOKEN_NUMBER);
-        return create_ast_node(NODE_NUMBER_LITERAL, value, NULL);
-    } else if (parser->current_token->type == TOKEN_STRING) {
-        char* value = strdup(parser->current_token->value);
+// Binding power of operators, loosest first
+typedef enum {
+    PREC_NONE,
+    PREC_ASSIGNMENT,   // = += -= *= /=, right associative
+    PREC_EQUALITY,     // == !=
+    PREC_COMPARISON,   // < <= > >=
+    PREC_BITWISE_OR,   // |
+    PREC_BITWISE_XOR,  // ^
+    PREC_BITWISE_AND,  // &
+    PREC_SHIFT,        // << >> >>>
+    PREC_TERM,         // + -
+    PREC_FACTOR,       // * / %
+    PREC_UNARY,        // - ! ~
+    PREC_POWER         // **, right associative
+} Precedence;
+
+static NodeIndex parse_precedence(Parser* parser, Precedence min);
+
+// Get the binding power of a token used as an infix operator
+static Precedence infix_precedence(TokenType type) {
+    switch (type) {
+        case TOKEN_EQUALS:
+        case TOKEN_PLUS_EQUALS:
+        case TOKEN_MINUS_EQUALS:
+        case TOKEN_MULTIPLY_EQUALS:
+        case TOKEN_DIVIDE_EQUALS:
+            return PREC_ASSIGNMENT;
+        case TOKEN_EQUAL_EQUAL:
+        case TOKEN_NOT_EQUAL:
+            return PREC_EQUALITY;
+        case TOKEN_LESS:
+        case TOKEN_LESS_EQUAL:
+        case TOKEN_GREATER:
+        case TOKEN_GREATER_EQUAL:
+            return PREC_COMPARISON;
+        case TOKEN_BITWISE_OR:
+            return PREC_BITWISE_OR;
+        case TOKEN_BITWISE_XOR:
+            return PREC_BITWISE_XOR;
+        case TOKEN_BITWISE_AND:
+            return PREC_BITWISE_AND;
+        case TOKEN_LEFT_SHIFT:
+        case TOKEN_RIGHT_SHIFT:
+        case TOKEN_UNSIGNED_RIGHT_SHIFT:
+            return PREC_SHIFT;
+        case TOKEN_PLUS:
+        case TOKEN_MINUS:
+            return PREC_TERM;
+        case TOKEN_MULTIPLY:
+        case TOKEN_DIVIDE:
+        case TOKEN_MODULO:
+            return PREC_FACTOR;
+        case TOKEN_POWER:
+            return PREC_POWER;
+        default:
+            return PREC_NONE;
+    }
+}
+
+// Get the operator a compound assignment applies
+static TokenType compound_operator(TokenType type) {
+    switch (type) {
+        case TOKEN_PLUS_EQUALS: return TOKEN_PLUS;
+        case TOKEN_MINUS_EQUALS: return TOKEN_MINUS;
+        case TOKEN_MULTIPLY_EQUALS: return TOKEN_MULTIPLY;
+        default: return TOKEN_DIVIDE;
+    }
+}
+
+// Get the source text of an operator token, for AST dumps
+const char* operator_text(TokenType type) {
+    switch (type) {
+        case TOKEN_PLUS: return "+";
+        case TOKEN_MINUS: return "-";
+        case TOKEN_MULTIPLY: return "*";
+        case TOKEN_DIVIDE: return "/";
+        case TOKEN_MODULO: return "%";
+        case TOKEN_POWER: return "**";
+        case TOKEN_LEFT_SHIFT: return "<<";
+        case TOKEN_RIGHT_SHIFT: return ">>";
+        case TOKEN_UNSIGNED_RIGHT_SHIFT: return ">>>";
+        case TOKEN_BITWISE_AND: return "&";
+        case TOKEN_BITWISE_OR: return "|";
+        case TOKEN_BITWISE_XOR: return "^";
+        case TOKEN_BITWISE_NOT: return "~";
+        case TOKEN_NOT: return "!";
+        case TOKEN_EQUAL_EQUAL: return "==";
+        case TOKEN_NOT_EQUAL: return "!=";
+        case TOKEN_LESS: return "<";
+        case TOKEN_LESS_EQUAL: return "<=";
+        case TOKEN_GREATER: return ">";
+        case TOKEN_GREATER_EQUAL: return ">=";
+        default: return "?";
+    }
+}
+
+// Report a parse error at a source offset
+__attribute__((noreturn))
+static void parse_error_at(Parser* parser, const char* message, size_t position) {
+    size_t line, column;
+    lexer_location(parser->lexer, position, &line, &column);
+    raise_error("%s at line %zu, column %zu", message, line, column);
+}
+
+// Create a binary operator node, or the literal it folds to
+static NodeIndex make_binary(Parser* parser, TokenType type, NodeIndex left, NodeIndex right) {
+    NodeIndex folded = fold_binary(parser->ast, parser->strings, type, left, right);
+    if (folded != NODE_NONE) {
+        return folded;
+    }
+    uint32_t mark = parser->scratch_count;
+    push_child(parser, left);
+    push_child(parser, right);
+    return create_ast_node(parser, NODE_BINARY_OP, (StringId)type, ast_node(parser->ast, left)->position, mark);
+}
+
+// Parse an assignment to the identifier on its left; `x op= e` is parsed
+// as `x = x op e`
+static NodeIndex parse_assignment(Parser* parser, NodeIndex target) {
+    const ASTNode* node = ast_node(parser->ast, target);
+    if (node->type != NODE_IDENTIFIER) {
+        parse_error_at(parser, "Invalid assignment target", parser->current_token.start);
+    }
+    StringId name = node->value;
+    size_t position = node->position;
+    TokenType type = parser->current_token.type;
+    advance_tokens(parser);
+
+    NodeIndex value = parse_precedence(parser, PREC_ASSIGNMENT);
+    if (type != TOKEN_EQUALS) {
+        value = make_binary(parser, compound_operator(type), target, value);
+    }
+    uint32_t mark = parser->scratch_count;
+    push_child(parser, value);
+    return create_ast_node(parser, NODE_ASSIGNMENT, name, position, mark);
+}
+
+// Parse a literal, name, call, parenthesized expression or prefix operator
+static NodeIndex parse_prefix(Parser* parser) {
+    size_t position = parser->current_token.start;
+    TokenType type = parser->current_token.type;
+    if (type == TOKEN_NUMBER || type == TOKEN_HEX || type == TOKEN_OCTAL || type == TOKEN_BINARY ||
+        type == TOKEN_FLOAT) {
+        uint32_t value = ast_add_number(parser->ast, parser->current_token.number);
+        advance_tokens(parser);
+        return create_ast_node(parser, type == TOKEN_FLOAT ? NODE_FLOAT_LITERAL : NODE_NUMBER_LITERAL,
+                               value, position, parser->scratch_count);
+    } else if (type == TOKEN_STRING) {
+        StringId value = current_text(parser);
         expect_token(parser, TOKEN_STRING);
-        return create_ast_node(NODE_STRING_LITERAL, value, NULL);
-    } else if (parser->current_token->type == TOKEN_IDENTIFIER) {
-        char* name = strdup(parser->current_token->value);
+        return create_ast_node(parser, NODE_STRING_LITERAL, value, position, parser->scratch_count);
+    } else if (type == TOKEN_IDENTIFIER) {
+        StringId name = current_text(parser);
         expect_token(parser, TOKEN_IDENTIFIER);
-        if (parser->current_token->type == TOKEN_LPAREN) {
-            return parse_function_call(parser, name);
+        if (parser->current_token.type == TOKEN_LEFT_PAREN) {
+            return parse_function_call(parser, name, position);
         } else {
-            return create_ast_node(NODE_IDENTIFIER, name, NULL);
+            return create_ast_node(parser, NODE_IDENTIFIER, name, position, parser->scratch_count);
         }
+    } else if (type == TOKEN_LEFT_PAREN) {
+        expect_token(parser, TOKEN_LEFT_PAREN);
+        parser->paren_depth++;
+        NodeIndex inner = parse_expression(parser);
+        parser->paren_depth--;
+        expect_token(parser, TOKEN_RIGHT_PAREN);
+        return inner;
+    } else if (type == TOKEN_MINUS || type == TOKEN_NOT || type == TOKEN_BITWISE_NOT) {
+        advance_tokens(parser);
+        NodeIndex operand = parse_precedence(parser, PREC_UNARY);
+        NodeIndex folded = fold_unary(parser->ast, parser->strings, type, operand);
+        if (folded != NODE_NONE) {
+            return folded;
+        }
+        uint32_t mark = parser->scratch_count;
+        push_child(parser, operand);
+        return create_ast_node(parser, NODE_UNARY_OP, (StringId)type, position, mark);
     } else {
-        fprintf(stderr, "Unexpected token type: %d\n", parser->current_token->type);
-        exit(1);
+        size_t line, column;
+        lexer_location(parser->lexer, position, &line, &column);
+        raise_error("Unexpected token type: %d at line %zu, column %zu",
+                    parser->current_token.type, line, column);
+    }
+}
+
+// Parse operators binding at least as tightly as min. Statements are not
+// terminated, so outside parentheses an operator that starts a line
+// starts the next statement instead of continuing this one
+static NodeIndex parse_precedence(Parser* parser, Precedence min) {
+    NodeIndex left = parse_prefix(parser);
+    FoldRun run = {false, 0};
+    for (;;) {
+        TokenType type = parser->current_token.type;
+        Precedence precedence = infix_precedence(type);
+        if (precedence == PREC_NONE || precedence < min ||
+            (parser->paren_depth == 0 &&
+             lexer_at_line_start(parser->lexer, parser->current_token.start))) {
+            fold_run_end(parser, &run, left);
+            return left;
+        }
+        if (precedence == PREC_ASSIGNMENT) {
+            fold_run_end(parser, &run, left);
+            left = parse_assignment(parser, left);
+            continue;
+        }
+        advance_tokens(parser);
+
+        // ** groups to the right and its exponent may be negated
+        NodeIndex right = parse_precedence(parser, precedence == PREC_POWER ? PREC_UNARY
+                                                                          : (Precedence)(precedence + 1));
+        if (!fold_run_append(parser, &run, type, left, right)) {
+            fold_run_end(parser, &run, left);
+            left = make_binary(parser, type, left, right);
+        }
     }
 }
 
+// Parse an expression
+NodeIndex parse_expression(Parser* parser) {
+    return parse_precedence(parser, PREC_ASSIGNMENT);
+}
+
 // Parse a function call
-ASTNode* parse_function_call(Parser* parser, char* name) {
-    expect_token(parser, TOKEN_LPAREN);
-    ASTNode* args_node = create_ast_node(NODE_PARAMETERS, NULL, NULL);
-    
-    while (parser->current_token->type != TOKEN_RPAREN) {
-        ASTNode* arg = parse_expression(parser);
-        add_child(args_node, arg);
-        if (parser->current_token->type == TOKEN_COMMA) {
+NodeIndex parse_function_call(Parser* parser, StringId name, size_t position) {
+    uint32_t mark = parser->scratch_count;
+    expect_token(parser, TOKEN_LEFT_PAREN);
+
+    uint32_t args_mark = parser->scratch_count;
+    parser->paren_depth++;
+    while (parser->current_token.type != TOKEN_RIGHT_PAREN) {
+        push_child(parser, parse_expression(parser));
+        if (parser->current_token.type == TOKEN_COMMA) {
             expect_token(parser, TOKEN_COMMA);
         }
     }
-    expect_token(parser, TOKEN_RPAREN);
+    parser->paren_depth--;
+    expect_token(parser, TOKEN_RIGHT_PAREN);
+    push_child(parser, create_ast_node(parser, NODE_PARAMETERS, STRING_ID_NONE, NO_POSITION, args_mark));
 
-    ASTNode* call_node = create_ast_node(NODE_FUNCTION_CALL, name, NULL);
-    add_child(call_node, args_node);
-    return call_node;
+    return create_ast_node(parser, NODE_FUNCTION_CALL, name, position, mark);
 }
 
 // Parse the entire program
-ASTNode* parse_program(Parser* parser) {
-    ASTNode* program = create_ast_node(NODE_PROGRAM, NULL, NULL);
+AST* parse_program(Parser* parser) {
+    uint32_t mark = parser->scratch_count;
     
-    while (parser->current_token->type != TOKEN_EOF) {
-        if (parser->current_token->type == TOKEN_DEF) {
-            ASTNode* func_def = parse_function_definition(parser);
-            add_child(program, func_def);
+    while (parser->current_token.type != TOKEN_EOF) {
+        if (parser->current_token.type == TOKEN_DEF) {
+            push_child(parser, parse_function_definition(parser));
         } else {
-            ASTNode* statement = parse_statement(parser);
-            add_child(program, statement);
+            push_child(parser, parse_statement(parser));
         }
     }
     
-    return program;
-} 
\ No newline at end of file
+    parser->ast->root = create_ast_node(parser, NODE_PROGRAM, STRING_ID_NONE, 0, mark);
+    return parser->ast;
+}
@@ -2,6 +2,7 @@
 #define IBERY_PARSER_H
 
 #include "lexer.h"
+#include "intern.h"
 #include <stdbool.h>
 
 // AST Node Types
@@ -12,44 +13,105 @@ typedef enum {
     NODE_RUN_STATEMENT,
     NODE_PRINT_STATEMENT,
     NODE_RETURN_STATEMENT,
-    NODE_NUMBER_LITERAL,
+    NODE_NUMBER_LITERAL,  // value: index of its integer in the AST's numbers
     NODE_STRING_LITERAL,
     NODE_IDENTIFIER,
     NODE_PARAMETERS,
-    NODE_BODY
+    NODE_BODY,
+    NODE_ASSIGNMENT,   // value: target name; child: the value assigned
+    NODE_BINARY_OP,    // value: operator TokenType; children: left, right
+    NODE_UNARY_OP,     // value: operator TokenType; child: operand
+    NODE_FLOAT_LITERAL // value: index of its double in the AST's numbers
 } NodeType;
 
-// AST Node structure
-typedef struct ASTNode {
+// Index of a node in an AST's node array
+typedef uint32_t NodeIndex;
+
+#define NODE_NONE UINT32_MAX
+#define NO_POSITION SIZE_MAX
+
+// AST Node structure; names and literal text are ids in the parser's
+// interning table, number literals index the AST's number table and
+// children are a contiguous range of the child list
+typedef struct {
     NodeType type;
-    char* value;
-    struct ASTNode** children;
-    int children_count;
-    Token* token;
+    StringId value;
+    size_t position;       // Source offset of the node's first token, or NO_POSITION
+    uint32_t first_child;  // Index into the AST's child list
+    uint32_t child_count;
 } ASTNode;
 
-// Parser structure
+// Flat AST: every node in one array, parents refer to children by index.
+// The arrays live in the parser's arena.
+typedef struct {
+    Arena* arena;
+    ASTNode* nodes;
+    uint32_t node_count;
+    size_t node_capacity;
+    NodeIndex* children;
+    uint32_t child_count;
+    size_t child_capacity;
+    NumberValue* numbers;  // Values of number and float literals
+    uint32_t number_count;
+    size_t number_capacity;
+    NodeIndex root;
+} AST;
+
+// Parser structure; reads either from the lexer one token at a time or,
+// when tokens is set, by index from a pre-lexed token buffer
 typedef struct {
     Lexer* lexer;
-    Token* current_token;
-    Token* peek_token;
+    Arena* arena;
+    InternTable* strings;
+    bool owns_strings;   // False when the table is shared with other parses
+    AST* ast;
+    NodeIndex* scratch;  // Children of the nodes being parsed
+    uint32_t scratch_count;
+    size_t scratch_capacity;
+    char* fold_text;     // Text of the string concatenations being folded
+    size_t fold_length;
+    size_t fold_capacity;
+    const TokenBuffer* tokens;
+    size_t index;
+    Token current_token;
+    Token peek_token;
+    uint32_t paren_depth;  // Inside parentheses an operator may start a line
 } Parser;
 
+// Get a node of an AST
+static inline const ASTNode* ast_node(const AST* ast, NodeIndex index) {
+    return &ast->nodes[index];
+}
+
+// Get the i-th child of a node
+static inline NodeIndex ast_child(const AST* ast, const ASTNode* node, uint32_t i) {
+    return ast->children[node->first_child + i];
+}
+
+// Get the value of a number or float literal node
+static inline NumberValue ast_number(const AST* ast, const ASTNode* node) {
+    return ast->numbers[node->value];
+}
+
 // Function declarations
 Parser* create_parser(Lexer* lexer);
+Parser* create_buffered_parser(Lexer* lexer, const TokenBuffer* tokens);
+Parser* create_parser_with_strings(Lexer* lexer, const TokenBuffer* tokens, InternTable* strings);
 void destroy_parser(Parser* parser);
-ASTNode* parse_program(Parser* parser);
-void destroy_ast_node(ASTNode* node);
+AST* parse_program(Parser* parser);
+uint32_t ast_add_number(AST* ast, NumberValue value);
 
 // Helper functions
 void advance_tokens(Parser* parser);
+Token parser_lookahead(Parser* parser, int distance);
 void expect_token(Parser* parser, TokenType expected_type);
-ASTNode* parse_function_definition(Parser* parser);
-ASTNode* parse_statement(Parser* parser);
-ASTNode* parse_expression(Parser* parser);
-ASTNode* parse_function_call(Parser* parser, char* name);
-ASTNode* parse_run_statement(Parser* parser);
-ASTNode* parse_print_statement(Parser* parser);
-ASTNode* parse_return_statement(Parser* parser);
+NodeIndex parse_function_definition(Parser* parser);
+NodeIndex parse_statement(Parser* parser);
+NodeIndex parse_expression(Parser* parser);
+NodeIndex parse_function_call(Parser* parser, StringId name, size_t position);
+NodeIndex parse_run_statement(Parser* parser);
+NodeIndex parse_print_statement(Parser* parser);
+NodeIndex parse_return_statement(Parser* parser);
+const char* operator_text(TokenType type);
 
 #endif // IBERY_PARSER_H 
\ No newline at end of file
@@ -0,0 +1,227 @@
+#include "resolve.h"
+#include <string.h>
+
+#define SCOPE_MIN_CAPACITY 8
+
+// Hash an interned id to a scope slot
+static uint32_t slot_hash(StringId name) {
+    return name * 2654435761u;
+}
+
+// Initialize an empty scope; its table is allocated on the first define
+void scope_init(Scope* scope, SymbolKind kind, Scope* parent) {
+    scope->names = NULL;
+    scope->slots = NULL;
+    scope->count = 0;
+    scope->mask = 0;
+    scope->kind = kind;
+    scope->parent = parent;
+}
+
+// Forget every name of a scope, keeping its table
+static void scope_clear(Scope* scope) {
+    if (scope->count > 0) {
+        memset(scope->names, 0, (scope->mask + 1) * sizeof(StringId));
+        scope->count = 0;
+    }
+}
+
+// Rebuild a scope's table with room for twice as many names
+static void scope_grow(Scope* scope, Arena* arena) {
+    uint32_t capacity = scope->names ? (scope->mask + 1) * 2 : SCOPE_MIN_CAPACITY;
+    StringId* names = (StringId*)arena_alloc(arena, capacity * sizeof(StringId));
+    uint32_t* slots = (uint32_t*)arena_alloc(arena, capacity * sizeof(uint32_t));
+    memset(names, 0, capacity * sizeof(StringId));
+
+    uint32_t mask = capacity - 1;
+    for (uint32_t i = 0; scope->names && i <= scope->mask; i++) {
+        if (scope->names[i] != STRING_ID_NONE) {
+            uint32_t j = slot_hash(scope->names[i]) & mask;
+            while (names[j] != STRING_ID_NONE) {
+                j = (j + 1) & mask;
+            }
+            names[j] = scope->names[i];
+            slots[j] = scope->slots[i];
+        }
+    }
+    scope->names = names;
+    scope->slots = slots;
+    scope->mask = mask;
+}
+
+// Add a name to a scope; returns false, keeping the first slot, if the
+// scope already has it
+bool scope_define(Scope* scope, Arena* arena, StringId name, uint32_t slot) {
+    if (!scope->names || (scope->count + 1) * 2 > scope->mask + 1) {
+        scope_grow(scope, arena);
+    }
+    uint32_t i = slot_hash(name) & scope->mask;
+    while (scope->names[i] != STRING_ID_NONE) {
+        if (scope->names[i] == name) {
+            return false;
+        }
+        i = (i + 1) & scope->mask;
+    }
+    scope->names[i] = name;
+    scope->slots[i] = slot;
+    scope->count++;
+    return true;
+}
+
+// Look a name up in one scope only
+static bool scope_lookup(const Scope* scope, StringId name, Symbol* out) {
+    if (scope->count == 0) {
+        return false;
+    }
+    uint32_t i = slot_hash(name) & scope->mask;
+    while (scope->names[i] != STRING_ID_NONE) {
+        if (scope->names[i] == name) {
+            out->kind = scope->kind;
+            out->index = scope->slots[i];
+            return true;
+        }
+        i = (i + 1) & scope->mask;
+    }
+    return false;
+}
+
+// Look a name up in a scope and then in the scopes enclosing it
+Symbol scope_find(const Scope* scope, StringId name) {
+    Symbol symbol = { SYMBOL_NONE, 0 };
+    for (; scope; scope = scope->parent) {
+        if (scope_lookup(scope, name, &symbol)) {
+            break;
+        }
+    }
+    return symbol;
+}
+
+// Create a resolver for an AST in the arena
+Resolver* create_resolver(Arena* arena, const AST* ast) {
+    Resolver* resolver = (Resolver*)arena_alloc(arena, sizeof(Resolver));
+    resolver->arena = arena;
+    resolver->ast = ast;
+    resolver->symbols = NULL;
+    resolver->symbol_capacity = 0;
+    scope_init(&resolver->functions, SYMBOL_FUNCTION, NULL);
+    scope_init(&resolver->globals, SYMBOL_GLOBAL, NULL);
+    scope_init(&resolver->locals, SYMBOL_LOCAL, NULL);
+    resolver->function_count = 0;
+    resolver->global_names = NULL;
+    resolver->global_count = 0;
+    resolver->global_capacity = 0;
+    resolver->frame_size = 0;
+    resolver->resolve_globals = true;
+    return resolver;
+}
+
+// Give the next function table entry a name
+void declare_function(Resolver* resolver, StringId name) {
+    scope_define(&resolver->functions, resolver->arena, name, resolver->function_count++);
+}
+
+// Give the next global index to a name that does not have one yet
+void declare_global(Resolver* resolver, StringId name) {
+    if (!scope_define(&resolver->globals, resolver->arena, name, resolver->global_count)) {
+        return;
+    }
+    resolver->global_names = (StringId*)arena_reserve(resolver->arena, resolver->global_names,
+                                                      &resolver->global_capacity,
+                                                      resolver->global_count + 1, sizeof(StringId));
+    resolver->global_names[resolver->global_count++] = name;
+}
+
+// Declare the globals a top-level statement assigns, in the order its
+// stores are emitted: an assignment's value before its target
+static void collect_globals(Resolver* resolver, NodeIndex index) {
+    const ASTNode* node = ast_node(resolver->ast, index);
+    for (uint32_t i = 0; i < node->child_count; i++) {
+        collect_globals(resolver, ast_child(resolver->ast, node, i));
+    }
+    if (node->type == NODE_ASSIGNMENT) {
+        declare_global(resolver, node->value);
+    }
+}
+
+// Resolve an assignment target. A function's locals get a slot on their
+// first assignment; at the top level the target is a global
+static Symbol resolve_target(Resolver* resolver, Scope* locals, StringId name) {
+    Symbol symbol = { SYMBOL_NONE, 0 };
+    if (!locals) {
+        return resolver->resolve_globals ? scope_find(&resolver->globals, name) : symbol;
+    }
+    if (!scope_lookup(locals, name, &symbol)) {
+        scope_define(locals, resolver->arena, name, resolver->frame_size);
+        symbol.kind = SYMBOL_LOCAL;
+        symbol.index = resolver->frame_size++;
+    }
+    return symbol;
+}
+
+// Resolve the names used by an expression or statement; locals is NULL
+// for top-level code. Children are resolved first, so an assignment's
+// value still sees the names as they were before it
+static void resolve_node(Resolver* resolver, Scope* locals, NodeIndex index) {
+    const ASTNode* node = ast_node(resolver->ast, index);
+    for (uint32_t i = 0; i < node->child_count; i++) {
+        resolve_node(resolver, locals, ast_child(resolver->ast, node, i));
+    }
+
+    Symbol none = { SYMBOL_NONE, 0 };
+    if (node->type == NODE_FUNCTION_CALL) {
+        resolver->symbols[index] = resolver->resolve_globals
+                                       ? scope_find(&resolver->functions, node->value) : none;
+    } else if (node->type == NODE_IDENTIFIER) {
+        const Scope* scope = locals ? locals : resolver->resolve_globals ? &resolver->globals : NULL;
+        resolver->symbols[index] = scope_find(scope, node->value);
+    } else if (node->type == NODE_ASSIGNMENT) {
+        resolver->symbols[index] = resolve_target(resolver, locals, node->value);
+    }
+}
+
+// Resolve the names used by a top-level item. A function's parameters are
+// its first local slots; top-level code has no locals, only globals
+void resolve_item(Resolver* resolver, NodeIndex item) {
+    const AST* ast = resolver->ast;
+    resolver->symbols = (Symbol*)arena_reserve(resolver->arena, resolver->symbols, &resolver->symbol_capacity,
+                                               ast->node_count, sizeof(Symbol));
+
+    const ASTNode* node = ast_node(ast, item);
+    if (node->type != NODE_FUNCTION_DEF) {
+        resolve_node(resolver, NULL, item);
+        return;
+    }
+
+    Scope* locals = &resolver->locals;
+    scope_clear(locals);
+    locals->parent = resolver->resolve_globals ? &resolver->globals : NULL;
+    const ASTNode* params = ast_node(ast, ast_child(ast, node, 0));
+    for (uint32_t i = 0; i < params->child_count; i++) {
+        scope_define(locals, resolver->arena, ast_node(ast, ast_child(ast, params, i))->value, i);
+    }
+    resolver->frame_size = params->child_count;
+    const ASTNode* body = ast_node(ast, ast_child(ast, node, 1));
+    for (uint32_t i = 0; i < body->child_count; i++) {
+        resolve_node(resolver, locals, ast_child(ast, body, i));
+    }
+    Symbol frame = { SYMBOL_LOCAL, resolver->frame_size };
+    resolver->symbols[item] = frame;
+}
+
+// Declare every function and global of a program, then resolve all of
+// its items
+void resolve_program(Resolver* resolver) {
+    const AST* ast = resolver->ast;
+    const ASTNode* program = ast_node(ast, ast->root);
+    for (uint32_t i = 0; i < program->child_count; i++) {
+        NodeIndex item = ast_child(ast, program, i);
+        if (ast_node(ast, item)->type == NODE_FUNCTION_DEF) {
+            declare_function(resolver, ast_node(ast, item)->value);
+        } else {
+            collect_globals(resolver, item);
+        }
+    }
+    for (uint32_t i = 0; i < program->child_count; i++) {
+        resolve_item(resolver, ast_child(ast, program, i));
+    }
+}
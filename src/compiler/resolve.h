@@ -0,0 +1,77 @@
+#ifndef IBERY_RESOLVE_H
+#define IBERY_RESOLVE_H
+
+#include "parser.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+// What a name resolves to
+typedef enum {
+    SYMBOL_NONE,      // Not defined anywhere the reference can see
+    SYMBOL_FUNCTION,  // Index into the module's function table
+    SYMBOL_LOCAL,     // Slot in the current call frame; parameters come first
+    SYMBOL_GLOBAL     // Index into the module's global table
+} SymbolKind;
+
+// A resolved name
+typedef struct {
+    SymbolKind kind;
+    uint32_t index;
+} Symbol;
+
+// A scope: an open-addressed hash of interned names to slots, chained to
+// the enclosing scope. Names of one scope all resolve to the same kind
+typedef struct Scope {
+    StringId* names;   // STRING_ID_NONE marks an empty slot
+    uint32_t* slots;
+    uint32_t count;
+    uint32_t mask;
+    SymbolKind kind;
+    struct Scope* parent;
+} Scope;
+
+// Name resolution over an AST. Every call, identifier and assignment node
+// gets a Symbol; the program scope maps function names to function table
+// indices in definition order, the first definition of a name winning.
+// Names assigned by top-level statements are globals, numbered in the order
+// their stores are emitted. Inside a function an assignment to a name that
+// is not yet local gives it the next frame slot after the parameters, and a
+// definition's own Symbol holds its frame size. Everything lives in the arena
+typedef struct {
+    Arena* arena;
+    const AST* ast;
+    Symbol* symbols;        // Indexed by node
+    size_t symbol_capacity;
+    Scope functions;
+    Scope globals;
+    Scope locals;           // Locals of the function being resolved
+    uint32_t function_count;
+    StringId* global_names; // By global index
+    uint32_t global_count;
+    size_t global_capacity;
+    uint32_t frame_size;    // Slots of the function being resolved
+    bool resolve_globals;   // False leaves calls and globals to be bound at link time
+} Resolver;
+
+// Function declarations
+void scope_init(Scope* scope, SymbolKind kind, Scope* parent);
+bool scope_define(Scope* scope, Arena* arena, StringId name, uint32_t slot);
+Symbol scope_find(const Scope* scope, StringId name);
+Resolver* create_resolver(Arena* arena, const AST* ast);
+void declare_function(Resolver* resolver, StringId name);
+void declare_global(Resolver* resolver, StringId name);
+void resolve_item(Resolver* resolver, NodeIndex item);
+void resolve_program(Resolver* resolver);
+
+// Get the symbol of a call, identifier or assignment node
+static inline Symbol resolved_symbol(const Resolver* resolver, NodeIndex node) {
+    return resolver->symbols[node];
+}
+
+// Get the number of frame slots, parameters included, of a function
+// definition node
+static inline uint32_t resolved_frame_size(const Resolver* resolver, NodeIndex def) {
+    return resolver->symbols[def].index;
+}
+
+#endif // IBERY_RESOLVE_H
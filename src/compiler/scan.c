@@ -0,0 +1,211 @@
+#include "scan.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__) && defined(__SSE2__)
+#define SCAN_X86 1
+#include <immintrin.h>
+#endif
+
+// Check if a byte belongs to a class
+static inline int in_class(ScanClass cls, unsigned char c) {
+    switch (cls) {
+        case SCAN_WHITESPACE:
+            return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+        case SCAN_IDENTIFIER:
+            return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+                   (c >= '0' && c <= '9') || c == '_';
+        case SCAN_STRING_BODY:
+            return c != '"';
+        case SCAN_LINE_COMMENT:
+            return c != '\n';
+        case SCAN_BLOCK_COMMENT:
+            return c != ']';
+        default:
+            return 0;
+    }
+}
+
+// Byte-at-a-time scan from offset i, used as the fallback and for tails
+static inline size_t scan_scalar(ScanClass cls, const char* text, size_t length, size_t i) {
+    while (i < length && in_class(cls, (unsigned char)text[i])) {
+        i++;
+    }
+    return i;
+}
+
+#define DEFINE_SCALAR(name, cls) \
+    static size_t name(const char* text, size_t length) { \
+        return scan_scalar(cls, text, length, 0); \
+    }
+
+DEFINE_SCALAR(scalar_whitespace, SCAN_WHITESPACE)
+DEFINE_SCALAR(scalar_identifier, SCAN_IDENTIFIER)
+DEFINE_SCALAR(scalar_string_body, SCAN_STRING_BODY)
+DEFINE_SCALAR(scalar_line_comment, SCAN_LINE_COMMENT)
+DEFINE_SCALAR(scalar_block_comment, SCAN_BLOCK_COMMENT)
+
+static const Scanner scalar_scanner = {
+    "scalar",
+    {scalar_whitespace, scalar_identifier, scalar_string_body,
+     scalar_line_comment, scalar_block_comment}
+};
+
+#ifdef SCAN_X86
+
+// 16-byte masks: bit i is set when byte i is in the class
+static inline uint32_t sse2_class_mask(ScanClass cls, __m128i v) {
+    switch (cls) {
+        case SCAN_WHITESPACE: {
+            __m128i m = _mm_or_si128(
+                _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(' ')),
+                             _mm_cmpeq_epi8(v, _mm_set1_epi8('\t'))),
+                _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('\n')),
+                             _mm_cmpeq_epi8(v, _mm_set1_epi8('\r'))));
+            return (uint32_t)_mm_movemask_epi8(m);
+        }
+        case SCAN_IDENTIFIER: {
+            // Unsigned range checks via the sign-flip trick
+            const __m128i flip = _mm_set1_epi8((char)0x80);
+            __m128i lower = _mm_or_si128(v, _mm_set1_epi8(0x20));
+            __m128i letter = _mm_cmplt_epi8(
+                _mm_xor_si128(_mm_sub_epi8(lower, _mm_set1_epi8('a')), flip),
+                _mm_set1_epi8((char)(26 ^ 0x80)));
+            __m128i digit = _mm_cmplt_epi8(
+                _mm_xor_si128(_mm_sub_epi8(v, _mm_set1_epi8('0')), flip),
+                _mm_set1_epi8((char)(10 ^ 0x80)));
+            __m128i underscore = _mm_cmpeq_epi8(v, _mm_set1_epi8('_'));
+            return (uint32_t)_mm_movemask_epi8(_mm_or_si128(_mm_or_si128(letter, digit), underscore));
+        }
+        case SCAN_STRING_BODY:
+            return ~(uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8('"'))) & 0xFFFF;
+        case SCAN_LINE_COMMENT:
+            return ~(uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8('\n'))) & 0xFFFF;
+        case SCAN_BLOCK_COMMENT:
+            return ~(uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8(']'))) & 0xFFFF;
+        default:
+            return 0;
+    }
+}
+
+// Scan 16 bytes at a time with SSE2
+static inline size_t scan_sse2(ScanClass cls, const char* text, size_t length) {
+    size_t i = 0;
+    while (i + 16 <= length) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(text + i));
+        uint32_t outside = ~sse2_class_mask(cls, v) & 0xFFFF;
+        if (outside) {
+            return i + __builtin_ctz(outside);
+        }
+        i += 16;
+    }
+    return scan_scalar(cls, text, length, i);
+}
+
+#define DEFINE_SSE2(name, cls) \
+    static size_t name(const char* text, size_t length) { \
+        return scan_sse2(cls, text, length); \
+    }
+
+DEFINE_SSE2(sse2_whitespace, SCAN_WHITESPACE)
+DEFINE_SSE2(sse2_identifier, SCAN_IDENTIFIER)
+DEFINE_SSE2(sse2_string_body, SCAN_STRING_BODY)
+DEFINE_SSE2(sse2_line_comment, SCAN_LINE_COMMENT)
+DEFINE_SSE2(sse2_block_comment, SCAN_BLOCK_COMMENT)
+
+static const Scanner sse2_scanner = {
+    "sse2",
+    {sse2_whitespace, sse2_identifier, sse2_string_body,
+     sse2_line_comment, sse2_block_comment}
+};
+
+#define AVX2 __attribute__((target("avx2")))
+
+// 32-byte masks: bit i is set when byte i is in the class
+static inline AVX2 uint32_t avx2_class_mask(ScanClass cls, __m256i v) {
+    switch (cls) {
+        case SCAN_WHITESPACE: {
+            __m256i m = _mm256_or_si256(
+                _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(' ')),
+                                _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\t'))),
+                _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n')),
+                                _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\r'))));
+            return (uint32_t)_mm256_movemask_epi8(m);
+        }
+        case SCAN_IDENTIFIER: {
+            const __m256i flip = _mm256_set1_epi8((char)0x80);
+            __m256i lower = _mm256_or_si256(v, _mm256_set1_epi8(0x20));
+            __m256i letter = _mm256_cmpgt_epi8(
+                _mm256_set1_epi8((char)(26 ^ 0x80)),
+                _mm256_xor_si256(_mm256_sub_epi8(lower, _mm256_set1_epi8('a')), flip));
+            __m256i digit = _mm256_cmpgt_epi8(
+                _mm256_set1_epi8((char)(10 ^ 0x80)),
+                _mm256_xor_si256(_mm256_sub_epi8(v, _mm256_set1_epi8('0')), flip));
+            __m256i underscore = _mm256_cmpeq_epi8(v, _mm256_set1_epi8('_'));
+            return (uint32_t)_mm256_movemask_epi8(
+                _mm256_or_si256(_mm256_or_si256(letter, digit), underscore));
+        }
+        case SCAN_STRING_BODY:
+            return ~(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('"')));
+        case SCAN_LINE_COMMENT:
+            return ~(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n')));
+        case SCAN_BLOCK_COMMENT:
+            return ~(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(']')));
+        default:
+            return 0;
+    }
+}
+
+// Scan 32 bytes at a time with AVX2
+static inline AVX2 size_t scan_avx2(ScanClass cls, const char* text, size_t length) {
+    size_t i = 0;
+    while (i + 32 <= length) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(text + i));
+        uint32_t outside = ~avx2_class_mask(cls, v);
+        if (outside) {
+            return i + __builtin_ctz(outside);
+        }
+        i += 32;
+    }
+    return scan_scalar(cls, text, length, i);
+}
+
+#define DEFINE_AVX2(name, cls) \
+    static AVX2 size_t name(const char* text, size_t length) { \
+        return scan_avx2(cls, text, length); \
+    }
+
+DEFINE_AVX2(avx2_whitespace, SCAN_WHITESPACE)
+DEFINE_AVX2(avx2_identifier, SCAN_IDENTIFIER)
+DEFINE_AVX2(avx2_string_body, SCAN_STRING_BODY)
+DEFINE_AVX2(avx2_line_comment, SCAN_LINE_COMMENT)
+DEFINE_AVX2(avx2_block_comment, SCAN_BLOCK_COMMENT)
+
+static const Scanner avx2_scanner = {
+    "avx2",
+    {avx2_whitespace, avx2_identifier, avx2_string_body,
+     avx2_line_comment, avx2_block_comment}
+};
+
+#endif // SCAN_X86
+
+// Pick the widest scanner the CPU supports; IBERY_SIMD=scalar|sse2|avx2
+// forces a narrower one
+const Scanner* select_scanner(void) {
+    const char* forced = getenv("IBERY_SIMD");
+    if (forced && strcmp(forced, "scalar") == 0) {
+        return &scalar_scanner;
+    }
+#ifdef SCAN_X86
+    if (forced && strcmp(forced, "sse2") == 0) {
+        return &sse2_scanner;
+    }
+    if (__builtin_cpu_supports("avx2")) {
+        return &avx2_scanner;
+    }
+    return &sse2_scanner;
+#else
+    return &scalar_scanner;
+#endif
+}
@@ -0,0 +1,26 @@
+#ifndef IBERY_SCAN_H
+#define IBERY_SCAN_H
+
+#include <stddef.h>
+
+// Character classes the lexer skips in bulk
+typedef enum {
+    SCAN_WHITESPACE,      // Run of ' ', '\t', '\r', '\n'
+    SCAN_IDENTIFIER,      // Run of [A-Za-z0-9_]
+    SCAN_STRING_BODY,     // Run up to the next '"'
+    SCAN_LINE_COMMENT,    // Run up to the next '\n'
+    SCAN_BLOCK_COMMENT,   // Run up to the next ']'
+    SCAN_CLASS_COUNT
+} ScanClass;
+
+// Scanner implementation for one instruction set; each function returns
+// the length of the run of class bytes at the start of text
+typedef struct {
+    const char* name;
+    size_t (*scan[SCAN_CLASS_COUNT])(const char* text, size_t length);
+} Scanner;
+
+// Function declarations
+const Scanner* select_scanner(void);
+
+#endif // IBERY_SCAN_H
@@ -0,0 +1,236 @@
+#include "session.h"
+#include "lexer.h"
+#include "parser.h"
+#include "codegen.h"
+#include "module.h"
+#include <stdlib.h>
+#include <string.h>
+
+// Create a session; cache may be NULL
+CompilerSession* create_compiler_session(Cache* cache) {
+    CompilerSession* session = (CompilerSession*)calloc(1, sizeof(CompilerSession));
+    if (!session) {
+        return NULL;
+    }
+    session->arena = create_arena(0);
+    session->string_arena = create_arena(0);
+    session->strings = session->string_arena ? create_intern_table(session->string_arena) : NULL;
+    session->cache = cache;
+    session->vm = create_vm();
+    if (!session->arena || !session->strings || !session->vm) {
+        destroy_compiler_session(session);
+        return NULL;
+    }
+    return session;
+}
+
+// Destroy a session and every module it still holds
+void destroy_compiler_session(CompilerSession* session) {
+    if (!session) return;
+
+    for (int i = 0; i < SESSION_RECENT_MODULES; i++) {
+        free(session->recent[i].module);
+    }
+    for (int i = 0; i < SESSION_DOCUMENTS; i++) {
+        free(session->documents[i].name);
+        destroy_incremental_program(session->documents[i].program);
+    }
+    destroy_vm(session->vm);
+    destroy_intern_table(session->strings);
+    destroy_arena(session->string_arena);
+    destroy_arena(session->arena);
+    free(session);
+}
+
+// Find a recent module by key
+static SessionModule* find_recent(CompilerSession* session, CacheKey key) {
+    for (int i = 0; i < SESSION_RECENT_MODULES; i++) {
+        SessionModule* entry = &session->recent[i];
+        if (entry->last_use && entry->key.high == key.high && entry->key.low == key.low) {
+            entry->last_use = ++session->clock;
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+// Keep a copy of a module, replacing the least recently used one
+static SessionModule* remember(CompilerSession* session, CacheKey key, const uint8_t* module, size_t size) {
+    SessionModule* entry = &session->recent[0];
+    for (int i = 1; i < SESSION_RECENT_MODULES && entry->last_use; i++) {
+        if (session->recent[i].last_use < entry->last_use) {
+            entry = &session->recent[i];
+        }
+    }
+    free(entry->module);
+    entry->module = (uint8_t*)malloc(size);
+    if (!entry->module) {
+        entry->last_use = 0;
+        return NULL;
+    }
+    memcpy(entry->module, module, size);
+    entry->key = key;
+    entry->size = size;
+    entry->last_use = ++session->clock;
+    return entry;
+}
+
+// Find a document by name, starting it over in the least recently used
+// slot if it is not open
+static SessionDocument* find_document(CompilerSession* session, const char* name) {
+    SessionDocument* document = &session->documents[0];
+    for (int i = 0; i < SESSION_DOCUMENTS; i++) {
+        SessionDocument* candidate = &session->documents[i];
+        if (candidate->last_use && strcmp(candidate->name, name) == 0) {
+            candidate->last_use = ++session->clock;
+            return candidate;
+        }
+        if (candidate->last_use < document->last_use) {
+            document = candidate;
+        }
+    }
+
+    free(document->name);
+    destroy_incremental_program(document->program);
+    document->name = strdup(name);
+    document->program = create_incremental_program();
+    if (!document->name || !document->program) {
+        document->last_use = 0;
+        return NULL;
+    }
+    document->last_use = ++session->clock;
+    return document;
+}
+
+// Fill in a successful result
+static bool succeed(CompileResult* result, const SessionModule* entry) {
+    result->ok = true;
+    result->error[0] = '\0';
+    result->module = entry->module;
+    result->module_size = entry->size;
+    return true;
+}
+
+// Fill in a failed result
+static bool fail(CompilerSession* session, CompileResult* result, const char* message) {
+    session->errors++;
+    result->ok = false;
+    snprintf(result->error, sizeof(result->error), "%s", message);
+    result->module = NULL;
+    result->module_size = 0;
+    return false;
+}
+
+// Compile a new version of a document against the previous one
+static uint8_t* compile_document(CompilerSession* session, SessionDocument* document,
+                                 const char* source, size_t length, size_t* size) {
+    IncrementalProgram* program = document->program;
+    uint8_t* module = incremental_compile(program, source, length, size);
+    session->reparsed_items += program->reparsed_items;
+    session->reused_items += program->reused_items;
+    return module;
+}
+
+// Compile source[0, length) to a module; source[length] must be '\0'.
+// Unchanged sources are served from memory or the disk cache, and a named
+// source is compiled incrementally as a document
+bool session_compile(CompilerSession* session, const char* name, const char* source, size_t length,
+                     CompileResult* result) {
+    session->requests++;
+    CacheKey key = session->cache ? cache_key(session->cache, source, length, 0)
+                                  : cache_hash(source, length, MODULE_VERSION);
+    SessionModule* entry = find_recent(session, key);
+    if (entry) {
+        session->memory_hits++;
+        return succeed(result, entry);
+    }
+    SourceFile cached;
+    if (session->cache && cache_lookup(session->cache, key, &cached)) {
+        entry = remember(session, key, (const uint8_t*)cached.text, cached.length);
+        source_release(&cached);
+        if (entry) {
+            session->disk_hits++;
+            return succeed(result, entry);
+        }
+    }
+    SessionDocument* document = NULL;
+    if (name) {
+        document = find_document(session, name);
+        if (!document) {
+            return fail(session, result, "Out of memory");
+        }
+    }
+
+    // Everything but the lexer, parser and generator lives in the arena,
+    // so those are all an error has to clean up
+    session->compiles++;
+    Lexer* volatile lexer = NULL;
+    Parser* volatile parser = NULL;
+    CodeGenerator* volatile gen = NULL;
+    ErrorHandler handler;
+    error_push_handler(&handler);
+    if (setjmp(handler.jump) == 0) {
+        size_t size;
+        uint8_t* module;
+        if (document) {
+            module = compile_document(session, document, source, length, &size);
+        } else {
+            lexer = create_lexer_from_buffer(source, length, session->arena);
+            TokenBuffer* tokens = lex_all(lexer);
+            parser = create_parser_with_strings(lexer, tokens, session->strings);
+            AST* ast = parse_program(parser);
+            gen = create_code_generator(session->arena, session->strings);
+            module = generate_code(gen, ast, &size);
+        }
+        error_pop_handler(&handler);
+
+        entry = remember(session, key, module, size);
+        if (entry && session->cache) {
+            cache_store(session->cache, key, module, size);
+        }
+    }
+    destroy_code_generator(gen);
+    destroy_parser(parser);
+    destroy_lexer(lexer);
+    arena_reset(session->arena);
+
+    if (session->strings->count > SESSION_MAX_STRINGS) {
+        destroy_intern_table(session->strings);
+        arena_reset(session->string_arena);
+        session->strings = create_intern_table(session->string_arena);
+    }
+
+    if (handler.message[0]) {
+        return fail(session, result, handler.message);
+    }
+    if (!entry) {
+        return fail(session, result, "Out of memory");
+    }
+    return succeed(result, entry);
+}
+
+// Compile and execute source, writing its output to output
+bool session_run(CompilerSession* session, const char* name, const char* source, size_t length,
+                 FILE* output, CompileResult* result) {
+    if (!session_compile(session, name, source, length, result)) {
+        return false;
+    }
+
+    ErrorHandler handler;
+    error_push_handler(&handler);
+    if (setjmp(handler.jump) == 0) {
+        vm_set_output(session->vm, output);
+        vm_execute(session->vm, result->module, result->module_size);
+        error_pop_handler(&handler);
+        return true;
+    }
+    return fail(session, result, handler.message);
+}
+
+// Write the session counters as a JSON object
+void session_write_stats(const CompilerSession* session, FILE* out) {
+    fprintf(out, "{\"requests\": %zu, \"compiles\": %zu, \"memory_hits\": %zu, \"disk_hits\": %zu, "
+            "\"errors\": %zu, \"strings\": %d, \"items_reparsed\": %zu, \"items_reused\": %zu}\n",
+            session->requests, session->compiles, session->memory_hits, session->disk_hits,
+            session->errors, session->strings->count - 1, session->reparsed_items, session->reused_items);
+}
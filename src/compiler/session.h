@@ -0,0 +1,72 @@
+#ifndef IBERY_SESSION_H
+#define IBERY_SESSION_H
+
+#include "cache.h"
+#include "error.h"
+#include "incremental.h"
+#include "intern.h"
+#include "vm.h"
+#include <stdio.h>
+
+#define SESSION_RECENT_MODULES 32
+#define SESSION_MAX_STRINGS 65536
+#define SESSION_DOCUMENTS 8
+
+// A module compiled earlier in a session
+typedef struct {
+    CacheKey key;
+    uint8_t* module;
+    size_t size;
+    uint64_t last_use;  // 0 for an empty slot
+} SessionModule;
+
+// A named source compiled incrementally across requests
+typedef struct {
+    char* name;
+    IncrementalProgram* program;
+    uint64_t last_use;  // 0 for an empty slot
+} SessionDocument;
+
+// Long-lived compiler state for embedding and for the daemon. Errors are
+// returned instead of exiting. Between requests the session keeps its
+// arena blocks, an interning table, a VM and the most recent modules; the
+// table is started over once it holds SESSION_MAX_STRINGS strings. Named
+// sources are documents: each new version of one is compiled against the
+// previous version, reusing the code of every item the edit did not touch
+typedef struct {
+    Arena* arena;         // Per-request memory, reset after each request
+    Arena* string_arena;  // Backs the interning table
+    InternTable* strings;
+    Cache* cache;         // Optional on-disk cache, not owned
+    VM* vm;
+    SessionModule recent[SESSION_RECENT_MODULES];
+    SessionDocument documents[SESSION_DOCUMENTS];
+    uint64_t clock;
+
+    size_t requests;
+    size_t compiles;
+    size_t memory_hits;
+    size_t disk_hits;
+    size_t errors;
+    size_t reparsed_items;
+    size_t reused_items;
+} CompilerSession;
+
+// Outcome of a session request
+typedef struct {
+    bool ok;
+    char error[ERROR_MESSAGE_MAX];  // Set when ok is false
+    const uint8_t* module;          // Owned by the session; valid until the next request
+    size_t module_size;
+} CompileResult;
+
+// Function declarations
+CompilerSession* create_compiler_session(Cache* cache);
+void destroy_compiler_session(CompilerSession* session);
+bool session_compile(CompilerSession* session, const char* name, const char* source, size_t length,
+                     CompileResult* result);
+bool session_run(CompilerSession* session, const char* name, const char* source, size_t length,
+                 FILE* output, CompileResult* result);
+void session_write_stats(const CompilerSession* session, FILE* out);
+
+#endif // IBERY_SESSION_H
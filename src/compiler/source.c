@@ -0,0 +1,57 @@
+#include "source.h"
+#include <stdio.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// Map a regular file read-only with a zero byte after its last byte.
+// Returns false if fd is not a regular file, so it has to be streamed.
+bool source_map(int fd, SourceFile* source) {
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+        return false;
+    }
+
+    size_t length = (size_t)st.st_size;
+    if (length == 0) {
+        source->text = "";
+        source->length = 0;
+        source->mapping_size = 0;
+        return true;
+    }
+
+    // Reserve one extra zero page, then map the file over the front of it.
+    // The kernel zero-fills the rest of the file's last page, so there is
+    // always a '\0' at text[length] even when the size is page aligned.
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    size_t mapping_size = (length / page + 1) * page;
+    void* reserved = mmap(NULL, mapping_size, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (reserved == MAP_FAILED) {
+        return false;
+    }
+    void* text = mmap(reserved, length, PROT_READ, MAP_PRIVATE | MAP_FIXED, fd, 0);
+    if (text == MAP_FAILED) {
+        munmap(reserved, mapping_size);
+        return false;
+    }
+
+    source->text = (const char*)text;
+    source->length = length;
+    source->mapping_size = mapping_size;
+    return true;
+}
+
+// Unmap a source mapped by source_map
+void source_release(SourceFile* source) {
+    if (source->mapping_size) {
+        munmap((void*)source->text, source->mapping_size);
+    }
+    source->text = NULL;
+    source->length = 0;
+    source->mapping_size = 0;
+}
+
+// LexerReader over a stdio stream; userdata is the FILE*
+size_t source_read_stream(void* userdata, char* buffer, size_t capacity) {
+    return fread(buffer, 1, capacity, (FILE*)userdata);
+}
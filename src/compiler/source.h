@@ -0,0 +1,19 @@
+#ifndef IBERY_SOURCE_H
+#define IBERY_SOURCE_H
+
+#include <stddef.h>
+#include <stdbool.h>
+
+// Source text mapped from a regular file; text[length] is always '\0'
+typedef struct {
+    const char* text;
+    size_t length;
+    size_t mapping_size;  // Bytes to unmap, 0 if nothing is mapped
+} SourceFile;
+
+// Function declarations
+bool source_map(int fd, SourceFile* source);
+void source_release(SourceFile* source);
+size_t source_read_stream(void* userdata, char* buffer, size_t capacity);
+
+#endif // IBERY_SOURCE_H
@@ -0,0 +1,111 @@
+#include "stats.h"
+#include <string.h>
+#include <time.h>
+
+static const char* phase_names[PHASE_COUNT] = {
+    [PHASE_LEX] = "lex",
+    [PHASE_PARSE] = "parse",
+    [PHASE_CODEGEN] = "codegen"
+};
+
+// Get a monotonic timestamp in seconds
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Arena hook: charge an allocation to the running phase
+static void count_allocation(size_t size, void* userdata) {
+    CompileStats* stats = (CompileStats*)userdata;
+    if (stats->current_phase >= 0) {
+        PhaseStats* phase = &stats->phases[stats->current_phase];
+        phase->allocations++;
+        phase->allocated_bytes += size;
+    }
+}
+
+// Reset all counters
+void stats_init(CompileStats* stats) {
+    memset(stats, 0, sizeof(CompileStats));
+    stats->current_phase = -1;
+}
+
+// Count every allocation made from an arena
+void stats_attach(CompileStats* stats, Arena* arena) {
+    arena_set_hook(arena, count_allocation, stats);
+}
+
+// Start timing a phase
+void stats_begin_phase(CompileStats* stats, CompilePhase phase) {
+    stats->current_phase = phase;
+    stats->phase_start = now_seconds();
+}
+
+// Stop timing the running phase
+void stats_end_phase(CompileStats* stats) {
+    if (stats->current_phase >= 0) {
+        stats->phases[stats->current_phase].seconds += now_seconds() - stats->phase_start;
+        stats->current_phase = -1;
+    }
+}
+
+// Write a string as a JSON string literal
+static void write_json_string(FILE* out, const char* str) {
+    fputc('"', out);
+    for (const unsigned char* p = (const unsigned char*)str; *p; p++) {
+        if (*p == '"' || *p == '\\') {
+            fprintf(out, "\\%c", *p);
+        } else if (*p < 0x20) {
+            fprintf(out, "\\u%04x", *p);
+        } else {
+            fputc(*p, out);
+        }
+    }
+    fputc('"', out);
+}
+
+// Write the statistics as a single JSON object
+void stats_write_json(const CompileStats* stats, const char* path, FILE* out) {
+    double total_seconds = 0;
+    size_t total_allocations = 0;
+    size_t total_bytes = 0;
+
+    fprintf(out, "{\n  \"file\": ");
+    write_json_string(out, path);
+    fprintf(out, ",\n  \"phases\": {\n");
+    for (int i = 0; i < PHASE_COUNT; i++) {
+        const PhaseStats* phase = &stats->phases[i];
+        fprintf(out, "    \"%s\": {\"seconds\": %.9f, \"allocations\": %zu, \"allocated_bytes\": %zu}%s\n",
+                phase_names[i], phase->seconds, phase->allocations, phase->allocated_bytes,
+                i + 1 < PHASE_COUNT ? "," : "");
+        total_seconds += phase->seconds;
+        total_allocations += phase->allocations;
+        total_bytes += phase->allocated_bytes;
+    }
+    fprintf(out, "  },\n");
+    fprintf(out, "  \"total\": {\"seconds\": %.9f, \"allocations\": %zu, \"allocated_bytes\": %zu},\n",
+            total_seconds, total_allocations, total_bytes);
+    fprintf(out, "  \"source_bytes\": %zu,\n", stats->source_bytes);
+    fprintf(out, "  \"tokens\": %zu,\n", stats->token_count);
+    fprintf(out, "  \"nodes\": %zu,\n", stats->node_count);
+    fprintf(out, "  \"constants\": %zu,\n", stats->constant_count);
+    fprintf(out, "  \"functions\": %zu,\n", stats->function_count);
+    fprintf(out, "  \"code_bytes\": %zu,\n", stats->code_bytes);
+    fprintf(out, "  \"module_bytes\": %zu", stats->module_bytes);
+    if (stats->cache_enabled) {
+        fprintf(out, ",\n  \"cache\": {\"hits\": %zu, \"misses\": %zu, \"evictions\": %zu}",
+                stats->cache_hits, stats->cache_misses, stats->cache_evictions);
+    }
+    if (stats->optimized) {
+        const OptimizeReport* report = &stats->optimize;
+        fprintf(out, ",\n  \"optimizer\": {\"code_bytes_saved\": %zu, \"unreachable_bytes\": %zu, "
+                "\"redundant_returns\": %zu, \"push_pop_pairs\": %zu, \"constants_removed\": %zu, "
+                "\"constant_bytes_saved\": %zu}",
+                report->code_bytes_before - report->code_bytes_after, report->unreachable_bytes,
+                report->redundant_returns, report->push_pop_pairs, report->constants_removed,
+                report->constant_bytes_saved);
+    }
+    fprintf(out, "\n");
+    fprintf(out, "}\n");
+}
@@ -0,0 +1,57 @@
+#ifndef IBERY_STATS_H
+#define IBERY_STATS_H
+
+#include "arena.h"
+#include "optimize.h"
+#include <stdio.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// Compilation phases that are timed separately
+typedef enum {
+    PHASE_LEX,
+    PHASE_PARSE,
+    PHASE_CODEGEN,
+    PHASE_COUNT
+} CompilePhase;
+
+// Time and allocations spent in one phase
+typedef struct {
+    double seconds;
+    size_t allocations;
+    size_t allocated_bytes;
+} PhaseStats;
+
+// Statistics for one compilation
+typedef struct {
+    PhaseStats phases[PHASE_COUNT];
+    int current_phase;  // -1 outside of a phase
+    double phase_start;
+
+    size_t source_bytes;
+    size_t token_count;
+    size_t node_count;
+    size_t constant_count;
+    size_t function_count;
+    size_t module_bytes;
+    size_t code_bytes;
+
+    // Compile cache use; only reported when a cache is in use
+    bool cache_enabled;
+    size_t cache_hits;
+    size_t cache_misses;
+    size_t cache_evictions;
+
+    // Peephole pass results; only reported when the pass ran
+    bool optimized;
+    OptimizeReport optimize;
+} CompileStats;
+
+// Function declarations
+void stats_init(CompileStats* stats);
+void stats_attach(CompileStats* stats, Arena* arena);
+void stats_begin_phase(CompileStats* stats, CompilePhase phase);
+void stats_end_phase(CompileStats* stats);
+void stats_write_json(const CompileStats* stats, const char* path, FILE* out);
+
+#endif // IBERY_STATS_H
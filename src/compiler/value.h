@@ -0,0 +1,299 @@
+#ifndef IBERY_VALUE_H
+#define IBERY_VALUE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+// Runtime values. A Value is a single 64-bit word (NaN boxing): a double
+// is stored as its own bits, and everything else hides in the payload of
+// negative quiet NaNs, which arithmetic never produces once NaN results
+// are canonicalized. The top 16 bits tag the kind and the low 48 bits hold
+// the payload:
+//
+//     0x0000... - 0xFFF8...   double
+//     0xFFF9 0000 0000 000X   nil (0) and undefined (1)
+//     0xFFFA + 48 bits        integer in [-2^47, 2^47)
+//     0xFFFB + 48 bits        pointer to a VMString
+//     0xFFFC + 48 bits        pointer to a VMObject
+//
+// Pointers must fit in 48 bits, which user space addresses do on x86-64
+// and AArch64. Integers too wide for a small int live in an OBJECT_INTEGER
+// object. The operand stack is then a flat array of words that needs no
+// allocation per value. Defining VM_STRUCT_VALUES builds the VM with the
+// previous representation instead, a type tag beside a payload union, so
+// benchmarks can compare the two; both have the same accessors.
+
+// A string slice pointing into the loaded module or the VM's heap
+typedef struct {
+    const char* chars;
+    int length;
+} VMString;
+
+// Kinds of heap object
+typedef enum {
+    OBJECT_INTEGER  // An integer outside the small int range
+} ObjectType;
+
+// A heap object a value points to
+typedef struct {
+    ObjectType type;
+    int64_t integer;
+} VMObject;
+
+#ifndef VM_STRUCT_VALUES
+
+// Runtime value
+typedef uint64_t Value;
+
+#define VALUE_TAG_SHIFT 48
+#define VALUE_PAYLOAD_MASK (((uint64_t)1 << VALUE_TAG_SHIFT) - 1)
+#define VALUE_TAG_SPECIAL ((uint64_t)0xFFF9 << VALUE_TAG_SHIFT)
+#define VALUE_TAG_INT ((uint64_t)0xFFFA << VALUE_TAG_SHIFT)
+#define VALUE_TAG_STRING ((uint64_t)0xFFFB << VALUE_TAG_SHIFT)
+#define VALUE_TAG_OBJECT ((uint64_t)0xFFFC << VALUE_TAG_SHIFT)
+#define VALUE_TAG_MASK ((uint64_t)0xFFFF << VALUE_TAG_SHIFT)
+#define VALUE_CANONICAL_NAN ((uint64_t)0x7FF8 << VALUE_TAG_SHIFT)
+
+#define VALUE_NIL (VALUE_TAG_SPECIAL | 0)
+#define VALUE_UNDEFINED (VALUE_TAG_SPECIAL | 1)
+
+// Get the nil value
+static inline Value nil_value(void) {
+    return VALUE_NIL;
+}
+
+// Get the value of a global that was never assigned; never on the stack
+static inline Value undefined_value(void) {
+    return VALUE_UNDEFINED;
+}
+
+// Box a double; every NaN becomes the one positive quiet NaN so that no
+// double can look like a tagged value
+static inline Value double_value(double real) {
+    if (real != real) {
+        return VALUE_CANONICAL_NAN;
+    }
+    Value value;
+    memcpy(&value, &real, sizeof(value));
+    return value;
+}
+
+// Check if an integer fits a small int
+static inline bool fits_small_int(int64_t integer) {
+    return (int64_t)((uint64_t)integer << 16) >> 16 == integer;
+}
+
+// Box an integer that fits a small int
+static inline Value small_int_value(int64_t integer) {
+    return VALUE_TAG_INT | ((uint64_t)integer & VALUE_PAYLOAD_MASK);
+}
+
+// Box a string pointer
+static inline Value string_value(const VMString* string) {
+    return VALUE_TAG_STRING | (uint64_t)(uintptr_t)string;
+}
+
+// Box an object pointer
+static inline Value object_value(VMObject* object) {
+    return VALUE_TAG_OBJECT | (uint64_t)(uintptr_t)object;
+}
+
+// Check if a value is nil
+static inline bool value_is_nil(Value value) {
+    return value == VALUE_NIL;
+}
+
+// Check if a value is undefined
+static inline bool value_is_undefined(Value value) {
+    return value == VALUE_UNDEFINED;
+}
+
+// Check if a value is a double
+static inline bool value_is_double(Value value) {
+    return value < VALUE_TAG_SPECIAL;
+}
+
+// Check if a value is a small int
+static inline bool value_is_small_int(Value value) {
+    return (value & VALUE_TAG_MASK) == VALUE_TAG_INT;
+}
+
+// Check if a value is a string
+static inline bool value_is_string(Value value) {
+    return (value & VALUE_TAG_MASK) == VALUE_TAG_STRING;
+}
+
+// Check if a value is an object
+static inline bool value_is_object(Value value) {
+    return (value & VALUE_TAG_MASK) == VALUE_TAG_OBJECT;
+}
+
+// Get the double a value holds
+static inline double value_as_double(Value value) {
+    double real;
+    memcpy(&real, &value, sizeof(real));
+    return real;
+}
+
+// Sign-extend the 48-bit payload of a small int
+static inline int64_t value_as_small_int(Value value) {
+    return (int64_t)(value << 16) >> 16;
+}
+
+// Get the string a value points to
+static inline const VMString* value_as_string(Value value) {
+    return (const VMString*)(uintptr_t)(value & VALUE_PAYLOAD_MASK);
+}
+
+// Get the object a value points to
+static inline VMObject* value_as_object(Value value) {
+    return (VMObject*)(uintptr_t)(value & VALUE_PAYLOAD_MASK);
+}
+
+#else // VM_STRUCT_VALUES
+
+// Runtime value types
+typedef enum {
+    VAL_NIL,
+    VAL_INT,
+    VAL_DOUBLE,
+    VAL_STRING,
+    VAL_OBJECT,
+    VAL_UNDEFINED
+} ValueType;
+
+// Runtime value
+typedef struct {
+    ValueType type;
+    union {
+        int64_t integer;
+        double real;
+        const VMString* string;
+        VMObject* object;
+    } as;
+} Value;
+
+// Get the nil value
+static inline Value nil_value(void) {
+    Value value;
+    value.type = VAL_NIL;
+    value.as.integer = 0;
+    return value;
+}
+
+// Get the value of a global that was never assigned; never on the stack
+static inline Value undefined_value(void) {
+    Value value;
+    value.type = VAL_UNDEFINED;
+    value.as.integer = 0;
+    return value;
+}
+
+// Box a double
+static inline Value double_value(double real) {
+    Value value;
+    value.type = VAL_DOUBLE;
+    value.as.real = real;
+    return value;
+}
+
+// Every integer is a small int here
+static inline bool fits_small_int(int64_t integer) {
+    (void)integer;
+    return true;
+}
+
+// Box an integer
+static inline Value small_int_value(int64_t integer) {
+    Value value;
+    value.type = VAL_INT;
+    value.as.integer = integer;
+    return value;
+}
+
+// Box a string pointer
+static inline Value string_value(const VMString* string) {
+    Value value;
+    value.type = VAL_STRING;
+    value.as.string = string;
+    return value;
+}
+
+// Box an object pointer
+static inline Value object_value(VMObject* object) {
+    Value value;
+    value.type = VAL_OBJECT;
+    value.as.object = object;
+    return value;
+}
+
+// Check if a value is nil
+static inline bool value_is_nil(Value value) {
+    return value.type == VAL_NIL;
+}
+
+// Check if a value is undefined
+static inline bool value_is_undefined(Value value) {
+    return value.type == VAL_UNDEFINED;
+}
+
+// Check if a value is a double
+static inline bool value_is_double(Value value) {
+    return value.type == VAL_DOUBLE;
+}
+
+// Check if a value is a small int
+static inline bool value_is_small_int(Value value) {
+    return value.type == VAL_INT;
+}
+
+// Check if a value is a string
+static inline bool value_is_string(Value value) {
+    return value.type == VAL_STRING;
+}
+
+// Check if a value is an object
+static inline bool value_is_object(Value value) {
+    return value.type == VAL_OBJECT;
+}
+
+// Get the double a value holds
+static inline double value_as_double(Value value) {
+    return value.as.real;
+}
+
+// Get the integer a small int holds
+static inline int64_t value_as_small_int(Value value) {
+    return value.as.integer;
+}
+
+// Get the string a value points to
+static inline const VMString* value_as_string(Value value) {
+    return value.as.string;
+}
+
+// Get the object a value points to
+static inline VMObject* value_as_object(Value value) {
+    return value.as.object;
+}
+
+#endif // VM_STRUCT_VALUES
+
+// Check if a value is an integer, small or not
+static inline bool value_is_integer(Value value) {
+    return value_is_small_int(value) ||
+           (value_is_object(value) && value_as_object(value)->type == OBJECT_INTEGER);
+}
+
+// Get an integer value, small or not
+static inline int64_t value_as_integer(Value value) {
+    return value_is_small_int(value) ? value_as_small_int(value) : value_as_object(value)->integer;
+}
+
+// Check if a value is a number
+static inline bool value_is_number(Value value) {
+    return value_is_double(value) || value_is_integer(value);
+}
+
+#endif // IBERY_VALUE_H
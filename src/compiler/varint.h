@@ -0,0 +1,109 @@
+#ifndef IBERY_VARINT_H
+#define IBERY_VARINT_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+// LEB128 operand encoding: seven bits per byte, low group first, high bit
+// set on every byte but the last. Values below 128 take a single byte.
+// Doubles are not varints but their eight bytes, little-endian.
+
+#define VARINT_MAX_BYTES 5
+#define VARINT64_MAX_BYTES 10
+#define DOUBLE_BYTES 8
+
+// Encode an unsigned value; out needs room for VARINT_MAX_BYTES
+static inline size_t varint_encode_u32(uint8_t* out, uint32_t value) {
+    size_t n = 0;
+    while (value >= 0x80) {
+        out[n++] = (uint8_t)(value | 0x80);
+        value >>= 7;
+    }
+    out[n++] = (uint8_t)value;
+    return n;
+}
+
+// Encode a signed value (SLEB128); out needs room for VARINT64_MAX_BYTES
+static inline size_t varint_encode_i64(uint8_t* out, int64_t value) {
+    size_t n = 0;
+    for (;;) {
+        uint8_t byte = (uint8_t)(value & 0x7F);
+        value >>= 7;
+        if ((value == 0 && !(byte & 0x40)) || (value == -1 && (byte & 0x40))) {
+            out[n++] = byte;
+            return n;
+        }
+        out[n++] = byte | 0x80;
+    }
+}
+
+// Decode an unsigned value from at most available bytes; returns the bytes
+// consumed, or 0 if the encoding is truncated or too long
+static inline size_t varint_decode_u32(const uint8_t* in, size_t available, uint32_t* value) {
+    if (available > 0 && in[0] < 0x80) {
+        *value = in[0];
+        return 1;
+    }
+
+    uint32_t result = 0;
+    size_t limit = available < VARINT_MAX_BYTES ? available : VARINT_MAX_BYTES;
+    for (size_t n = 0; n < limit; n++) {
+        result |= (uint32_t)(in[n] & 0x7F) << (7 * n);
+        if (!(in[n] & 0x80)) {
+            *value = result;
+            return n + 1;
+        }
+    }
+    return 0;
+}
+
+// Decode a signed value (SLEB128); returns the bytes consumed, or 0 if the
+// encoding is truncated or too long
+static inline size_t varint_decode_i64(const uint8_t* in, size_t available, int64_t* value) {
+    if (available > 0 && in[0] < 0x80) {
+        // Sign-extend bit 6 of a single byte
+        *value = (int64_t)(in[0] ^ 0x40) - 0x40;
+        return 1;
+    }
+
+    uint64_t result = 0;
+    size_t limit = available < VARINT64_MAX_BYTES ? available : VARINT64_MAX_BYTES;
+    for (size_t n = 0; n < limit; n++) {
+        result |= (uint64_t)(in[n] & 0x7F) << (7 * n);
+        if (!(in[n] & 0x80)) {
+            size_t shift = 7 * (n + 1);
+            if (shift < 64 && (in[n] & 0x40)) {
+                result |= ~(uint64_t)0 << shift;
+            }
+            *value = (int64_t)result;
+            return n + 1;
+        }
+    }
+    return 0;
+}
+
+// Encode a double; out needs room for DOUBLE_BYTES
+static inline size_t double_encode(uint8_t* out, double value) {
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    for (size_t n = 0; n < DOUBLE_BYTES; n++) {
+        out[n] = (uint8_t)(bits >> (8 * n));
+    }
+    return DOUBLE_BYTES;
+}
+
+// Decode a double; returns the bytes consumed, or 0 if it is truncated
+static inline size_t double_decode(const uint8_t* in, size_t available, double* value) {
+    if (available < DOUBLE_BYTES) {
+        return 0;
+    }
+    uint64_t bits = 0;
+    for (size_t n = 0; n < DOUBLE_BYTES; n++) {
+        bits |= (uint64_t)in[n] << (8 * n);
+    }
+    memcpy(value, &bits, sizeof(bits));
+    return DOUBLE_BYTES;
+}
+
+#endif // IBERY_VARINT_H
@@ -0,0 +1,992 @@
+#include "vm.h"
+#include "arith.h"
+#include "varint.h"
+#include "error.h"
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <stdio.h>
+
+// Use computed-goto dispatch where the compiler supports it
+#if defined(__GNUC__)
+#define VM_THREADED_DISPATCH 1
+#endif
+
+// Internal operations of the threaded code
+typedef enum {
+    VM_OP_RETURN,
+    VM_OP_QUANTUM,
+    VM_OP_RUN,
+    VM_OP_PRINT,
+    VM_OP_CALL,
+    VM_OP_CALL_UNDEFINED,
+    VM_OP_PUSH,
+    VM_OP_LOAD_LOCAL,
+    VM_OP_STORE_LOCAL,
+    VM_OP_LOAD_GLOBAL,
+    VM_OP_STORE_GLOBAL,
+    VM_OP_LOAD_UNDEFINED,
+    VM_OP_ADD,
+    VM_OP_ARITHMETIC,    // Other number operators, by bytecode opcode
+    VM_OP_EQUALITY,
+    VM_OP_COMPARE,
+    VM_OP_UNARY,         // OP_NEGATE and OP_BIT_NOT
+    VM_OP_NOT,
+    VM_OP_POP,
+    VM_OP_HALT,
+    VM_OP_COUNT
+} VMOp;
+
+// A bytecode instruction with its operand decoded
+typedef struct {
+    uint8_t opcode;
+    int64_t integer;
+    double real;
+    uint32_t constant;
+    uint32_t index;     // Function index, frame slot or global index
+} DecodedInstruction;
+
+// Report a runtime error and stop
+__attribute__((noreturn, format(printf, 1, 2)))
+static void vm_error(const char* format, ...) {
+    char message[ERROR_MESSAGE_MAX];
+    va_list args;
+    va_start(args, format);
+    vsnprintf(message, sizeof(message), format, args);
+    va_end(args);
+    raise_error("Runtime error: %s", message);
+}
+
+// Default handler for `run` statements; userdata is the VM
+static void default_run_handler(const char* command, int length, bool quantum, void* userdata) {
+    VM* vm = (VM*)userdata;
+    fprintf(vm->output, "[%s] %.*s\n", quantum ? "quantum" : "run", length, command);
+}
+
+// Count an allocation from the VM's heap; userdata is the VM
+static void count_heap_bytes(size_t size, void* userdata) {
+    ((VM*)userdata)->heap_bytes += size;
+}
+
+// Create a new virtual machine
+VM* create_vm(void) {
+    VM* vm = (VM*)malloc(sizeof(VM));
+    if (!vm) {
+        return NULL;
+    }
+
+    vm->stack_top = vm->stack;
+    vm->frame_count = 0;
+    vm->module = NULL;
+    vm->functions = NULL;
+    vm->function_count = 0;
+    vm->globals = NULL;
+    vm->global_count = 0;
+    vm->code = NULL;
+    vm->code_count = 0;
+    vm->code_capacity = 0;
+    vm->run_handler = default_run_handler;
+    vm->run_userdata = vm;
+    vm->output = stdout;
+    vm->constants = NULL;
+    vm->program = create_arena(0);
+    vm->heap = create_arena(0);
+    vm->spare = create_arena(0);
+    arena_set_hook(vm->heap, count_heap_bytes, vm);
+    arena_set_hook(vm->spare, count_heap_bytes, vm);
+    vm->heap_bytes = 0;
+    vm->heap_limit = VM_HEAP_SWEEP_MIN;
+    return vm;
+}
+
+// Release the loaded program
+static void clear_program(VM* vm) {
+    free(vm->functions);
+    free(vm->globals);
+    free(vm->code);
+    vm->module = NULL;
+    vm->functions = NULL;
+    vm->function_count = 0;
+    vm->globals = NULL;
+    vm->global_count = 0;
+    vm->code = NULL;
+    vm->code_count = 0;
+    vm->code_capacity = 0;
+    vm->constants = NULL;
+    arena_reset(vm->program);
+}
+
+// Destroy a virtual machine
+void destroy_vm(VM* vm) {
+    if (vm) {
+        clear_program(vm);
+        destroy_arena(vm->program);
+        destroy_arena(vm->heap);
+        destroy_arena(vm->spare);
+        free(vm);
+    }
+}
+
+// Set the handler invoked by `run` statements
+void vm_set_run_handler(VM* vm, RunHandler handler, void* userdata) {
+    vm->run_handler = handler ? handler : default_run_handler;
+    vm->run_userdata = handler ? userdata : vm;
+}
+
+// Set the stream that print statements write to
+void vm_set_output(VM* vm, FILE* output) {
+    vm->output = output;
+}
+
+// Get a constant of the loaded module as a string
+static VMString constant_string(const ModuleHeader* module, uint32_t index) {
+    VMString string;
+    string.chars = module_constant_text(module, index);
+    string.length = (int)module_constants(module)[index].length;
+    return string;
+}
+
+// Decode the instruction at pos and return the position after it
+static size_t decode_instruction(const ModuleHeader* module, size_t pos, DecodedInstruction* out) {
+    const uint8_t* code = module_code(module);
+    size_t size = module->code_size;
+    out->opcode = code[pos++];
+    out->integer = 0;
+    out->real = 0.0;
+    out->constant = 0;
+    out->index = 0;
+
+    switch (out->opcode) {
+        case OP_RUN_COMMAND:
+        case OP_CALL_FUNCTION:
+        case OP_PUSH_STRING:
+        case OP_PUSH_IDENTIFIER: {
+            size_t length = varint_decode_u32(code + pos, size - pos, &out->constant);
+            if (length == 0) {
+                vm_error("Malformed bytecode at offset %zu", pos);
+            }
+            if (out->constant >= module->constant_count) {
+                vm_error("Constant index out of range at offset %zu", pos);
+            }
+            pos += length;
+            break;
+        }
+        case OP_PUSH_INT: {
+            size_t length = varint_decode_i64(code + pos, size - pos, &out->integer);
+            if (length == 0) {
+                vm_error("Malformed bytecode at offset %zu", pos);
+            }
+            pos += length;
+            break;
+        }
+        case OP_PUSH_DOUBLE: {
+            size_t length = double_decode(code + pos, size - pos, &out->real);
+            if (length == 0) {
+                vm_error("Malformed bytecode at offset %zu", pos);
+            }
+            pos += length;
+            break;
+        }
+        case OP_CALL_INDEX:
+        case OP_LOAD_LOCAL:
+        case OP_STORE_LOCAL:
+        case OP_LOAD_GLOBAL:
+        case OP_STORE_GLOBAL: {
+            size_t length = varint_decode_u32(code + pos, size - pos, &out->index);
+            if (length == 0) {
+                vm_error("Malformed bytecode at offset %zu", pos);
+            }
+            if (out->opcode == OP_CALL_INDEX && out->index >= module->function_count) {
+                vm_error("Function index out of range at offset %zu", pos);
+            }
+            if ((out->opcode == OP_LOAD_GLOBAL || out->opcode == OP_STORE_GLOBAL) &&
+                out->index >= module->global_count) {
+                vm_error("Global index out of range at offset %zu", pos);
+            }
+            pos += length;
+            break;
+        }
+        case OP_RETURN:
+        case OP_QUANTUM_OP:
+        case OP_PRINT:
+        case OP_POP:
+        case OP_ADD:
+        case OP_SUBTRACT:
+        case OP_MULTIPLY:
+        case OP_DIVIDE:
+        case OP_MODULO:
+        case OP_POWER:
+        case OP_SHIFT_LEFT:
+        case OP_SHIFT_RIGHT:
+        case OP_SHIFT_RIGHT_UNSIGNED:
+        case OP_BIT_AND:
+        case OP_BIT_OR:
+        case OP_BIT_XOR:
+        case OP_EQUAL:
+        case OP_NOT_EQUAL:
+        case OP_LESS:
+        case OP_LESS_EQUAL:
+        case OP_GREATER:
+        case OP_GREATER_EQUAL:
+        case OP_NEGATE:
+        case OP_NOT:
+        case OP_BIT_NOT:
+            break;
+        default:
+            vm_error("Unknown opcode 0x%02X at offset %zu", out->opcode, pos - 1);
+    }
+    return pos;
+}
+
+// Find a function by name; names are compared as constant indices
+static int find_function(VM* vm, uint32_t name) {
+    for (int i = 0; i < vm->function_count; i++) {
+        if (vm->functions[i].name_constant == name) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// Find a parameter slot by name
+static int find_param(VMFunction* function, uint32_t name) {
+    if (!function) {
+        return -1;
+    }
+    for (int i = 0; i < function->param_count; i++) {
+        if (function->params[i] == name) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// Box an integer, allocating it from arena if it is too wide for a small int
+static Value integer_value(Arena* arena, int64_t integer) {
+    if (fits_small_int(integer)) {
+        return small_int_value(integer);
+    }
+    VMObject* object = (VMObject*)arena_alloc(arena, sizeof(VMObject));
+    object->type = OBJECT_INTEGER;
+    object->integer = integer;
+    return object_value(object);
+}
+
+// Append a threaded instruction
+static VMInstruction* append_instruction(VM* vm, VMOp op, const void** labels) {
+    if (vm->code_count == vm->code_capacity) {
+        size_t new_capacity = vm->code_capacity ? vm->code_capacity * 2 : 64;
+        VMInstruction* new_code = (VMInstruction*)realloc(vm->code,
+                                                          new_capacity * sizeof(VMInstruction));
+        if (!new_code) {
+            vm_error("Out of memory");
+        }
+        vm->code = new_code;
+        vm->code_capacity = new_capacity;
+    }
+    VMInstruction* instr = &vm->code[vm->code_count++];
+    instr->op = (uint8_t)op;
+    instr->handler = labels ? labels[op] : NULL;
+    instr->operand.target = 0;
+    return instr;
+}
+
+static void vm_dispatch(VM* vm, const void*** labels_out);
+
+// Read the function table of the module
+static void load_functions(VM* vm) {
+    const ModuleHeader* module = vm->module;
+    if (module->function_count == 0) {
+        return;
+    }
+
+    vm->functions = (VMFunction*)malloc(module->function_count * sizeof(VMFunction));
+    if (!vm->functions) {
+        vm_error("Out of memory");
+    }
+    const ModuleFunction* table = module_functions(module);
+    const uint32_t* params = module_params(module);
+    for (uint32_t i = 0; i < module->function_count; i++) {
+        VMFunction* function = &vm->functions[i];
+        function->name = constant_string(module, table[i].name);
+        function->name_constant = table[i].name;
+        function->params = params + table[i].params;
+        function->param_count = (int)table[i].param_count;
+        function->frame_size = (int)(table[i].param_count + table[i].local_count);
+        if (function->frame_size > VM_STACK_MAX) {
+            vm_error("Frame of '%.*s' is larger than the stack",
+                     function->name.length, function->name.chars);
+        }
+        function->entry = 0;
+    }
+    vm->function_count = (int)module->function_count;
+}
+
+// Make the constants of the module into strings that values can point to
+static void load_constants(VM* vm) {
+    const ModuleHeader* module = vm->module;
+    vm->constants = (VMString*)arena_alloc(vm->program,
+                                           module->constant_count * sizeof(VMString));
+    for (uint32_t i = 0; i < module->constant_count; i++) {
+        vm->constants[i] = constant_string(module, i);
+    }
+}
+
+// Allocate the globals of the module; vm_run clears them
+static void load_globals(VM* vm) {
+    if (vm->module->global_count == 0) {
+        return;
+    }
+    vm->globals = (Value*)malloc(vm->module->global_count * sizeof(Value));
+    if (!vm->globals) {
+        vm_error("Out of memory");
+    }
+    vm->global_count = (int)vm->module->global_count;
+}
+
+// Translate a module's code into direct-threaded code
+void vm_load(VM* vm, const uint8_t* image, size_t size) {
+    const void** labels;
+    vm_dispatch(NULL, &labels);
+
+    clear_program(vm);
+    vm->module = module_open(image, size);
+    load_constants(vm);
+    load_functions(vm);
+    load_globals(vm);
+
+    const ModuleHeader* module = vm->module;
+    const ModuleFunction* table = module_functions(module);
+    size_t pos = 0;
+    int next_function = 0;
+    VMFunction* current = NULL;
+
+    while (pos < module->code_size) {
+        while (next_function < vm->function_count && table[next_function].entry == pos) {
+            current = &vm->functions[next_function++];
+            current->entry = vm->code_count;
+        }
+
+        DecodedInstruction instr;
+        size_t at = pos;
+        pos = decode_instruction(module, pos, &instr);
+        VMInstruction* out;
+
+        switch (instr.opcode) {
+            case OP_RETURN:
+                append_instruction(vm, VM_OP_RETURN, labels);
+                break;
+            case OP_QUANTUM_OP:
+                append_instruction(vm, VM_OP_QUANTUM, labels);
+                break;
+            case OP_RUN_COMMAND:
+                out = append_instruction(vm, VM_OP_RUN, labels);
+                out->operand.string = &vm->constants[instr.constant];
+                break;
+            case OP_PRINT:
+                append_instruction(vm, VM_OP_PRINT, labels);
+                break;
+            case OP_CALL_FUNCTION: {
+                int index = find_function(vm, instr.constant);
+                if (index < 0) {
+                    out = append_instruction(vm, VM_OP_CALL_UNDEFINED, labels);
+                    out->operand.string = &vm->constants[instr.constant];
+                } else {
+                    out = append_instruction(vm, VM_OP_CALL, labels);
+                    out->operand.function = index;
+                }
+                break;
+            }
+            case OP_CALL_INDEX:
+                out = append_instruction(vm, VM_OP_CALL, labels);
+                out->operand.function = (int)instr.index;
+                break;
+            case OP_PUSH_INT:
+                out = append_instruction(vm, VM_OP_PUSH, labels);
+                out->operand.value = integer_value(vm->program, instr.integer);
+                break;
+            case OP_PUSH_DOUBLE:
+                out = append_instruction(vm, VM_OP_PUSH, labels);
+                out->operand.value = double_value(instr.real);
+                break;
+            case OP_PUSH_STRING:
+                out = append_instruction(vm, VM_OP_PUSH, labels);
+                out->operand.value = string_value(&vm->constants[instr.constant]);
+                break;
+            case OP_PUSH_IDENTIFIER: {
+                int slot = find_param(current, instr.constant);
+                if (slot < 0) {
+                    out = append_instruction(vm, VM_OP_LOAD_UNDEFINED, labels);
+                    out->operand.string = &vm->constants[instr.constant];
+                } else {
+                    out = append_instruction(vm, VM_OP_LOAD_LOCAL, labels);
+                    out->operand.slot = slot;
+                }
+                break;
+            }
+            case OP_LOAD_LOCAL:
+            case OP_STORE_LOCAL:
+                if (!current || instr.index >= (uint32_t)current->frame_size) {
+                    vm_error("Local slot out of range at offset %zu", at);
+                }
+                out = append_instruction(vm, instr.opcode == OP_LOAD_LOCAL ? VM_OP_LOAD_LOCAL
+                                                                           : VM_OP_STORE_LOCAL, labels);
+                out->operand.slot = (int)instr.index;
+                break;
+            case OP_LOAD_GLOBAL:
+            case OP_STORE_GLOBAL:
+                out = append_instruction(vm, instr.opcode == OP_LOAD_GLOBAL ? VM_OP_LOAD_GLOBAL
+                                                                            : VM_OP_STORE_GLOBAL, labels);
+                out->operand.slot = (int)instr.index;
+                break;
+            case OP_ADD:
+                append_instruction(vm, VM_OP_ADD, labels);
+                break;
+            case OP_EQUAL:
+            case OP_NOT_EQUAL:
+                out = append_instruction(vm, VM_OP_EQUALITY, labels);
+                out->operand.opcode = instr.opcode;
+                break;
+            case OP_LESS:
+            case OP_LESS_EQUAL:
+            case OP_GREATER:
+            case OP_GREATER_EQUAL:
+                out = append_instruction(vm, VM_OP_COMPARE, labels);
+                out->operand.opcode = instr.opcode;
+                break;
+            case OP_NEGATE:
+            case OP_BIT_NOT:
+                out = append_instruction(vm, VM_OP_UNARY, labels);
+                out->operand.opcode = instr.opcode;
+                break;
+            case OP_NOT:
+                append_instruction(vm, VM_OP_NOT, labels);
+                break;
+            case OP_POP:
+                append_instruction(vm, VM_OP_POP, labels);
+                break;
+            default:
+                // The remaining operators take two numbers
+                out = append_instruction(vm, VM_OP_ARITHMETIC, labels);
+                out->operand.opcode = instr.opcode;
+                break;
+        }
+    }
+    if (next_function < vm->function_count) {
+        vm_error("Function entry for '%.*s' is not on an instruction boundary",
+                 vm->functions[next_function].name.length,
+                 vm->functions[next_function].name.chars);
+    }
+
+    append_instruction(vm, VM_OP_HALT, labels);
+}
+
+// Get a number value as an arithmetic operand
+static Number value_number(Value value) {
+    return value_is_double(value) ? make_real(value_as_double(value))
+                                  : make_integer(value_as_integer(value));
+}
+
+// Make a number into a value; integers too wide for a small int are
+// allocated from the VM's heap
+static Value number_value(VM* vm, Number number) {
+    return number.is_double ? double_value(number.as.real)
+                            : integer_value(vm->heap, number.as.integer);
+}
+
+// Report an operator that has no result
+__attribute__((noreturn))
+static void arith_error(ArithStatus status, uint8_t opcode, bool unary) {
+    if (status == ARITH_DIVISION_BY_ZERO) {
+        vm_error("Division by zero");
+    } else if (status == ARITH_NEGATIVE_POWER_OF_ZERO) {
+        vm_error("Zero raised to a negative power");
+    } else if (unary) {
+        vm_error("Operand of '%s' must be an integer", opcode_symbol(opcode));
+    }
+    vm_error("Operands of '%s' must be integers", opcode_symbol(opcode));
+}
+
+// Get the text a value has when printed or concatenated; buffer holds a
+// number's
+static VMString value_text(Value value, char* buffer) {
+    VMString text;
+    if (value_is_string(value)) {
+        return *value_as_string(value);
+    } else if (value_is_number(value)) {
+        text.length = format_number(buffer, value_number(value));
+        text.chars = buffer;
+    } else {
+        text.chars = "nil";
+        text.length = 3;
+    }
+    return text;
+}
+
+// Print a runtime value
+static void print_value(FILE* output, Value value) {
+    char buffer[NUMBER_TEXT_MAX];
+    VMString text = value_text(value, buffer);
+    fprintf(output, "%.*s\n", text.length, text.chars);
+}
+
+// Concatenate two values, at least one a string, into the VM's heap
+static Value concatenate(VM* vm, Value a, Value b) {
+    char a_buffer[NUMBER_TEXT_MAX];
+    char b_buffer[NUMBER_TEXT_MAX];
+    VMString left = value_text(a, a_buffer);
+    VMString right = value_text(b, b_buffer);
+    if (left.length > INT_MAX - right.length) {
+        vm_error("String too long");
+    }
+    char* chars = (char*)arena_alloc(vm->heap, (size_t)left.length + right.length);
+    memcpy(chars, left.chars, left.length);
+    memcpy(chars + left.length, right.chars, right.length);
+
+    VMString* result = (VMString*)arena_alloc(vm->heap, sizeof(VMString));
+    result->chars = chars;
+    result->length = left.length + right.length;
+    return string_value(result);
+}
+
+// A pointer a sweep has already copied and the value that replaced it
+typedef struct {
+    const void* from;
+    Value to;
+} SweepEntry;
+
+// Open addressing table of the pointers copied so far by one sweep
+typedef struct {
+    SweepEntry* entries;
+    size_t mask;
+} SweepMap;
+
+// Find the slot of a pointer in a sweep's table, or the empty slot where
+// it belongs
+static SweepEntry* sweep_slot(SweepMap* map, const void* from) {
+    size_t index = (size_t)(((uintptr_t)from >> 3) * 0x9E3779B97F4A7C15ull) & map->mask;
+    while (map->entries[index].from && map->entries[index].from != from) {
+        index = (index + 1) & map->mask;
+    }
+    return &map->entries[index];
+}
+
+// Copy a value's heap string or object into arena. Strings of the
+// module's constants stay where they are and objects hold no pointers.
+// The map remembers every copy, so a value reachable from several roots
+// is copied once and all of them share it
+static Value copy_value(VM* vm, Arena* arena, SweepMap* map, Value value) {
+    if (value_is_object(value)) {
+        SweepEntry* entry = sweep_slot(map, value_as_object(value));
+        if (!entry->from) {
+            VMObject* copy = (VMObject*)arena_alloc(arena, sizeof(VMObject));
+            *copy = *value_as_object(value);
+            entry->from = value_as_object(value);
+            entry->to = object_value(copy);
+        }
+        return entry->to;
+    }
+    if (value_is_string(value)) {
+        const VMString* string = value_as_string(value);
+        if (string >= vm->constants && string < vm->constants + vm->module->constant_count) {
+            return value;
+        }
+        SweepEntry* entry = sweep_slot(map, string);
+        if (!entry->from) {
+            char* chars = (char*)arena_alloc(arena, (size_t)string->length);
+            memcpy(chars, string->chars, string->length);
+            VMString* copy = (VMString*)arena_alloc(arena, sizeof(VMString));
+            copy->chars = chars;
+            copy->length = string->length;
+            entry->from = string;
+            entry->to = string_value(copy);
+        }
+        return entry->to;
+    }
+    return value;
+}
+
+// Copy everything the stack and the globals refer to into the spare arena
+// and make it the heap, dropping the rest. Runs as a call starts, when no
+// live value is anywhere else. The next sweep waits until the heap has
+// grown to twice what survived, so sweeping stays linear in what is
+// allocated
+static void sweep_heap(VM* vm) {
+    size_t roots = (size_t)(vm->stack_top - vm->stack) + (size_t)vm->global_count;
+    size_t capacity = 16;
+    while (capacity < roots * 2) {
+        capacity *= 2;
+    }
+    SweepMap map;
+    map.entries = (SweepEntry*)calloc(capacity, sizeof(SweepEntry));
+    if (!map.entries) {
+        vm_error("Out of memory");
+    }
+    map.mask = capacity - 1;
+
+    Arena* live = vm->spare;
+    arena_reset(live);
+    vm->heap_bytes = 0;
+    for (Value* slot = vm->stack; slot < vm->stack_top; slot++) {
+        *slot = copy_value(vm, live, &map, *slot);
+    }
+    for (int i = 0; i < vm->global_count; i++) {
+        vm->globals[i] = copy_value(vm, live, &map, vm->globals[i]);
+    }
+    free(map.entries);
+    vm->spare = vm->heap;
+    vm->heap = live;
+    arena_reset(vm->spare);
+    vm->heap_limit = vm->heap_bytes * 2 > VM_HEAP_SWEEP_MIN ? vm->heap_bytes * 2 : VM_HEAP_SWEEP_MIN;
+}
+
+// Check if two values are equal; numbers compare by value, strings by
+// their text, and values of other different types never are equal
+static bool values_equal(Value a, Value b) {
+    if (value_is_number(a) && value_is_number(b)) {
+        return number_order(value_number(a), value_number(b)) == 0;
+    }
+    if (value_is_string(a) && value_is_string(b)) {
+        const VMString* x = value_as_string(a);
+        const VMString* y = value_as_string(b);
+        return x->length == y->length && memcmp(x->chars, y->chars, x->length) == 0;
+    }
+    return value_is_nil(a) && value_is_nil(b);
+}
+
+// Check if a value counts as false: nil, 0, 0.0 and the empty string
+static bool is_falsey(Value value) {
+    return value_is_nil(value) ||
+           (value_is_number(value) && number_is_zero(value_number(value))) ||
+           (value_is_string(value) && value_as_string(value)->length == 0);
+}
+
+#define PUSH(value) do { \
+        if (vm->stack_top == vm->stack + VM_STACK_MAX) { \
+            vm_error("Stack overflow"); \
+        } \
+        *vm->stack_top++ = (value); \
+    } while (0)
+
+#ifdef VM_THREADED_DISPATCH
+#define DISPATCH() goto *ip->handler
+#else
+#define DISPATCH() goto dispatch
+#endif
+
+// Execute the threaded code, or export the dispatch table when vm is NULL
+static void vm_dispatch(VM* vm, const void*** labels_out) {
+#ifdef VM_THREADED_DISPATCH
+    static const void* labels[VM_OP_COUNT] = {
+        [VM_OP_RETURN] = &&op_return,
+        [VM_OP_QUANTUM] = &&op_quantum,
+        [VM_OP_RUN] = &&op_run,
+        [VM_OP_PRINT] = &&op_print,
+        [VM_OP_CALL] = &&op_call,
+        [VM_OP_CALL_UNDEFINED] = &&op_call_undefined,
+        [VM_OP_PUSH] = &&op_push,
+        [VM_OP_LOAD_LOCAL] = &&op_load_local,
+        [VM_OP_STORE_LOCAL] = &&op_store_local,
+        [VM_OP_LOAD_GLOBAL] = &&op_load_global,
+        [VM_OP_STORE_GLOBAL] = &&op_store_global,
+        [VM_OP_LOAD_UNDEFINED] = &&op_load_undefined,
+        [VM_OP_ADD] = &&op_add,
+        [VM_OP_ARITHMETIC] = &&op_arithmetic,
+        [VM_OP_EQUALITY] = &&op_equality,
+        [VM_OP_COMPARE] = &&op_compare,
+        [VM_OP_UNARY] = &&op_unary,
+        [VM_OP_NOT] = &&op_not,
+        [VM_OP_POP] = &&op_pop,
+        [VM_OP_HALT] = &&op_halt
+    };
+    if (labels_out) {
+        *labels_out = labels;
+        return;
+    }
+#else
+    if (labels_out) {
+        *labels_out = NULL;
+        return;
+    }
+#endif
+
+    const VMInstruction* ip = vm->code;
+    CallFrame* frame = &vm->frames[vm->frame_count - 1];
+    bool quantum = false;
+
+#ifndef VM_THREADED_DISPATCH
+dispatch:
+    switch ((VMOp)ip->op) {
+        case VM_OP_RETURN: goto op_return;
+        case VM_OP_QUANTUM: goto op_quantum;
+        case VM_OP_RUN: goto op_run;
+        case VM_OP_PRINT: goto op_print;
+        case VM_OP_CALL: goto op_call;
+        case VM_OP_CALL_UNDEFINED: goto op_call_undefined;
+        case VM_OP_PUSH: goto op_push;
+        case VM_OP_LOAD_LOCAL: goto op_load_local;
+        case VM_OP_STORE_LOCAL: goto op_store_local;
+        case VM_OP_LOAD_GLOBAL: goto op_load_global;
+        case VM_OP_STORE_GLOBAL: goto op_store_global;
+        case VM_OP_LOAD_UNDEFINED: goto op_load_undefined;
+        case VM_OP_ADD: goto op_add;
+        case VM_OP_ARITHMETIC: goto op_arithmetic;
+        case VM_OP_EQUALITY: goto op_equality;
+        case VM_OP_COMPARE: goto op_compare;
+        case VM_OP_UNARY: goto op_unary;
+        case VM_OP_NOT: goto op_not;
+        case VM_OP_POP: goto op_pop;
+        case VM_OP_HALT: goto op_halt;
+        case VM_OP_COUNT: break;
+    }
+    vm_error("Invalid instruction");
+#endif
+    DISPATCH();
+
+op_return: {
+    if (vm->frame_count == 1) {
+        // Return from the top-level script
+        return;
+    }
+    Value* locals_end = frame->base + frame->function->frame_size;
+    Value result = vm->stack_top > locals_end ? vm->stack_top[-1] : nil_value();
+    vm->stack_top = frame->base;
+    *vm->stack_top++ = result;
+    ip = frame->return_ip;
+    vm->frame_count--;
+    frame = &vm->frames[vm->frame_count - 1];
+    DISPATCH();
+}
+
+op_quantum:
+    quantum = true;
+    ip++;
+    DISPATCH();
+
+op_run:
+    vm->run_handler(ip->operand.string->chars, ip->operand.string->length,
+                    quantum, vm->run_userdata);
+    quantum = false;
+    ip++;
+    DISPATCH();
+
+op_print:
+    print_value(vm->output, *--vm->stack_top);
+    ip++;
+    DISPATCH();
+
+op_call: {
+    // Code between calls runs each of its instructions at most once, so
+    // sweeping only here is enough to bound the heap
+    if (vm->heap_bytes >= vm->heap_limit) {
+        sweep_heap(vm);
+    }
+    VMFunction* function = &vm->functions[ip->operand.function];
+    Value* floor = frame->base + (frame->function ? frame->function->frame_size : 0);
+    if (vm->stack_top - function->param_count < floor) {
+        vm_error("Not enough arguments for '%.*s'",
+                 function->name.length, function->name.chars);
+    }
+    if (vm->frame_count == VM_FRAMES_MAX) {
+        vm_error("Call stack overflow in '%.*s'",
+                 function->name.length, function->name.chars);
+    }
+    frame = &vm->frames[vm->frame_count++];
+    frame->function = function;
+    frame->return_ip = ip + 1;
+    frame->base = vm->stack_top - function->param_count;
+    if (frame->base + function->frame_size > vm->stack + VM_STACK_MAX) {
+        vm_error("Stack overflow");
+    }
+    while (vm->stack_top < frame->base + function->frame_size) {
+        *vm->stack_top++ = nil_value();
+    }
+    ip = vm->code + function->entry;
+    DISPATCH();
+}
+
+op_call_undefined:
+    vm_error("Undefined function '%.*s'",
+             ip->operand.string->length, ip->operand.string->chars);
+    return;
+
+op_push:
+    PUSH(ip->operand.value);
+    ip++;
+    DISPATCH();
+
+op_load_local:
+    PUSH(frame->base[ip->operand.slot]);
+    ip++;
+    DISPATCH();
+
+op_store_local:
+    frame->base[ip->operand.slot] = vm->stack_top[-1];
+    ip++;
+    DISPATCH();
+
+op_load_global: {
+    Value value = vm->globals[ip->operand.slot];
+    if (value_is_undefined(value)) {
+        const VMString* name = &vm->constants[module_globals(vm->module)[ip->operand.slot]];
+        vm_error("Undefined variable '%.*s'", name->length, name->chars);
+    }
+    PUSH(value);
+    ip++;
+    DISPATCH();
+}
+
+op_store_global:
+    vm->globals[ip->operand.slot] = vm->stack_top[-1];
+    ip++;
+    DISPATCH();
+
+op_load_undefined:
+    vm_error("Undefined variable '%.*s'",
+             ip->operand.string->length, ip->operand.string->chars);
+    return;
+
+op_add: {
+    Value a = vm->stack_top[-2];
+    Value b = vm->stack_top[-1];
+    Value result;
+    if (value_is_small_int(a) && value_is_small_int(b)) {
+        uint64_t sum = (uint64_t)value_as_small_int(a) + (uint64_t)value_as_small_int(b);
+        result = integer_value(vm->heap, (int64_t)sum);
+    } else if (value_is_double(a) && value_is_double(b)) {
+        result = double_value(value_as_double(a) + value_as_double(b));
+    } else if (value_is_number(a) && value_is_number(b)) {
+        Number sum = make_integer(0);
+        arith_binary(OP_ADD, value_number(a), value_number(b), &sum);
+        result = number_value(vm, sum);
+    } else if (value_is_string(a) || value_is_string(b)) {
+        result = concatenate(vm, a, b);
+    } else {
+        vm_error("Operands of '+' must be numbers or strings");
+    }
+    vm->stack_top[-2] = result;
+    vm->stack_top--;
+    ip++;
+    DISPATCH();
+}
+
+op_arithmetic: {
+    Value a = vm->stack_top[-2];
+    Value b = vm->stack_top[-1];
+    uint8_t op = ip->operand.opcode;
+    Value result;
+    ArithStatus status;
+    if (value_is_double(a) && value_is_double(b)) {
+        double real = 0.0;
+        status = real_binary(op, value_as_double(a), value_as_double(b), &real);
+        result = double_value(real);
+    } else if (value_is_small_int(a) && value_is_small_int(b)) {
+        int64_t integer = 0;
+        status = integer_binary(op, value_as_small_int(a), value_as_small_int(b), &integer);
+        result = integer_value(vm->heap, integer);
+    } else if (value_is_number(a) && value_is_number(b)) {
+        Number number = make_integer(0);
+        status = arith_binary(op, value_number(a), value_number(b), &number);
+        result = number_value(vm, number);
+    } else {
+        vm_error("Operands of '%s' must be numbers", opcode_symbol(op));
+    }
+    if (status != ARITH_OK) {
+        arith_error(status, op, false);
+    }
+    vm->stack_top[-2] = result;
+    vm->stack_top--;
+    ip++;
+    DISPATCH();
+}
+
+op_equality: {
+    Value* a = vm->stack_top - 2;
+    bool equal = values_equal(*a, vm->stack_top[-1]);
+    *a = small_int_value(equal == (ip->operand.opcode == OP_EQUAL));
+    vm->stack_top--;
+    ip++;
+    DISPATCH();
+}
+
+op_compare: {
+    Value* a = vm->stack_top - 2;
+    Value b = vm->stack_top[-1];
+    int order;
+    if (value_is_double(*a) && value_is_double(b)) {
+        double x = value_as_double(*a);
+        double y = value_as_double(b);
+        order = x < y ? -1 : x > y ? 1 : x == y ? 0 : ORDER_UNORDERED;
+    } else if (value_is_number(*a) && value_is_number(b)) {
+        order = number_order(value_number(*a), value_number(b));
+    } else if (value_is_string(*a) && value_is_string(b)) {
+        const VMString* x = value_as_string(*a);
+        const VMString* y = value_as_string(b);
+        order = compare_text(x->chars, x->length, y->chars, y->length);
+    } else {
+        vm_error("Operands of '%s' must be two numbers or two strings",
+                 opcode_symbol(ip->operand.opcode));
+    }
+    *a = small_int_value(compare_result(ip->operand.opcode, order));
+    vm->stack_top--;
+    ip++;
+    DISPATCH();
+}
+
+op_unary: {
+    Value* a = vm->stack_top - 1;
+    uint8_t op = ip->operand.opcode;
+    if (!value_is_number(*a)) {
+        vm_error("Operand of '%s' must be a number", opcode_symbol(op));
+    }
+    Number result;
+    ArithStatus status = arith_unary(op, value_number(*a), &result);
+    if (status != ARITH_OK) {
+        arith_error(status, op, true);
+    }
+    *a = number_value(vm, result);
+    ip++;
+    DISPATCH();
+}
+
+op_not: {
+    Value* a = vm->stack_top - 1;
+    *a = small_int_value(is_falsey(*a));
+    ip++;
+    DISPATCH();
+}
+
+op_pop:
+    vm->stack_top--;
+    ip++;
+    DISPATCH();
+
+op_halt:
+    return;
+}
+
+// Run the loaded program from the top
+void vm_run(VM* vm) {
+    if (!vm->code) {
+        return;
+    }
+    for (int i = 0; i < vm->global_count; i++) {
+        vm->globals[i] = undefined_value();
+    }
+    arena_reset(vm->heap);
+    vm->heap_bytes = 0;
+    vm->heap_limit = VM_HEAP_SWEEP_MIN;
+    vm->stack_top = vm->stack;
+    vm->frame_count = 1;
+    vm->frames[0].function = NULL;
+    vm->frames[0].return_ip = NULL;
+    vm->frames[0].base = vm->stack;
+    vm_dispatch(vm, NULL);
+}
+
+// Load and run a module image
+void vm_execute(VM* vm, const uint8_t* image, size_t size) {
+    vm_load(vm, image, size);
+    vm_run(vm);
+}
@@ -0,0 +1,87 @@
+#ifndef IBERY_VM_H
+#define IBERY_VM_H
+
+#include "codegen.h"
+#include "value.h"
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+#define VM_STACK_MAX MODULE_STACK_MAX
+#define VM_FRAMES_MAX 256
+#define VM_HEAP_SWEEP_MIN (1024 * 1024)  // Heap bytes that trigger the first sweep
+
+// A function from the module's function table
+typedef struct {
+    VMString name;
+    uint32_t name_constant;
+    const uint32_t* params;  // Constant indices, in the module image
+    int param_count;
+    int frame_size;          // Parameters and locals
+    size_t entry;
+} VMFunction;
+
+// A decoded, direct-threaded instruction
+typedef struct {
+    const void* handler;
+    uint8_t op;
+    union {
+        Value value;         // Constant of VM_OP_PUSH
+        int slot;
+        int function;
+        uint8_t opcode;      // Operator of the generic arithmetic handlers
+        size_t target;
+        const VMString* string;  // A constant of the module
+    } operand;
+} VMInstruction;
+
+// Call frame for a running function
+typedef struct {
+    VMFunction* function;
+    const VMInstruction* return_ip;
+    Value* base;
+} CallFrame;
+
+// Host callback for `run` statements
+typedef void (*RunHandler)(const char* command, int length, bool quantum, void* userdata);
+
+// Virtual machine structure; the loaded module image must outlive the
+// program because strings and parameter names are used in place
+typedef struct {
+    Value stack[VM_STACK_MAX];
+    Value* stack_top;
+    CallFrame frames[VM_FRAMES_MAX];
+    int frame_count;
+
+    const ModuleHeader* module;
+    VMFunction* functions;
+    int function_count;
+    Value* globals;
+    int global_count;
+
+    VMInstruction* code;
+    size_t code_count;
+    size_t code_capacity;
+
+    RunHandler run_handler;
+    void* run_userdata;
+    VMString* constants;  // Constants of the module, for string values
+    Arena* program;       // Constants and wide integer literals of the code
+    Arena* heap;          // Strings and objects the running program builds
+    Arena* spare;         // Where a sweep copies the live part of the heap
+    size_t heap_bytes;    // Allocated from the heap since the last sweep
+    size_t heap_limit;    // Heap bytes at which the next sweep runs
+    FILE* output;  // Where print and the default run handler write
+} VM;
+
+// Function declarations
+VM* create_vm(void);
+void destroy_vm(VM* vm);
+void vm_set_run_handler(VM* vm, RunHandler handler, void* userdata);
+void vm_set_output(VM* vm, FILE* output);
+void vm_load(VM* vm, const uint8_t* image, size_t size);
+void vm_run(VM* vm);
+void vm_execute(VM* vm, const uint8_t* image, size_t size);
+
+#endif // IBERY_VM_H
@@ -0,0 +1,124 @@
+#include "workers.h"
+#include "error.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+// Get the number of online cores
+int default_worker_count(void) {
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    return cores > 0 ? (int)cores : 1;
+}
+
+// Claim and run tasks of the current batch until none are left; called
+// with the lock held and returns with it held
+static void drain_batch(WorkerPool* pool) {
+    while (pool->next < pool->count) {
+        size_t index = pool->next++;
+        WorkerTask task = pool->task;
+        void* userdata = pool->userdata;
+
+        pthread_mutex_unlock(&pool->lock);
+        task(userdata, index);
+        pthread_mutex_lock(&pool->lock);
+
+        if (++pool->finished == pool->count) {
+            pthread_cond_broadcast(&pool->work_done);
+        }
+    }
+}
+
+// Worker thread body: wait for a batch, help finish it, repeat
+static void* worker_main(void* arg) {
+    WorkerPool* pool = (WorkerPool*)arg;
+    unsigned long seen = 0;
+
+    pthread_mutex_lock(&pool->lock);
+    for (;;) {
+        while (!pool->shutting_down && pool->generation == seen) {
+            pthread_cond_wait(&pool->work_ready, &pool->lock);
+        }
+        if (pool->shutting_down) {
+            break;
+        }
+        seen = pool->generation;
+        drain_batch(pool);
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+
+// Create a pool of worker_count threads in total, counting the caller of
+// worker_pool_run; 0 means one per core
+WorkerPool* create_worker_pool(int worker_count) {
+    WorkerPool* pool = (WorkerPool*)malloc(sizeof(WorkerPool));
+    if (!pool) {
+        return NULL;
+    }
+
+    if (worker_count <= 0) {
+        worker_count = default_worker_count();
+    }
+    pool->thread_count = worker_count - 1;
+    pool->threads = pool->thread_count > 0
+        ? (pthread_t*)malloc(pool->thread_count * sizeof(pthread_t))
+        : NULL;
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->work_ready, NULL);
+    pthread_cond_init(&pool->work_done, NULL);
+    pool->task = NULL;
+    pool->userdata = NULL;
+    pool->count = 0;
+    pool->next = 0;
+    pool->finished = 0;
+    pool->generation = 0;
+    pool->shutting_down = false;
+
+    for (int i = 0; i < pool->thread_count; i++) {
+        if (pthread_create(&pool->threads[i], NULL, worker_main, pool) != 0) {
+            raise_error("Failed to start worker thread");
+        }
+    }
+    return pool;
+}
+
+// Stop and join every worker
+void destroy_worker_pool(WorkerPool* pool) {
+    if (!pool) return;
+
+    pthread_mutex_lock(&pool->lock);
+    pool->shutting_down = true;
+    pthread_cond_broadcast(&pool->work_ready);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (int i = 0; i < pool->thread_count; i++) {
+        pthread_join(pool->threads[i], NULL);
+    }
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->work_ready);
+    pthread_cond_destroy(&pool->work_done);
+    free(pool->threads);
+    free(pool);
+}
+
+// Run task for every index in [0, count) and wait for all of them
+void worker_pool_run(WorkerPool* pool, WorkerTask task, void* userdata, size_t count) {
+    if (count == 0) {
+        return;
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    pool->task = task;
+    pool->userdata = userdata;
+    pool->count = count;
+    pool->next = 0;
+    pool->finished = 0;
+    pool->generation++;
+    pthread_cond_broadcast(&pool->work_ready);
+
+    drain_batch(pool);
+    while (pool->finished < pool->count) {
+        pthread_cond_wait(&pool->work_done, &pool->lock);
+    }
+    pthread_mutex_unlock(&pool->lock);
+}
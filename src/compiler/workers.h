@@ -0,0 +1,36 @@
+#ifndef IBERY_WORKERS_H
+#define IBERY_WORKERS_H
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+// One unit of a parallel batch
+typedef void (*WorkerTask)(void* userdata, size_t index);
+
+// Fixed pool of threads that run batches of indexed tasks. The thread
+// calling worker_pool_run works on the batch too.
+typedef struct {
+    pthread_t* threads;
+    int thread_count;
+    pthread_mutex_t lock;
+    pthread_cond_t work_ready;
+    pthread_cond_t work_done;
+
+    // The running batch
+    WorkerTask task;
+    void* userdata;
+    size_t count;
+    size_t next;
+    size_t finished;
+    unsigned long generation;
+    bool shutting_down;
+} WorkerPool;
+
+// Function declarations
+int default_worker_count(void);
+WorkerPool* create_worker_pool(int worker_count);
+void destroy_worker_pool(WorkerPool* pool);
+void worker_pool_run(WorkerPool* pool, WorkerTask task, void* userdata, size_t count);
+
+#endif // IBERY_WORKERS_H
@@ -0,0 +1,244 @@
+#include "daemon.h"
+#include "compiler/session.h"
+#include "compiler/source.h"
+#include "compiler/module.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#define MAX_REQUEST_BYTES (256u * 1024 * 1024)
+#define NAME_MAX_BYTES 1024
+#define HEADER_MAX (NAME_MAX_BYTES + 64)
+
+// Fill in a socket address; returns false if the path does not fit
+static bool socket_address(const char* path, struct sockaddr_un* address) {
+    memset(address, 0, sizeof(*address));
+    address->sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(address->sun_path)) {
+        fprintf(stderr, "Socket path too long: %s\n", path);
+        return false;
+    }
+    strcpy(address->sun_path, path);
+    return true;
+}
+
+// Write all of a buffer to a socket
+static bool write_all(int fd, const void* data, size_t size) {
+    const char* bytes = (const char*)data;
+    while (size > 0) {
+        ssize_t n = write(fd, bytes, size);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        bytes += n;
+        size -= (size_t)n;
+    }
+    return true;
+}
+
+// Send a header line, naming a document if name is not NULL, and a body
+static bool send_message(int fd, const char* word, const char* name, const void* body, size_t length) {
+    char header[HEADER_MAX];
+    int header_length = snprintf(header, sizeof(header), "%s %zu%s%.*s\n", word, length,
+                                 name ? " " : "", NAME_MAX_BYTES - 1, name ? name : "");
+    return write_all(fd, header, (size_t)header_length) && write_all(fd, body, length);
+}
+
+// Read a header line and its body; the body is NUL-terminated and must be
+// freed by the caller, and name is empty unless the header names a
+// document. Returns false at the end of the stream or on a malformed message
+static bool read_message(FILE* in, char* word, size_t word_size, char* name, char** body, size_t* length) {
+    char header[HEADER_MAX];
+    char format[32];
+    int name_start = 0;
+    if (!fgets(header, sizeof(header), in)) {
+        return false;
+    }
+    snprintf(format, sizeof(format), "%%%zus %%zu%%n", word_size - 1);
+    if (sscanf(header, format, word, length, &name_start) != 2 || *length > MAX_REQUEST_BYTES) {
+        return false;
+    }
+    const char* rest = header + name_start + (header[name_start] == ' ');
+    snprintf(name, NAME_MAX_BYTES, "%.*s", (int)strcspn(rest, "\n"), rest);
+
+    *body = (char*)malloc(*length + 1);
+    if (!*body || fread(*body, 1, *length, in) != *length) {
+        free(*body);
+        return false;
+    }
+    (*body)[*length] = '\0';
+    return true;
+}
+
+// Answer one request; returns false once the server should stop
+static bool handle_request(CompilerSession* session, int fd, const char* command, const char* name,
+                           const char* body, size_t length) {
+    CompileResult result;
+    const char* document = name[0] ? name : NULL;
+    if (strcmp(command, "COMPILE") == 0) {
+        if (session_compile(session, document, body, length, &result)) {
+            send_message(fd, "OK", NULL, result.module, result.module_size);
+        } else {
+            send_message(fd, "ERROR", NULL, result.error, strlen(result.error));
+        }
+    } else if (strcmp(command, "RUN") == 0) {
+        char* output = NULL;
+        size_t output_size = 0;
+        FILE* stream = open_memstream(&output, &output_size);
+        bool ok = stream && session_run(session, document, body, length, stream, &result);
+        if (stream) {
+            fclose(stream);
+        }
+        if (ok) {
+            send_message(fd, "OK", NULL, output, output_size);
+        } else {
+            const char* message = stream ? result.error : "Out of memory";
+            send_message(fd, "ERROR", NULL, message, strlen(message));
+        }
+        free(output);
+    } else if (strcmp(command, "STATS") == 0) {
+        char* json = NULL;
+        size_t json_size = 0;
+        FILE* stream = open_memstream(&json, &json_size);
+        if (stream) {
+            session_write_stats(session, stream);
+            fclose(stream);
+        }
+        send_message(fd, "OK", NULL, json, json_size);
+        free(json);
+    } else if (strcmp(command, "SHUTDOWN") == 0) {
+        send_message(fd, "OK", NULL, "", 0);
+        return false;
+    } else {
+        const char* message = "Unknown command";
+        send_message(fd, "ERROR", NULL, message, strlen(message));
+    }
+    return true;
+}
+
+// Serve compile requests on a Unix socket until a SHUTDOWN request
+int serve_requests(const char* socket_path, Cache* cache) {
+    struct sockaddr_un address;
+    if (!socket_address(socket_path, &address)) {
+        return 1;
+    }
+    int server = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (server < 0) {
+        perror("Error creating socket");
+        return 1;
+    }
+    unlink(socket_path);
+    if (bind(server, (struct sockaddr*)&address, sizeof(address)) != 0 || listen(server, 16) != 0) {
+        perror("Error listening on socket");
+        close(server);
+        return 1;
+    }
+
+    // A client that hangs up mid-reply must not take the server down
+    signal(SIGPIPE, SIG_IGN);
+    CompilerSession* session = create_compiler_session(cache);
+    if (!session) {
+        fprintf(stderr, "Error creating compiler session\n");
+        close(server);
+        unlink(socket_path);
+        return 1;
+    }
+    bool running = true;
+    while (running) {
+        int client = accept(server, NULL, NULL);
+        if (client < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("Error accepting connection");
+            break;
+        }
+        FILE* in = fdopen(client, "rb");
+        if (!in) {
+            perror("Error reading connection");
+            close(client);
+            continue;
+        }
+        char command[16];
+        char name[NAME_MAX_BYTES];
+        char* body;
+        size_t length;
+        while (running && read_message(in, command, sizeof(command), name, &body, &length)) {
+            running = handle_request(session, client, command, name, body, length);
+            free(body);
+        }
+        fclose(in);
+    }
+
+    destroy_compiler_session(session);
+    close(server);
+    unlink(socket_path);
+    return 0;
+}
+
+// Compile a file on a running server, then save the module to output_path
+// or, without one, run it there and print its output
+int send_request(const char* socket_path, const char* path, const char* output_path) {
+    int fd = open(path, O_RDONLY);
+    SourceFile source;
+    if (fd < 0 || !source_map(fd, &source)) {
+        perror("Error opening file");
+        return 1;
+    }
+    close(fd);
+
+    struct sockaddr_un address;
+    if (!socket_address(socket_path, &address)) {
+        return 1;
+    }
+    int server = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (server < 0 || connect(server, (struct sockaddr*)&address, sizeof(address)) != 0) {
+        perror("Error connecting to server");
+        return 1;
+    }
+
+    const char* command = output_path ? "COMPILE" : "RUN";
+    FILE* in = fdopen(server, "rb");
+    if (!in) {
+        perror("Error connecting to server");
+        close(server);
+        source_release(&source);
+        return 1;
+    }
+    char reply[16];
+    char name[NAME_MAX_BYTES];
+    char* body = NULL;
+    size_t length;
+    char* document = realpath(path, NULL);
+    bool sent = send_message(server, command, document ? document : path, source.text, source.length);
+    free(document);
+    if (!sent || !read_message(in, reply, sizeof(reply), name, &body, &length)) {
+        fprintf(stderr, "No reply from server\n");
+        fclose(in);
+        source_release(&source);
+        return 1;
+    }
+    fclose(in);
+    source_release(&source);
+
+    int status = 0;
+    if (strcmp(reply, "OK") != 0) {
+        fprintf(stderr, "%.*s\n", (int)length, body);
+        status = 1;
+    } else if (output_path) {
+        module_write(output_path, (const uint8_t*)body, length);
+    } else {
+        fwrite(body, 1, length, stdout);
+    }
+    free(body);
+    return status;
+}
@@ -0,0 +1,26 @@
+#ifndef IBERY_DAEMON_H
+#define IBERY_DAEMON_H
+
+#include "compiler/cache.h"
+
+// Compile server protocol over a Unix stream socket. A client sends any
+// number of requests on one connection, each a header line followed by a
+// body of exactly <length> bytes:
+//
+//     COMPILE <length>\n<source>   reply body: the module image
+//     RUN <length>\n<source>       reply body: everything the program printed
+//     STATS 0\n                    reply body: session counters as JSON
+//     SHUTDOWN 0\n                 stops the server after replying
+//
+// A COMPILE or RUN header may end with a document name, as in
+// "COMPILE 5120 /src/game.ibery"; each new version of a document is then
+// compiled incrementally against the last one. Every request gets one
+// reply, OK <length>\n<body> on success or ERROR <length>\n<message> on
+// failure. Connections are served one at a time by a single warm
+// CompilerSession.
+
+// Function declarations
+int serve_requests(const char* socket_path, Cache* cache);
+int send_request(const char* socket_path, const char* path, const char* output_path);
+
+#endif // IBERY_DAEMON_H
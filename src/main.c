@@ -1,11 +1,25 @@
 #include "compiler/lexer.h"
 #include "compiler/parser.h"
+#include "compiler/codegen.h"
+#include "compiler/arith.h"
+#include "compiler/vm.h"
+#include "compiler/stats.h"
+#include "compiler/source.h"
+#include "compiler/cache.h"
+#include "build.h"
+#include "daemon.h"
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
 
 // Function to print an AST node (for debugging)
-void print_ast_node(ASTNode* node, int depth) {
-    if (!node) return;
+void print_ast_node(const InternTable* strings, const AST* ast, NodeIndex index, int depth) {
+    if (index == NODE_NONE) return;
+    const ASTNode* node = ast_node(ast, index);
 
     // Print indentation
     for (int i = 0; i < depth; i++) {
@@ -14,63 +28,310 @@ void print_ast_node(ASTNode* node, int depth) {
 
     // Print node type and value
     printf("Type: %d", node->type);
-    if (node->value) {
-        printf(", Value: %s", node->value);
+    if (node->type == NODE_BINARY_OP || node->type == NODE_UNARY_OP) {
+        printf(", Operator: %s", operator_text((TokenType)node->value));
+    } else if (node->type == NODE_NUMBER_LITERAL || node->type == NODE_FLOAT_LITERAL) {
+        Number number;
+        char text[NUMBER_TEXT_MAX];
+        number.is_double = node->type == NODE_FLOAT_LITERAL;
+        number.as = ast_number(ast, node);
+        format_number(text, number);
+        printf(", Value: %s", text);
+    } else if (node->value != STRING_ID_NONE) {
+        printf(", Value: %s", intern_text(strings, node->value));
     }
     printf("\n");
 
     // Print children
-    for (int i = 0; i < node->children_count; i++) {
-        print_ast_node(node->children[i], depth + 1);
+    for (uint32_t i = 0; i < node->child_count; i++) {
+        print_ast_node(strings, ast, ast_child(ast, node, i), depth + 1);
     }
 }
 
+// Save a module to output_path, or execute it if there is none
+static void save_or_run(const uint8_t* module, size_t size, const char* output_path) {
+    if (output_path) {
+        module_write(output_path, module, size);
+    } else {
+        VM* vm = create_vm();
+        vm_execute(vm, module, size);
+        destroy_vm(vm);
+    }
+}
+
+// Write compile statistics to stats_path, or to stderr if there is none
+static int write_stats(const CompileStats* stats, const char* path, const char* stats_path) {
+    FILE* out = stats_path ? fopen(stats_path, "w") : stderr;
+    if (!out) {
+        perror("Error opening stats file");
+        return 1;
+    }
+    stats_write_json(stats, path, out);
+    if (out != stderr) {
+        fclose(out);
+    }
+    return 0;
+}
+
 int main(int argc, char** argv) {
-    if (argc != 2) {
-        printf("Usage: %s <source_file>\n", argv[0]);
+    bool dump_ast = false;
+    bool show_stats = false;
+    bool compile_only = false;
+    bool jobs_given = false;
+    bool use_cache = false;
+    bool optimize = false;
+    const char* cache_dir = NULL;
+    uint64_t cache_max_bytes = CACHE_DEFAULT_MAX_BYTES;
+    const char* stats_path = NULL;
+    const char* output_path = NULL;
+    const char* serve_path = NULL;
+    const char* connect_path = NULL;
+    BuildOptions build = { NULL, 0, false, NULL, NULL, false };
+    const char** inputs = (const char**)malloc(argc * sizeof(const char*));
+    int input_count = 0;
+    bool usage_error = false;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--ast") == 0) {
+            dump_ast = true;
+        } else if (strcmp(argv[i], "--stats") == 0) {
+            show_stats = true;
+        } else if (strncmp(argv[i], "--stats=", 8) == 0) {
+            show_stats = true;
+            stats_path = argv[i] + 8;
+        } else if (strcmp(argv[i], "--cache") == 0) {
+            use_cache = true;
+        } else if (strncmp(argv[i], "--cache=", 8) == 0) {
+            use_cache = true;
+            cache_dir = argv[i] + 8;
+        } else if (strncmp(argv[i], "--cache-size=", 13) == 0) {
+            // A size in MiB; 0, junk or a size whose bytes overflow is refused
+            const char* text = argv[i] + 13;
+            char* end;
+            unsigned long long mib = strtoull(text, &end, 10);
+            if (!isdigit((unsigned char)text[0]) || *end != '\0' || mib == 0 ||
+                mib > UINT64_MAX / (1024 * 1024)) {
+                fprintf(stderr, "Invalid cache size: %s\n", text);
+                usage_error = true;
+            } else {
+                cache_max_bytes = (uint64_t)mib * 1024 * 1024;
+            }
+        } else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+            output_path = argv[++i];
+        } else if (strcmp(argv[i], "-O") == 0) {
+            optimize = true;
+        } else if (strcmp(argv[i], "-c") == 0) {
+            compile_only = true;
+        } else if (strcmp(argv[i], "-j") == 0 && i + 1 < argc) {
+            const char* text = argv[++i];
+            char* end;
+            long jobs = strtol(text, &end, 10);
+            if (end == text || *end != '\0' || jobs <= 0 || jobs > INT_MAX) {
+                fprintf(stderr, "Invalid job count: %s\n", text);
+                usage_error = true;
+            } else {
+                build.jobs = (int)jobs;
+                jobs_given = true;
+            }
+        } else if (strcmp(argv[i], "-d") == 0 && i + 1 < argc) {
+            build.output_dir = argv[++i];
+        } else if (strcmp(argv[i], "--serve") == 0 && i + 1 < argc) {
+            serve_path = argv[++i];
+        } else if (strcmp(argv[i], "--connect") == 0 && i + 1 < argc) {
+            connect_path = argv[++i];
+        } else {
+            inputs[input_count++] = argv[i];
+        }
+    }
+
+    // A client hands its source to a running server and prints the reply
+    if (connect_path && input_count == 1 && !usage_error) {
+        int status = send_request(connect_path, inputs[0], output_path);
+        free(inputs);
+        return status;
+    }
+    usage_error = usage_error || connect_path || (serve_path && input_count > 0);
+
+    // Compiled modules are cached by source content with --cache
+    Cache* cache = NULL;
+    if (use_cache) {
+        if (!cache_dir) {
+            cache_dir = cache_default_dir();
+        }
+        cache = create_cache(cache_dir, cache_max_bytes);
+        if (!cache) {
+            fprintf(stderr, "Cannot create cache directory %s\n", cache_dir);
+            return 1;
+        }
+    }
+
+    // A server keeps one warm compiler session for every request
+    if (serve_path && !usage_error) {
+        free(inputs);
+        int status = serve_requests(serve_path, cache);
+        destroy_cache(cache);
+        return status;
+    }
+
+    // Several inputs, or -c, compile each source to a module in parallel
+    if (!usage_error && (compile_only || input_count > 1)) {
+        usage_error = input_count == 0 || dump_ast || output_path;
+        if (!usage_error) {
+            build.show_stats = show_stats;
+            build.stats_path = stats_path;
+            build.cache = cache;
+            build.optimize = optimize;
+            int status = build_files(inputs, input_count, &build);
+            free(inputs);
+            destroy_cache(cache);
+            return status;
+        }
+    }
+    const char* path = input_count == 1 && !usage_error ? inputs[0] : NULL;
+    free(inputs);
+    if (!path) {
+        printf("Usage: %s [--ast] [-O] [--stats[=<file>]] [--cache[=<dir>]] [--cache-size=<MiB>] [-j <jobs>]\n"
+               "           [-o <module>] <source_file | module | ->\n"
+               "       %s -c [-O] [-j <jobs>] [-d <dir>] [--stats[=<file>]] [--cache[=<dir>]] [--cache-size=<MiB>]\n"
+               "           <source | dir | pattern>...\n"
+               "       %s --serve <socket> [--cache[=<dir>]] [--cache-size=<MiB>]\n"
+               "       %s --connect <socket> [-o <module>] <source_file>\n",
+               argv[0], argv[0], argv[0], argv[0]);
         return 1;
     }
 
-    // Read the source file
-    FILE* file = fopen(argv[1], "r");
-    if (!file) {
+    // Regular files are mapped; pipes and stdin ("-") are streamed
+    bool from_stdin = strcmp(path, "-") == 0;
+    int fd = from_stdin ? STDIN_FILENO : open(path, O_RDONLY);
+    if (fd < 0) {
         perror("Error opening file");
         return 1;
     }
+    SourceFile source = { NULL, 0, 0 };
+    FILE* stream = NULL;
+    if (source_map(fd, &source)) {
+        if (!from_stdin) {
+            close(fd);
+        }
+    } else {
+        stream = from_stdin ? stdin : fdopen(fd, "rb");
+        if (!stream) {
+            perror("Error opening file");
+            return 1;
+        }
+    }
 
-    // Get file size
-    fseek(file, 0, SEEK_END);
-    long file_size = ftell(file);
-    fseek(file, 0, SEEK_SET);
+    // Compiled modules are executed in place
+    if (!stream && !dump_ast && !output_path &&
+        module_is_image((const uint8_t*)source.text, source.length)) {
+        VM* vm = create_vm();
+        vm_execute(vm, (const uint8_t*)source.text, source.length);
+        destroy_vm(vm);
+        source_release(&source);
+        destroy_cache(cache);
+        return 0;
+    }
 
-    // Allocate buffer and read file
-    char* source = (char*)malloc(file_size + 1);
-    if (!source) {
-        fclose(file);
-        perror("Error allocating memory");
-        return 1;
+    // A cached module of the same source skips lexing, parsing and codegen
+    CompileStats stats;
+    stats_init(&stats);
+    stats.cache_enabled = cache && !stream && !dump_ast;
+    CacheKey key = { 0, 0 };
+    if (stats.cache_enabled) {
+        key = cache_key(cache, source.text, source.length, optimize ? CACHE_OPTION_OPTIMIZE : 0);
+        SourceFile cached;
+        if (cache_lookup(cache, key, &cached)) {
+            stats.cache_hits = 1;
+            stats.source_bytes = source.length;
+            stats.module_bytes = cached.length;
+            // Stats are complete before the program runs, which may not return
+            int status = show_stats ? write_stats(&stats, path, stats_path) : 0;
+            save_or_run((const uint8_t*)cached.text, cached.length, output_path);
+            source_release(&cached);
+            source_release(&source);
+            destroy_cache(cache);
+            return status;
+        }
+        stats.cache_misses = 1;
     }
 
-    fread(source, 1, file_size, file);
-    source[file_size] = '\0';
-    fclose(file);
+    // With -j, lexing and code generation are split over a worker pool
+    WorkerPool* pool = jobs_given && build.jobs != 1 ? create_worker_pool(build.jobs) : NULL;
+
+    // Every phase allocates from the arena, so the stats hook sees it all
+    Arena* arena = create_arena(0);
+    if (show_stats) {
+        stats_attach(&stats, arena);
+    }
 
-    // Create lexer and parser
-    Lexer* lexer = create_lexer(source);
-    Parser* parser = create_parser(lexer);
+    Lexer* lexer;
+    Parser* parser;
+    if (stream) {
+        // Tokens are pulled by the parser as the input arrives, so lexing
+        // is timed as part of parsing
+        stats_begin_phase(&stats, PHASE_PARSE);
+        lexer = create_streaming_lexer(source_read_stream, stream, arena);
+        parser = create_parser(lexer);
+    } else {
+        // Lex the whole file
+        stats_begin_phase(&stats, PHASE_LEX);
+        lexer = create_lexer_from_buffer(source.text, source.length, arena);
+        TokenBuffer* tokens = pool ? lex_all_parallel(lexer, pool) : lex_all(lexer);
+        stats_end_phase(&stats);
+        stats.token_count = tokens->count;
+
+        stats_begin_phase(&stats, PHASE_PARSE);
+        parser = create_buffered_parser(lexer, tokens);
+    }
 
     // Parse the program
-    ASTNode* ast = parse_program(parser);
+    AST* ast = parse_program(parser);
+    stats_end_phase(&stats);
+    stats.node_count = ast->node_count;
+    stats.source_bytes = lexer->base + lexer->length;
 
-    // Print the AST
-    printf("Abstract Syntax Tree:\n");
-    print_ast_node(ast, 0);
+    int status = 0;
+    if (dump_ast) {
+        // Print the AST
+        printf("Abstract Syntax Tree:\n");
+        print_ast_node(parser->strings, ast, ast->root, 0);
+        status = show_stats ? write_stats(&stats, path, stats_path) : 0;
+    } else {
+        // Compile to a module, then save or execute it
+        stats_begin_phase(&stats, PHASE_CODEGEN);
+        CodeGenerator* gen = create_code_generator(arena, parser->strings);
+        gen->optimize = optimize;
+        size_t module_size;
+        uint8_t* module = pool ? generate_code_parallel(gen, ast, pool, &module_size)
+                               : generate_code(gen, ast, &module_size);
+        stats_end_phase(&stats);
+        stats.optimized = optimize;
+        stats.optimize = gen->optimize_report;
+        stats.constant_count = gen->constant_count;
+        stats.function_count = gen->function_count;
+        stats.code_bytes = gen->size;
+        stats.module_bytes = module_size;
+
+        if (stats.cache_enabled) {
+            stats.cache_evictions = cache_store(cache, key, module, module_size);
+        }
+        // Stats are complete before the program runs, which may not return
+        status = show_stats ? write_stats(&stats, path, stats_path) : 0;
+        save_or_run(module, module_size, output_path);
+        destroy_code_generator(gen);
+    }
 
     // Clean up
-    destroy_ast_node(ast);
+    if (pool) {
+        destroy_worker_pool(pool);
+    }
     destroy_parser(parser);
     destroy_lexer(lexer);
-    free(source);
+    destroy_arena(arena);
+    if (stream) {
+        fclose(stream);
+    }
+    source_release(&source);
+    destroy_cache(cache);
 
-    return 0;
+    return status;
 } 
\ No newline at end of file
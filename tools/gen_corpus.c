@@ -0,0 +1,242 @@
+// Synthetic .ibery corpus generator for the pipeline benchmark.
+//
+// Usage: gen_corpus <shape> <count> [seed]
+//
+// Writes a program of the given shape to stdout. count scales the program
+// roughly linearly; the same arguments always produce the same program.
+//
+//   defs      many small functions with a few parameters each
+//   nesting   statements made of deeply nested calls
+//   strings   run statements with long command strings
+//   comments  short functions buried in line, doc and block comments
+//   mixed     all of the above interleaved
+//   force     calculate_force-style double arithmetic, for the VM benchmark
+//   integers  integer hashing and bit twiddling, for the VM benchmark
+//
+// The VM shapes define a tree of CALL_DEPTH levels of functions in which
+// each level calls the one below twice, so every statement runs about
+// 2^CALL_DEPTH arithmetic-heavy calls.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#define NESTING_DEPTH 48
+#define STRING_LENGTH 1024
+#define CALL_DEPTH 8
+#define PRINT_INTERVAL 64
+
+static uint64_t rng_state;
+
+// xorshift64*
+static uint32_t next_random(void) {
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    return (uint32_t)((rng_state * 0x2545F4914F6CDD1DULL) >> 32);
+}
+
+static const char* words[] = {
+    "player", "mass", "velocity", "force", "position", "target", "score",
+    "width", "height", "angle", "speed", "energy", "sprite", "request",
+    "response", "buffer", "cursor", "layer", "signal", "weight"
+};
+
+#define WORD_COUNT (sizeof(words) / sizeof(words[0]))
+
+// Pick a random word
+static const char* word(void) {
+    return words[next_random() % WORD_COUNT];
+}
+
+// Write an expression of at most the given nesting depth
+static void write_expression(int function, int depth) {
+    switch (depth > 0 ? next_random() % 4 : next_random() % 3) {
+        case 0:
+            printf("%u", next_random() % 100000);
+            break;
+        case 1:
+            printf("\"%s %s\"", word(), word());
+            break;
+        case 2:
+            printf("%s_%d", word(), function);
+            break;
+        default:
+            printf("%s_%u(", word(), next_random() % 1000);
+            write_expression(function, depth - 1);
+            printf(", ");
+            write_expression(function, depth - 1);
+            printf(")");
+            break;
+    }
+}
+
+// Write a small function whose parameters are named after its index
+static void write_function(int index) {
+    int params = next_random() % 4;
+    printf("def %s_fn_%d(", word(), index);
+    for (int i = 0; i < params; i++) {
+        printf("%sp%d", i ? ", " : "", i);
+    }
+    printf("):\n");
+
+    int statements = 2 + next_random() % 5;
+    for (int i = 0; i < statements; i++) {
+        switch (next_random() % 4) {
+            case 0:
+                printf("    run \"update('%s', %u)\"\n", word(), next_random() % 1000);
+                break;
+            case 1:
+                printf("    print(");
+                write_expression(index, 2);
+                printf(")\n");
+                break;
+            case 2:
+                printf("    ");
+                write_expression(index, 3);
+                printf("\n");
+                break;
+            default:
+                printf("    return %s\n", params ? "p0" : "0");
+                break;
+        }
+    }
+    printf("\n");
+}
+
+// Write a statement of calls nested NESTING_DEPTH deep
+static void write_nested_call(int index) {
+    printf("print ");
+    for (int i = 0; i < NESTING_DEPTH; i++) {
+        printf("%s_%d(", word(), i);
+    }
+    printf("%d", index);
+    for (int i = 0; i < NESTING_DEPTH; i++) {
+        printf(")");
+    }
+    printf("\n");
+}
+
+// Write a run statement with a long command string
+static void write_long_run(void) {
+    printf("run %s\"", next_random() % 8 == 0 ? "quantum " : "");
+    int length = 0;
+    while (length < STRING_LENGTH) {
+        length += printf("%s(%u) ", word(), next_random() % 1000);
+    }
+    printf("\"\n");
+}
+
+// Write a function surrounded by comments of every kind
+static void write_commented_function(int index) {
+    printf("// %s %s %s %s %s %s\n", word(), word(), word(), word(), word(), word());
+    printf("## Documentation for %s_fn_%d: %s %s %s\n", word(), index, word(), word(), word());
+    printf("#[\n");
+    int lines = 2 + next_random() % 6;
+    for (int i = 0; i < lines; i++) {
+        printf("   %s %s %s \"%s\" %s\n", word(), word(), word(), word(), word());
+    }
+    printf("]#\n");
+    printf("def commented_%d(x):\n", index);
+    printf("    # %s %s\n", word(), word());
+    printf("    print(x)  // %s %s %s\n", word(), word(), word());
+    printf("\n");
+}
+
+// Write the physics functions the force shape calls
+static void write_force_functions(void) {
+    printf("gravity = 9.81\n");
+    printf("total = 0.0\n\n");
+    printf("def calculate_force(mass, acceleration):\n");
+    printf("    force = mass * acceleration\n");
+    printf("    return force - mass * gravity / 2.5\n\n");
+    printf("def kinetic_energy(mass, velocity):\n");
+    printf("    return 0.5 * mass * velocity * velocity\n\n");
+    printf("def force_0(mass, velocity):\n");
+    printf("    return calculate_force(mass, velocity) + kinetic_energy(mass, velocity) / 100.0\n\n");
+    for (int level = 1; level <= CALL_DEPTH; level++) {
+        printf("def force_%d(mass, velocity):\n", level);
+        printf("    drag = velocity * 0.47 / mass\n");
+        printf("    return force_%d(mass + 0.5, velocity - drag) * 0.5 + force_%d(mass * 1.01, velocity * 0.98) * 0.5\n\n",
+               level - 1, level - 1);
+    }
+}
+
+// Write a statement accumulating the forces on a random body
+static void write_force_statement(int index) {
+    printf("total = total + force_%d(%u.%02u, %u.%u)\n", CALL_DEPTH,
+           1 + next_random() % 200, next_random() % 100, next_random() % 50, next_random() % 10);
+    if (index % PRINT_INTERVAL == PRINT_INTERVAL - 1) {
+        printf("print(total)\n");
+    }
+}
+
+// Write the hashing functions the integers shape calls
+static void write_integer_functions(void) {
+    printf("seed = 2166136261\n");
+    printf("hash = 0\n\n");
+    printf("def mix(h, x):\n");
+    printf("    h = (h ^ x) * 16777619 & 4294967295\n");
+    printf("    return h ^ h >> 13\n\n");
+    printf("def hash_0(h, x):\n");
+    printf("    return mix(h, x %% 65521 + (x << 3)) - (h & 255) * 3\n\n");
+    for (int level = 1; level <= CALL_DEPTH; level++) {
+        printf("def hash_%d(h, x):\n", level);
+        printf("    y = (x * 31 + %d) %% 1000003\n", level);
+        printf("    return hash_%d(h, y) + hash_%d(h ^ y, x | 1) >> 1\n\n", level - 1, level - 1);
+    }
+}
+
+// Write a statement folding a random key into the hash
+static void write_integer_statement(int index) {
+    printf("hash = hash_%d(seed ^ hash, %u) & 4294967295\n", CALL_DEPTH, next_random() % 100000);
+    if (index % PRINT_INTERVAL == PRINT_INTERVAL - 1) {
+        printf("print(hash)\n");
+    }
+}
+
+int main(int argc, char** argv) {
+    if (argc < 3) {
+        fprintf(stderr, "Usage: %s <defs|nesting|strings|comments|mixed|force|integers> <count> [seed]\n", argv[0]);
+        return 1;
+    }
+    const char* shape = argv[1];
+    int count = atoi(argv[2]);
+    rng_state = argc > 3 ? strtoull(argv[3], NULL, 10) : 0x1BE7;
+    if (rng_state == 0) {
+        rng_state = 1;
+    }
+
+    for (int i = 0; i < count; i++) {
+        if (strcmp(shape, "defs") == 0) {
+            write_function(i);
+        } else if (strcmp(shape, "nesting") == 0) {
+            write_nested_call(i);
+        } else if (strcmp(shape, "strings") == 0) {
+            write_long_run();
+        } else if (strcmp(shape, "comments") == 0) {
+            write_commented_function(i);
+        } else if (strcmp(shape, "mixed") == 0) {
+            switch (i % 4) {
+                case 0: write_function(i); break;
+                case 1: write_nested_call(i); break;
+                case 2: write_long_run(); break;
+                default: write_commented_function(i); break;
+            }
+        } else if (strcmp(shape, "force") == 0) {
+            if (i == 0) {
+                write_force_functions();
+            }
+            write_force_statement(i);
+        } else if (strcmp(shape, "integers") == 0) {
+            if (i == 0) {
+                write_integer_functions();
+            }
+            write_integer_statement(i);
+        } else {
+            fprintf(stderr, "Unknown shape '%s'\n", shape);
+            return 1;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,124 @@
+// Build-time generator for the keyword perfect hash table.
+//
+// Reads the keyword list from src/compiler/keywords.def, searches for a
+// hash seed that maps every keyword to a distinct slot of the smallest
+// power-of-two table it can find, and writes keyword_table.h to stdout.
+#include "keywords.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_TABLE_BITS 14
+#define SEED_ATTEMPTS 200000
+
+typedef struct {
+    const char* text;
+    const char* type_name;
+    int length;
+} Keyword;
+
+static Keyword keywords[] = {
+#define KEYWORD(text, type) {text, #type, sizeof(text) - 1},
+#include "keywords.def"
+#undef KEYWORD
+};
+
+#define KEYWORD_COUNT ((int)(sizeof(keywords) / sizeof(keywords[0])))
+
+// Deterministic generator so the output is reproducible
+static uint64_t next_random(uint64_t* state) {
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+    return *state;
+}
+
+// Check if seed places every keyword in its own slot
+static bool is_perfect(uint64_t seed, int bits, uint8_t* used) {
+    memset(used, 0, (size_t)1 << bits);
+    for (int i = 0; i < KEYWORD_COUNT; i++) {
+        uint32_t slot = keyword_slot(keywords[i].text, keywords[i].length, seed, bits);
+        if (used[slot]) {
+            return false;
+        }
+        used[slot] = 1;
+    }
+    return true;
+}
+
+int main(void) {
+    int min_length = 1 << 30;
+    int max_length = 0;
+
+    for (int i = 0; i < KEYWORD_COUNT; i++) {
+        Keyword* kw = &keywords[i];
+        if (kw->length < 2) {
+            fprintf(stderr, "gen_keywords: keyword '%s' is shorter than 2 bytes\n", kw->text);
+            return 1;
+        }
+        for (int j = 0; j < i; j++) {
+            if (strcmp(keywords[j].text, kw->text) == 0) {
+                fprintf(stderr, "gen_keywords: duplicate keyword '%s'\n", kw->text);
+                return 1;
+            }
+        }
+        if (kw->length < min_length) min_length = kw->length;
+        if (kw->length > max_length) max_length = kw->length;
+    }
+
+    int bits = 1;
+    while ((1 << bits) < KEYWORD_COUNT) {
+        bits++;
+    }
+
+    uint8_t* used = (uint8_t*)malloc((size_t)1 << MAX_TABLE_BITS);
+    uint64_t state = 0x9E3779B97F4A7C15ULL;
+    uint64_t seed = 0;
+    bool found = false;
+    for (; bits <= MAX_TABLE_BITS && !found; bits++) {
+        for (int attempt = 0; attempt < SEED_ATTEMPTS; attempt++) {
+            seed = next_random(&state) | 1;
+            if (is_perfect(seed, bits, used)) {
+                found = true;
+                break;
+            }
+        }
+    }
+    free(used);
+    bits--;
+
+    if (!found) {
+        fprintf(stderr, "gen_keywords: no perfect hash found for %d keywords\n", KEYWORD_COUNT);
+        return 1;
+    }
+
+    printf("// Generated by tools/gen_keywords.c from keywords.def. Do not edit.\n");
+    printf("#define KEYWORD_COUNT %d\n", KEYWORD_COUNT);
+    printf("#define KEYWORD_MIN_LENGTH %d\n", min_length);
+    printf("#define KEYWORD_MAX_LENGTH %d\n", max_length);
+    printf("#define KEYWORD_HASH_SEED 0x%016llXULL\n", (unsigned long long)seed);
+    printf("#define KEYWORD_HASH_BITS %d\n\n", bits);
+    // Sparse slot array of small indices into a dense entry array; entry 0 is
+    // the empty entry that never matches
+    uint16_t* slots = (uint16_t*)calloc((size_t)1 << bits, sizeof(uint16_t));
+    for (int i = 0; i < KEYWORD_COUNT; i++) {
+        slots[keyword_slot(keywords[i].text, keywords[i].length, seed, bits)] = (uint16_t)(i + 1);
+    }
+
+    printf("static const KeywordEntry keyword_entries[%d] = {\n", KEYWORD_COUNT + 1);
+    printf("    {\"\", 0, TOKEN_IDENTIFIER},\n");
+    for (int i = 0; i < KEYWORD_COUNT; i++) {
+        printf("    {\"%s\", %d, %s},\n",
+               keywords[i].text, keywords[i].length, keywords[i].type_name);
+    }
+    printf("};\n\n");
+
+    printf("static const %s keyword_slots[%d] = {",
+           KEYWORD_COUNT < 255 ? "uint8_t" : "uint16_t", 1 << bits);
+    for (int i = 0; i < (1 << bits); i++) {
+        printf("%s%u,", i % 16 == 0 ? "\n    " : " ", slots[i]);
+    }
+    printf("\n};\n");
+    free(slots);
+    return 0;
+}
@@ -0,0 +1,162 @@
+// Build-time generator for the powers-of-five table of number parsing.
+//
+// For every decimal exponent q in [POW5_MIN_EXPONENT, POW5_MAX_EXPONENT]
+// writes the 128 most significant bits of 5^q, normalized so that bit 127
+// is set: truncated for q >= 0, and for q < 0 a reciprocal rounded up, as
+// the Eisel-Lemire algorithm expects. The table goes to stdout as
+// pow5_table.h.
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#define POW5_MIN_EXPONENT -342
+#define POW5_MAX_EXPONENT 308
+
+// Big enough for 2^b with b = 2 * bits(5^342) + 128
+#define LIMBS 64
+
+// Unsigned big integer, little-endian 32-bit limbs
+typedef struct {
+    uint32_t limb[LIMBS];
+} Big;
+
+// Get the number of significant bits
+static int big_bits(const Big* a) {
+    for (int i = LIMBS - 1; i >= 0; i--) {
+        if (a->limb[i]) {
+            int bits = 32;
+            while (!(a->limb[i] >> (bits - 1))) {
+                bits--;
+            }
+            return i * 32 + bits;
+        }
+    }
+    return 0;
+}
+
+// Multiply by a small factor in place
+static void big_multiply(Big* a, uint32_t factor) {
+    uint64_t carry = 0;
+    for (int i = 0; i < LIMBS; i++) {
+        uint64_t product = (uint64_t)a->limb[i] * factor + carry;
+        a->limb[i] = (uint32_t)product;
+        carry = product >> 32;
+    }
+}
+
+// Shift left by one bit in place, or-ing in a new low bit
+static void big_shift_in(Big* a, int bit) {
+    uint32_t carry = (uint32_t)bit;
+    for (int i = 0; i < LIMBS; i++) {
+        uint32_t next = a->limb[i] >> 31;
+        a->limb[i] = (a->limb[i] << 1) | carry;
+        carry = next;
+    }
+}
+
+// Shift right by count bits in place
+static void big_shift_right(Big* a, int count) {
+    for (int n = 0; n < count; n++) {
+        for (int i = 0; i < LIMBS; i++) {
+            uint32_t next = i + 1 < LIMBS ? a->limb[i + 1] & 1 : 0;
+            a->limb[i] = (a->limb[i] >> 1) | (next << 31);
+        }
+    }
+}
+
+// Compare two big integers
+static int big_compare(const Big* a, const Big* b) {
+    for (int i = LIMBS - 1; i >= 0; i--) {
+        if (a->limb[i] != b->limb[i]) {
+            return a->limb[i] > b->limb[i] ? 1 : -1;
+        }
+    }
+    return 0;
+}
+
+// Subtract b from a in place; a must not be smaller
+static void big_subtract(Big* a, const Big* b) {
+    uint64_t borrow = 0;
+    for (int i = 0; i < LIMBS; i++) {
+        uint64_t difference = (uint64_t)a->limb[i] - b->limb[i] - borrow;
+        a->limb[i] = (uint32_t)difference;
+        borrow = (difference >> 32) & 1;
+    }
+}
+
+// Add one in place
+static void big_increment(Big* a) {
+    for (int i = 0; i < LIMBS && ++a->limb[i] == 0; i++) {
+    }
+}
+
+// Set quotient to floor(2^exponent / divisor) by binary long division
+static void big_divide_power_of_two(int exponent, const Big* divisor, Big* quotient) {
+    Big remainder;
+    memset(&remainder, 0, sizeof(remainder));
+    memset(quotient, 0, sizeof(*quotient));
+    for (int bit = exponent; bit >= 0; bit--) {
+        big_shift_in(&remainder, bit == exponent);
+        big_shift_in(quotient, 0);
+        if (big_compare(&remainder, divisor) >= 0) {
+            big_subtract(&remainder, divisor);
+            quotient->limb[0] |= 1;
+        }
+    }
+}
+
+// Get 5^n
+static void big_power_of_five(int n, Big* out) {
+    memset(out, 0, sizeof(*out));
+    out->limb[0] = 1;
+    for (int i = 0; i < n; i++) {
+        big_multiply(out, 5);
+    }
+}
+
+// Print the value as its high and low 64-bit halves; it must fit 128 bits
+static void print_entry(const Big* a, int q) {
+    uint64_t high = ((uint64_t)a->limb[3] << 32) | a->limb[2];
+    uint64_t low = ((uint64_t)a->limb[1] << 32) | a->limb[0];
+    printf("    0x%016llXULL, 0x%016llXULL, // 5^%d\n",
+           (unsigned long long)high, (unsigned long long)low, q);
+}
+
+int main(void) {
+    printf("// Generated by tools/gen_pow5.c. Do not edit.\n");
+    printf("#define POW5_MIN_EXPONENT %d\n", POW5_MIN_EXPONENT);
+    printf("#define POW5_MAX_EXPONENT %d\n\n", POW5_MAX_EXPONENT);
+    printf("static const uint64_t pow5_table[%d] = {\n",
+           2 * (POW5_MAX_EXPONENT - POW5_MIN_EXPONENT + 1));
+
+    for (int q = POW5_MIN_EXPONENT; q < 0; q++) {
+        Big power, value;
+        big_power_of_five(-q, &power);
+        int z = big_bits(&power);
+        // Small reciprocals are exact enough with 127 extra bits; the rest
+        // get twice the divisor's width before truncating to 128 bits
+        int exponent = q >= -27 ? z + 127 : 2 * z + 128;
+        big_divide_power_of_two(exponent, &power, &value);
+        big_increment(&value);
+        int excess = big_bits(&value) - 128;
+        if (excess > 0) {
+            big_shift_right(&value, excess);
+        }
+        print_entry(&value, q);
+    }
+    for (int q = 0; q <= POW5_MAX_EXPONENT; q++) {
+        Big value;
+        big_power_of_five(q, &value);
+        int bits = big_bits(&value);
+        if (bits > 128) {
+            big_shift_right(&value, bits - 128);
+        } else {
+            for (int i = bits; i < 128; i++) {
+                big_shift_in(&value, 0);
+            }
+        }
+        print_entry(&value, q);
+    }
+    printf("};\n");
+    return 0;
+}